@@ -109,7 +109,7 @@ namespace mage::crypto::ot {
         network_in.finish_read(sizeof(block) * num_choices);
     }
 
-    PipelinedCorrelatedExtSender::PipelinedCorrelatedExtSender(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, block choice_delta, util::UserPipe<block>& results, std::size_t batch_size, std::size_t max_depth)
+    PipelinedCorrelatedExtSender::PipelinedCorrelatedExtSender(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, block choice_delta, util::SPSCUserPipe<block>& results, std::size_t batch_size, std::size_t max_depth)
         : net_in(network_in), net_out(network_out), delta(choice_delta), output(results), num_choices(batch_size), depth(max_depth) {
         assert(this->num_choices != 0); // sse_trans does not work for zero-size matrices
 
@@ -117,7 +117,7 @@ namespace mage::crypto::ot {
 
         this->num_row_blocks = (this->num_choices + block_num_bits - 1) / block_num_bits;
         this->num_blocks = this->num_row_blocks * extension_kappa;
-        this->pipeline = std::make_unique<util::UserPipe<crypto::block>>(this->num_blocks * this->depth);
+        this->pipeline = std::make_unique<util::SPSCUserPipe<crypto::block>>(this->num_blocks * this->depth);
 
         this->start_daemon();
     }
@@ -162,7 +162,7 @@ namespace mage::crypto::ot {
         this->pipeline->finish_write_in_place(this->num_blocks);
     }
 
-    PipelinedCorrelatedExtChooser::PipelinedCorrelatedExtChooser(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, util::UserPipe<block>& results, std::size_t batch_size, std::size_t max_depth)
+    PipelinedCorrelatedExtChooser::PipelinedCorrelatedExtChooser(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, util::SPSCUserPipe<block>& results, std::size_t batch_size, std::size_t max_depth)
         : net_in(network_in), net_out(network_out), output(results), num_choices(batch_size), depth(max_depth) {
         assert(this->num_choices != 0); // sse_trans does not work for zero-size matrices
 
@@ -170,7 +170,7 @@ namespace mage::crypto::ot {
 
         this->num_row_blocks = (this->num_choices + block_num_bits - 1) / block_num_bits;
         this->num_blocks = this->num_row_blocks * extension_kappa;
-        this->pipeline = std::make_unique<util::UserPipe<crypto::block>>((this->num_row_blocks + this->num_blocks) * this->depth);
+        this->pipeline = std::make_unique<util::SPSCUserPipe<crypto::block>>((this->num_row_blocks + this->num_blocks) * this->depth);
 
         this->start_daemon();
     }
@@ -49,7 +49,7 @@ namespace mage::crypto::ot {
 
     class PipelinedCorrelatedExtSender : private CorrelatedExtensionSender {
     public:
-        PipelinedCorrelatedExtSender(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, block choice_delta, util::UserPipe<block>& results, std::size_t batch_size, std::size_t max_depth);
+        PipelinedCorrelatedExtSender(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, block choice_delta, util::SPSCUserPipe<block>& results, std::size_t batch_size, std::size_t max_depth);
         ~PipelinedCorrelatedExtSender();
 
         /* WARNING: Do not call this concurrently from multiple threads. */
@@ -65,17 +65,17 @@ namespace mage::crypto::ot {
 
         std::size_t num_row_blocks;
         std::size_t num_blocks;
-        std::unique_ptr<util::UserPipe<crypto::block>> pipeline;
+        std::unique_ptr<util::SPSCUserPipe<crypto::block>> pipeline;
 
         block delta;
 
-        util::UserPipe<block>& output;
+        util::SPSCUserPipe<block>& output;
         std::thread daemon;
     };
 
     class PipelinedCorrelatedExtChooser : private CorrelatedExtensionChooser {
     public:
-        PipelinedCorrelatedExtChooser(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, util::UserPipe<block>& results, std::size_t batch_size, std::size_t max_depth);
+        PipelinedCorrelatedExtChooser(util::BufferedFileReader<false>& network_in, util::BufferedFileWriter<false>& network_out, util::SPSCUserPipe<block>& results, std::size_t batch_size, std::size_t max_depth);
         ~PipelinedCorrelatedExtChooser();
 
         void start_daemon();
@@ -91,9 +91,9 @@ namespace mage::crypto::ot {
 
         std::size_t num_row_blocks;
         std::size_t num_blocks;
-        std::unique_ptr<util::UserPipe<crypto::block>> pipeline;
+        std::unique_ptr<util::SPSCUserPipe<crypto::block>> pipeline;
 
-        util::UserPipe<block>& output;
+        util::SPSCUserPipe<block>& output;
         std::thread daemon;
     };
 }
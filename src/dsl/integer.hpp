@@ -743,9 +743,9 @@ namespace mage::dsl {
         /**
          * @brief Swaps the values of @p arg0 and @p arg1 if @p predicate is 1.
          *
-         * This is implemented by composing existing operator and assigning to
-         * the provided Integers. So the allocated memory for @p arg0 and
-         * @p arg1 may change, invalidated any prior slices of those Integers.
+         * This is implemented as a single CondSwap instruction that updates
+         * the memory of @p arg0 and @p arg1 in place, so any prior slices of
+         * those Integers remain valid.
          *
          * @param predicate Determines whether the values of the two other
          * arguments are swapped.
@@ -757,9 +757,14 @@ namespace mage::dsl {
         template <bool predicate_sliced>
         static void swap_if(const Bit<predicate_sliced, Placer, p>& predicate, Integer<bits, false, Placer, p>& arg0, Integer<bits, false, Placer, p>& arg1) {
             assert(arg0.valid() && arg1.valid());
-            Integer<bits, false, Placer, p> mask = Integer<bits, false, Placer, p>::select(predicate, arg0, arg1) ^ arg1;
-            arg0 = arg0 ^ mask;
-            arg1 = arg1 ^ mask;
+            Instruction& instr = (*p)->instruction();
+            instr.header.operation = OpCode::CondSwap;
+            instr.header.width = bits;
+            instr.header.flags = 0;
+            instr.header.output = arg0.v;
+            instr.two_args.input1 = arg1.v;
+            instr.two_args.input2 = predicate.v;
+            (*p)->commit_instruction(0);
         }
 
         /**
@@ -767,9 +772,8 @@ namespace mage::dsl {
          * that arg0's value is less than or equal to arg1's value after the
          * operation.
          *
-         * This is implemented using swap_if(), so the allocated memory for
-         * @p arg0 and @p arg1 may change, invalidated any prior slices of
-         * those Integers.
+         * This is implemented using swap_if(), so @p arg0 and @p arg1 are
+         * updated in place.
          *
          * @param arg0 A reference to the first Integer whose value to compare
          * and potentially swap.
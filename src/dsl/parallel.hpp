@@ -37,6 +37,35 @@
 #include <vector>
 
 namespace mage::dsl {
+    /**
+     * @brief Communication pattern used to reduce values held by different
+     * workers.
+     */
+    enum class Reduction : std::uint8_t {
+        /**
+         * @brief Every worker sends its value directly to the worker that
+         * obtains the result, which combines them one at a time. This takes
+         * one round of communication, but the worker that obtains the
+         * result receives and combines num_proc - 1 values.
+         */
+        Direct,
+
+        /**
+         * @brief Values are combined along a binomial tree rooted at the
+         * worker that obtains the result. This takes log2(num_proc) rounds,
+         * and no worker receives more than log2(num_proc) values.
+         */
+        BinomialTree,
+
+        /**
+         * @brief Values are combined by recursive doubling, so that every
+         * worker obtains the result. This takes log2(num_proc) rounds (plus
+         * two if num_proc is not a power of two), and the work is spread
+         * evenly among workers.
+         */
+        RecursiveDoubling
+    };
+
     /**
      * @brief Information of the program's distribution and worker layout,
      * with some utility functions that use that information.
@@ -59,15 +88,29 @@ namespace mage::dsl {
          * It is expected that all workers will call this function
          * concurrently.
          *
+         * The function @p f must be associative and commutative, since the
+         * order in which the values are combined depends on @p algorithm.
+         *
          * @tparam T The type of the items to reduce.
          * @param gets_result The ID of the worker who obtains the result.
          * @param local_aggregate The local aggregate of this worker.
          * @param f The functon used to reduce the values.
+         * @param algorithm The communication pattern used for the reduction.
          * @return Returns the result of the reduction for the worker whose ID
          * is @p gets_result, and an empty optional for all other workers.
          */
         template <typename T>
-        std::optional<T> reduce_aggregates(WorkerID gets_result, T& local_aggregate, std::function<T(T&, T&)> f) const {
+        std::optional<T> reduce_aggregates(WorkerID gets_result, T& local_aggregate, std::function<T(T&, T&)> f, Reduction algorithm = Reduction::Direct) const {
+            if (algorithm == Reduction::BinomialTree) {
+                return this->tree_reduce_aggregates(gets_result, local_aggregate, f);
+            } else if (algorithm == Reduction::RecursiveDoubling) {
+                T result = this->all_reduce_aggregates(local_aggregate, f);
+                if (this->self_id == gets_result) {
+                    return std::move(result);
+                }
+                return std::nullopt;
+            }
+
             T current = std::move(local_aggregate);
             if (this->self_id == gets_result) {
                 std::vector<T> partial_reduction(this->num_proc - 1);
@@ -90,6 +133,116 @@ namespace mage::dsl {
             }
         }
 
+        /**
+         * @brief Helps reduce a dataset partitioned over multiple workers to a
+         * single value, assuming each worker has performed local reduction,
+         * by combining values along a binomial tree.
+         *
+         * In round i, each worker whose rank (relative to @p gets_result) is
+         * an odd multiple of 2^i sends its partial aggregate to the worker
+         * 2^i ranks below it, which combines it into its own. It is expected
+         * that all workers will call this function concurrently.
+         *
+         * @tparam T The type of the items to reduce.
+         * @param gets_result The ID of the worker who obtains the result.
+         * @param local_aggregate The local aggregate of this worker.
+         * @param f The functon used to reduce the values.
+         * @return Returns the result of the reduction for the worker whose ID
+         * is @p gets_result, and an empty optional for all other workers.
+         */
+        template <typename T>
+        std::optional<T> tree_reduce_aggregates(WorkerID gets_result, T& local_aggregate, std::function<T(T&, T&)> f) const {
+            T current = std::move(local_aggregate);
+            WorkerID rank = (this->self_id + this->num_proc - gets_result) % this->num_proc;
+            for (WorkerID stride = 1; stride < this->num_proc; stride <<= 1) {
+                if ((rank & stride) != 0) {
+                    WorkerID to = (rank - stride + gets_result) % this->num_proc;
+                    current.buffer_send(to);
+                    T::finish_send(to);
+                    return std::nullopt;
+                }
+                if (rank + stride < this->num_proc) {
+                    WorkerID from = (rank + stride + gets_result) % this->num_proc;
+                    T partial;
+                    partial.post_receive(from);
+                    T::finish_receive(from);
+                    current = f(current, partial);
+                }
+            }
+            return std::move(current);
+        }
+
+        /**
+         * @brief Reduces a dataset partitioned over multiple workers to a
+         * single value, which every worker obtains, assuming each worker has
+         * performed local reduction.
+         *
+         * This uses recursive doubling: in round i, each worker exchanges its
+         * partial aggregate with the worker whose ID differs from its own in
+         * bit i, and both combine the two. If the number of workers is not a
+         * power of two, the workers beyond the largest power of two first
+         * fold their values into a partner, and receive the result from that
+         * partner at the end. It is expected that all workers will call this
+         * function concurrently.
+         *
+         * The function @p f must be associative and commutative. It is always
+         * invoked with the value from the lower-numbered worker first, so
+         * both workers in an exchange compute the same result.
+         *
+         * @tparam T The type of the items to reduce.
+         * @param local_aggregate The local aggregate of this worker.
+         * @param f The functon used to reduce the values.
+         * @return The result of the reduction.
+         */
+        template <typename T>
+        T all_reduce_aggregates(T& local_aggregate, std::function<T(T&, T&)> f) const {
+            T current = std::move(local_aggregate);
+            WorkerID pow2 = 1;
+            while ((pow2 << 1) <= this->num_proc) {
+                pow2 <<= 1;
+            }
+
+            if (this->self_id >= pow2) {
+                WorkerID partner = this->self_id - pow2;
+                current.buffer_send(partner);
+                T::finish_send(partner);
+                T result;
+                result.post_receive(partner);
+                T::finish_receive(partner);
+                return std::move(result);
+            }
+
+            if (this->self_id + pow2 < this->num_proc) {
+                WorkerID partner = this->self_id + pow2;
+                T extra;
+                extra.post_receive(partner);
+                T::finish_receive(partner);
+                current = f(current, extra);
+            }
+
+            for (WorkerID stride = 1; stride != pow2; stride <<= 1) {
+                WorkerID partner = this->self_id ^ stride;
+                T other;
+                other.post_receive(partner);
+                current.buffer_send(partner);
+                T::finish_send(partner);
+                T::finish_receive(partner);
+                if (partner < this->self_id) {
+                    current = f(other, current);
+                } else {
+                    current = f(current, other);
+                }
+            }
+
+            if (this->self_id + pow2 < this->num_proc) {
+                WorkerID partner = this->self_id + pow2;
+                current.buffer_send(partner);
+                T::finish_send(partner);
+            }
+
+            return std::move(current);
+        }
+
         /*
          * @brief Reorganizes elements of the two argument arrays A and B,
          * assigning each element of each list to multiple workers, so that,
@@ -29,9 +29,14 @@
 #ifndef MAGE_ENGINE_ANDXOR_HPP_
 #define MAGE_ENGINE_ANDXOR_HPP_
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 #include "addr.hpp"
 #include "opcode.hpp"
 #include "engine/engine.hpp"
@@ -76,6 +81,8 @@ namespace mage::engine {
             this->init(worker["storage_path"].as_string(), byte_page_size, header.num_pages, header.num_swap_pages, header.max_concurrent_swaps);
             this->input.enable_stats("READ-INSTR (ns)");
             this->wires = reinterpret_cast<typename ProtEngine::Wire*>(this->get_memory());
+            this->protocol.zero(this->public_constants[0]);
+            this->protocol.one(this->public_constants[1]);
         }
 
         /**
@@ -87,13 +94,81 @@ namespace mage::engine {
             this->input.set_progress_bar(&this->progress_bar);
             for (InstructionNumber i = 0; i != num_instructions; i++) {
                 PackedPhysInstruction& phys = this->input.start_instruction();
-                std::size_t size = this->execute_instruction(phys);
+                std::size_t size;
+                if constexpr (ProtEngine::concurrent_gates) {
+                    size = this->schedule_instruction(phys);
+                } else {
+                    size = this->execute_instruction(phys);
+                }
                 this->input.finish_instruction(size);
             }
+            if constexpr (ProtEngine::concurrent_gates) {
+                this->flush_batch();
+            }
             this->progress_bar.finish();
         }
 
     private:
+        /*
+         * Returns the value of the specified wire if it holds the protocol's
+         * encoding of a public constant (as written by a PublicConstant
+         * instruction), or -1 otherwise.
+         */
+        int public_constant(const typename ProtEngine::Wire& wire) const {
+            for (int value = 0; value != 2; value++) {
+                if (std::memcmp(&wire, &this->public_constants[value], sizeof(wire)) == 0) {
+                    return value;
+                }
+            }
+            return -1;
+        }
+
+        /*
+         * Computes the AND of two wires. If the planner marked an input as
+         * possibly holding public constants, and it does, the protocol's
+         * AND gate is skipped.
+         */
+        void op_and(typename ProtEngine::Wire& output, const typename ProtEngine::Wire& input1, bool check1, const typename ProtEngine::Wire& input2, bool check2) {
+            int constant1 = check1 ? this->public_constant(input1) : -1;
+            int constant2 = check2 ? this->public_constant(input2) : -1;
+            if (constant1 == 0 || constant2 == 0) {
+                this->protocol.zero(output);
+            } else if (constant1 == 1) {
+                this->protocol.op_copy(output, input2);
+            } else if (constant2 == 1) {
+                this->protocol.op_copy(output, input1);
+            } else {
+                this->protocol.op_and(output, input1, input2);
+            }
+        }
+
+        /*
+         * Returns a scratch buffer of at least the specified number of wires,
+         * which remains valid until the next call to this function.
+         */
+        typename ProtEngine::Wire* scratch_wires(std::uint64_t count) {
+            if (this->scratch_space.size() < count) {
+                this->scratch_space.resize(count);
+            }
+            return this->scratch_space.data();
+        }
+
+        /*
+         * Invokes F on each integer from 0 to COUNT - 1. The invocations must
+         * not depend on each other, so that protocols with concurrent_gates
+         * can run them in parallel.
+         */
+        template <typename F>
+        void for_each_independent(std::uint64_t count, F&& f) {
+            if constexpr (ProtEngine::concurrent_gates) {
+                this->protocol.parallel_for(count, std::forward<F>(f));
+            } else {
+                for (std::uint64_t i = 0; i != count; i++) {
+                    f(i);
+                }
+            }
+        }
+
         void execute_public_constant(const PackedPhysInstruction& phys) {
             typename ProtEngine::Wire* output = &this->wires[phys.constant.output];
             BitWidth width = phys.constant.width;
@@ -119,6 +194,11 @@ namespace mage::engine {
 
         template <bool final_carry>
         void execute_int_add(const PackedPhysInstruction& phys) {
+            if constexpr (ProtEngine::low_depth_circuits) {
+                this->execute_int_add_low_depth<final_carry>(phys);
+                return;
+            }
+
             typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
             typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
             typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
@@ -168,6 +248,11 @@ namespace mage::engine {
         }
 
         void execute_int_sub(const PackedPhysInstruction& phys) {
+            if constexpr (ProtEngine::low_depth_circuits) {
+                this->execute_int_sub_low_depth(phys);
+                return;
+            }
+
             typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
             typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
             typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
@@ -212,47 +297,180 @@ namespace mage::engine {
             // skip computing the final output carry
         }
 
+        /*
+         * Adds the ADDEND_WIDTH-bit integer ADDEND into the ACC_WIDTH-bit
+         * integer ACC in place, discarding the final carry. ADDEND_WIDTH must
+         * be at most ACC_WIDTH.
+         */
+        void add_into(typename ProtEngine::Wire* acc, BitWidth acc_width, const typename ProtEngine::Wire* addend, BitWidth addend_width) {
+            typename ProtEngine::Wire temp1;
+            typename ProtEngine::Wire temp2;
+            typename ProtEngine::Wire temp3;
+            typename ProtEngine::Wire carry;
+            this->protocol.zero(carry);
+            for (BitWidth i = 0; i != acc_width; i++) {
+                bool last = (i == acc_width - 1);
+                if (i < addend_width) {
+                    this->protocol.op_xor(temp1, acc[i], carry);
+                    this->protocol.op_xor(temp2, addend[i], carry);
+                    this->protocol.op_xor(acc[i], temp1, addend[i]);
+                    if (!last) {
+                        this->protocol.op_and(temp3, temp1, temp2);
+                        this->protocol.op_xor(carry, carry, temp3);
+                    }
+                } else {
+                    this->protocol.op_copy(temp1, acc[i]);
+                    this->protocol.op_xor(acc[i], temp1, carry);
+                    if (!last) {
+                        this->protocol.op_and(carry, carry, temp1);
+                    }
+                }
+            }
+        }
+
+        /*
+         * Subtracts the SUBTRAHEND_WIDTH-bit integer SUBTRAHEND from the
+         * ACC_WIDTH-bit integer ACC in place, discarding the final borrow.
+         * SUBTRAHEND_WIDTH must be at most ACC_WIDTH.
+         */
+        void subtract_from(typename ProtEngine::Wire* acc, BitWidth acc_width, const typename ProtEngine::Wire* subtrahend, BitWidth subtrahend_width) {
+            typename ProtEngine::Wire temp1;
+            typename ProtEngine::Wire temp2;
+            typename ProtEngine::Wire temp3;
+            typename ProtEngine::Wire borrow;
+            this->protocol.zero(borrow);
+            for (BitWidth i = 0; i != acc_width; i++) {
+                bool last = (i == acc_width - 1);
+                if (i < subtrahend_width) {
+                    this->protocol.op_xor(temp1, acc[i], borrow);
+                    this->protocol.op_xor(temp2, subtrahend[i], borrow);
+                    this->protocol.op_xor(acc[i], temp1, subtrahend[i]);
+                    if (!last) {
+                        this->protocol.op_and(temp3, temp1, temp2);
+                        this->protocol.op_xor(borrow, temp3, subtrahend[i]);
+                    }
+                } else {
+                    this->protocol.op_not(temp1, acc[i]);
+                    this->protocol.op_xor(acc[i], acc[i], borrow);
+                    if (!last) {
+                        this->protocol.op_and(borrow, borrow, temp1);
+                    }
+                }
+            }
+        }
+
+        /*
+         * Operands narrower than this are multiplied with the schoolbook
+         * method. Counting AND gates for widths from 8 to 256 bits showed
+         * that below 16 bits, the additions that Karatsuba's method needs
+         * cost more than the multiplication it saves.
+         */
+        static constexpr BitWidth karatsuba_threshold = 16;
+
+        /*
+         * Returns the number of scratch wires needed by multiply() for
+         * operands of the specified width.
+         */
+        static std::uint64_t multiply_scratch_size(BitWidth width) {
+            if (width < karatsuba_threshold) {
+                return width;
+            }
+            BitWidth high_width = width - (width >> 1);
+            return 4 * (static_cast<std::uint64_t>(high_width) + 1) + multiply_scratch_size(high_width + 1);
+        }
+
+        /*
+         * Computes the 2 * WIDTH-bit product of the WIDTH-bit integers INPUT1
+         * and INPUT2 into OUTPUT, which must not overlap either of them.
+         * SCRATCH must hold at least multiply_scratch_size(WIDTH) wires.
+         * Wide operands are split in half and multiplied with Karatsuba's
+         * method, using three half-width multiplications instead of four.
+         */
+        void multiply(typename ProtEngine::Wire* output, const typename ProtEngine::Wire* input1, bool check1, const typename ProtEngine::Wire* input2, bool check2, BitWidth width, typename ProtEngine::Wire* scratch) {
+            if (width < karatsuba_threshold) {
+                typename ProtEngine::Wire* partial_product = scratch;
+                for (BitWidth j = 0; j != width; j++) {
+                    this->op_and(output[j], input1[j], check1, input2[0], check2);
+                }
+                this->protocol.zero(output[width]);
+
+                for (BitWidth i = 1; i != width; i++) {
+                    for (BitWidth j = 0; j != width; j++) {
+                        this->op_and(partial_product[j], input1[j], check1, input2[i], check2);
+                    }
+
+                    /* Add partial_product to output starting at bit i. */
+                    typename ProtEngine::Wire temp1;
+                    typename ProtEngine::Wire temp2;
+                    typename ProtEngine::Wire temp3;
+                    typename ProtEngine::Wire carry;
+                    this->protocol.zero(carry);
+                    for (BitWidth j = 0; j != width; j++) {
+                        this->protocol.op_xor(temp1, output[i + j], carry);
+                        this->protocol.op_xor(temp2, partial_product[j], carry);
+                        this->protocol.op_xor(output[i + j], temp1, partial_product[j]);
+                        this->protocol.op_and(temp3, temp1, temp2);
+                        this->protocol.op_xor(carry, carry, temp3);
+                    }
+                    this->protocol.op_copy(output[i + width], carry);
+                }
+                return;
+            }
+
+            /* Split each input into a low half and a (possibly wider) high half. */
+            BitWidth low_width = width >> 1;
+            BitWidth high_width = width - low_width;
+            BitWidth sum_width = high_width + 1;
+            typename ProtEngine::Wire* sum1 = scratch;
+            typename ProtEngine::Wire* sum2 = sum1 + sum_width;
+            typename ProtEngine::Wire* middle = sum2 + sum_width;
+            typename ProtEngine::Wire* rest = middle + 2 * sum_width;
+
+            /* The low and high products go directly into the output. */
+            this->multiply(output, input1, check1, input2, check2, low_width, rest);
+            this->multiply(output + 2 * low_width, input1 + low_width, check1, input2 + low_width, check2, high_width, rest);
+
+            /* (low1 + high1) * (low2 + high2) - low product - high product */
+            for (BitWidth i = 0; i != high_width; i++) {
+                this->protocol.op_copy(sum1[i], input1[low_width + i]);
+                this->protocol.op_copy(sum2[i], input2[low_width + i]);
+            }
+            this->protocol.zero(sum1[high_width]);
+            this->protocol.zero(sum2[high_width]);
+            this->add_into(sum1, sum_width, input1, low_width);
+            this->add_into(sum2, sum_width, input2, low_width);
+            this->multiply(middle, sum1, false, sum2, false, sum_width, rest);
+            this->subtract_from(middle, 2 * sum_width, output, 2 * low_width);
+            this->subtract_from(middle, 2 * sum_width, output + 2 * low_width, 2 * high_width);
+
+            /* The product fits in the output, so no carry leaves its top bit. */
+            BitWidth upper_width = 2 * width - low_width;
+            this->add_into(output + low_width, upper_width, middle, std::min<BitWidth>(2 * sum_width, upper_width));
+        }
+
         void execute_int_multiply(const PackedPhysInstruction& phys) {
             typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
             typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
             typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
             BitWidth operand_width = phys.two_args.width;
-            BitWidth product_width = operand_width << 1;
+            bool check1 = (phys.header.flags & FlagInput1Constant) != 0;
+            bool check2 = (phys.header.flags & FlagInput2Constant) != 0;
 
             if (operand_width == 0) {
                 return;
             }
 
-            for (BitWidth j = 0; j != operand_width; j++) {
-                this->protocol.op_and(output[j], input1[j], input2[0]);
-            }
-            this->protocol.zero(output[operand_width]);
-
-            for (BitWidth i = 1; i != operand_width; i++) {
-                typename ProtEngine::Wire partial_product[operand_width];
-                for (BitWidth j = 0; j != operand_width; j++) {
-                    this->protocol.op_and(partial_product[j], input1[j], input2[i]);
-                }
-
-                /* Add partial_product to output starting at bit i. */
-                typename ProtEngine::Wire temp1;
-                typename ProtEngine::Wire temp2;
-                typename ProtEngine::Wire temp3;
-                typename ProtEngine::Wire carry;
-                this->protocol.zero(carry);
-                for (BitWidth j = 0; j != operand_width; j++) {
-                    this->protocol.op_xor(temp1, output[i + j], carry);
-                    this->protocol.op_xor(temp2, partial_product[j], carry);
-                    this->protocol.op_xor(output[i + j], temp1, partial_product[j]);
-                    this->protocol.op_and(temp3, temp1, temp2);
-                    this->protocol.op_xor(carry, carry, temp3);
-                }
-                this->protocol.op_copy(output[i + operand_width], carry);
-            }
+            typename ProtEngine::Wire* scratch = this->scratch_wires(multiply_scratch_size(operand_width));
+            this->multiply(output, input1, check1, input2, check2, operand_width, scratch);
         }
 
         /* Based on https://github.com/samee/obliv-c/blob/obliv-c/src/ext/oblivc/obliv_bits.c */
         void execute_int_less(const PackedPhysInstruction& phys) {
+            if constexpr (ProtEngine::low_depth_circuits) {
+                this->execute_int_less_low_depth(phys);
+                return;
+            }
+
             typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
             typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
             typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
@@ -277,6 +495,11 @@ namespace mage::engine {
         }
 
         void execute_equal(const PackedPhysInstruction& phys) {
+            if constexpr (ProtEngine::low_depth_circuits) {
+                this->execute_equal_low_depth(phys);
+                return;
+            }
+
             typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
             typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
             typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
@@ -293,6 +516,139 @@ namespace mage::engine {
             this->protocol.op_copy(*output, result);
         }
 
+        /*
+         * Replaces the carry generate and propagate signals of each bit
+         * position, in GENERATE and PROPAGATE, with those of all bit
+         * positions up to and including it, using a Sklansky parallel-prefix
+         * network. Afterward, generate[i] is the carry out of bit i. The
+         * network has logarithmic depth, and the gates in each level are
+         * independent. Propagate signals of prefixes are not needed to
+         * compute carries, so they are not computed.
+         */
+        void prefix_carries(typename ProtEngine::Wire* generate, typename ProtEngine::Wire* propagate, BitWidth width) {
+            for (BitWidth block = 1; block < width; block <<= 1) {
+                this->for_each_independent(width - block, [&](std::uint64_t k) {
+                    BitWidth i = block + k;
+                    if ((i & block) == 0) {
+                        return;
+                    }
+                    /* Combine with the group ending just before i's block. */
+                    BitWidth j = (i & ~(block - 1)) - 1;
+                    typename ProtEngine::Wire temp;
+                    this->protocol.op_and(temp, propagate[i], generate[j]);
+                    this->protocol.op_xor(generate[i], generate[i], temp);
+                    if (i >= (block << 1)) {
+                        this->protocol.op_and(propagate[i], propagate[i], propagate[j]);
+                    }
+                });
+            }
+        }
+
+        template <bool final_carry>
+        void execute_int_add_low_depth(const PackedPhysInstruction& phys) {
+            typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
+            typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
+            typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
+            BitWidth width = phys.two_args.width;
+
+            typename ProtEngine::Wire* generate = this->scratch_wires(3 * static_cast<std::uint64_t>(width));
+            typename ProtEngine::Wire* propagate = generate + width;
+            typename ProtEngine::Wire* half_sum = propagate + width;
+            this->for_each_independent(width, [&](std::uint64_t i) {
+                this->protocol.op_and(generate[i], input1[i], input2[i]);
+                this->protocol.op_xor(half_sum[i], input1[i], input2[i]);
+                this->protocol.op_copy(propagate[i], half_sum[i]);
+            });
+            this->prefix_carries(generate, propagate, width);
+
+            this->protocol.op_copy(output[0], half_sum[0]);
+            this->for_each_independent(width - 1, [&](std::uint64_t k) {
+                this->protocol.op_xor(output[k + 1], half_sum[k + 1], generate[k]);
+            });
+            if constexpr (final_carry) {
+                this->protocol.op_copy(output[width], generate[width - 1]);
+            }
+        }
+
+        /* Computes input1 + ~input2 + 1 with the same network as addition. */
+        void execute_int_sub_low_depth(const PackedPhysInstruction& phys) {
+            typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
+            typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
+            typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
+            BitWidth width = phys.two_args.width;
+
+            typename ProtEngine::Wire* generate = this->scratch_wires(3 * static_cast<std::uint64_t>(width));
+            typename ProtEngine::Wire* propagate = generate + width;
+            typename ProtEngine::Wire* different = propagate + width;
+            this->for_each_independent(width, [&](std::uint64_t i) {
+                this->protocol.op_xor(different[i], input1[i], input2[i]);
+                this->protocol.op_and(generate[i], input1[i], different[i]);
+                this->protocol.op_not(propagate[i], different[i]);
+            });
+            /* Fold the carry into bit 0, whose generate and propagate signals are exclusive. */
+            this->protocol.op_xor(generate[0], generate[0], propagate[0]);
+            this->prefix_carries(generate, propagate, width);
+
+            this->protocol.op_copy(output[0], different[0]);
+            this->for_each_independent(width - 1, [&](std::uint64_t k) {
+                this->protocol.op_xnor(output[k + 1], different[k + 1], generate[k]);
+            });
+        }
+
+        /*
+         * Compares the inputs with a tree, combining adjacent groups of bits
+         * with (less, equal) = (less_hi ^ (equal_hi & less_lo), equal_hi &
+         * equal_lo).
+         */
+        void execute_int_less_low_depth(const PackedPhysInstruction& phys) {
+            typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
+            typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
+            typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
+            BitWidth width = phys.two_args.width;
+
+            typename ProtEngine::Wire* less = this->scratch_wires(2 * static_cast<std::uint64_t>(width));
+            typename ProtEngine::Wire* equal = less + width;
+            this->for_each_independent(width, [&](std::uint64_t i) {
+                this->protocol.op_xor(equal[i], input1[i], input2[i]);
+                this->protocol.op_and(less[i], input2[i], equal[i]);
+                this->protocol.op_not(equal[i], equal[i]);
+            });
+
+            for (BitWidth block = 1; block < width; block <<= 1) {
+                std::uint64_t num_pairs = (width - block + (block << 1) - 1) / (block << 1);
+                this->for_each_independent(num_pairs, [&](std::uint64_t k) {
+                    BitWidth i = k * (block << 1);
+                    typename ProtEngine::Wire temp;
+                    this->protocol.op_and(temp, equal[i + block], less[i]);
+                    this->protocol.op_xor(less[i], less[i + block], temp);
+                    if (i != 0 || (block << 1) < width) {
+                        this->protocol.op_and(equal[i], equal[i + block], equal[i]);
+                    }
+                });
+            }
+            this->protocol.op_copy(*output, less[0]);
+        }
+
+        void execute_equal_low_depth(const PackedPhysInstruction& phys) {
+            typename ProtEngine::Wire* output = &this->wires[phys.two_args.output];
+            typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
+            typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
+            BitWidth width = phys.two_args.width;
+
+            typename ProtEngine::Wire* equal = this->scratch_wires(width);
+            this->for_each_independent(width, [&](std::uint64_t i) {
+                this->protocol.op_xnor(equal[i], input1[i], input2[i]);
+            });
+            for (BitWidth block = 1; block < width; block <<= 1) {
+                std::uint64_t num_pairs = (width - block + (block << 1) - 1) / (block << 1);
+                this->for_each_independent(num_pairs, [&](std::uint64_t k) {
+                    BitWidth i = k * (block << 1);
+                    this->protocol.op_and(equal[i], equal[i], equal[i + block]);
+                });
+            }
+            this->protocol.op_copy(*output, equal[0]);
+        }
+
         void execute_is_zero(const PackedPhysInstruction& phys) {
             typename ProtEngine::Wire* output = &this->wires[phys.one_arg.output];
             typename ProtEngine::Wire* input = &this->wires[phys.one_arg.input1];
@@ -340,9 +696,11 @@ namespace mage::engine {
             typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
             typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
             BitWidth width = phys.two_args.width;
+            bool check1 = (phys.header.flags & FlagInput1Constant) != 0;
+            bool check2 = (phys.header.flags & FlagInput2Constant) != 0;
 
             for (BitWidth i = 0; i != width; i++) {
-                this->protocol.op_and(output[i], input1[i], input2[i]);
+                this->op_and(output[i], input1[i], check1, input2[i], check2);
             }
         }
 
@@ -351,12 +709,14 @@ namespace mage::engine {
             typename ProtEngine::Wire* input1 = &this->wires[phys.two_args.input1];
             typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
             BitWidth width = phys.two_args.width;
+            bool check1 = (phys.header.flags & FlagInput1Constant) != 0;
+            bool check2 = (phys.header.flags & FlagInput2Constant) != 0;
 
             typename ProtEngine::Wire temp1;
             typename ProtEngine::Wire temp2;
             for (BitWidth i = 0; i != width; i++) {
                 this->protocol.op_xor(temp1, input1[i], input2[i]);
-                this->protocol.op_and(temp2, input1[i], input2[i]);
+                this->op_and(temp2, input1[i], check1, input2[i], check2);
                 this->protocol.op_xor(output[i], temp1, temp2);
             }
         }
@@ -391,6 +751,320 @@ namespace mage::engine {
             }
         }
 
+        void execute_cond_swap(const PackedPhysInstruction& phys) {
+            typename ProtEngine::Wire* arg0 = &this->wires[phys.two_args.output];
+            typename ProtEngine::Wire* arg1 = &this->wires[phys.two_args.input1];
+            typename ProtEngine::Wire* input2 = &this->wires[phys.two_args.input2];
+            BitWidth width = phys.two_args.width;
+            bool check2 = (phys.header.flags & FlagInput2Constant) != 0;
+
+            typename ProtEngine::Wire selector;
+            this->protocol.op_copy(selector, *input2);
+
+            typename ProtEngine::Wire different;
+            typename ProtEngine::Wire mask;
+            for (BitWidth i = 0; i != width; i++) {
+                this->protocol.op_xor(different, arg0[i], arg1[i]);
+                this->op_and(mask, different, false, selector, check2);
+                this->protocol.op_xor(arg0[i], arg0[i], mask);
+                this->protocol.op_xor(arg1[i], arg1[i], mask);
+            }
+        }
+
+        /*
+         * Range [start, end) of wires that an instruction reads or writes.
+         */
+        struct WireRange {
+            PhysAddr start;
+            PhysAddr end;
+
+            bool overlaps(const WireRange& other) const {
+                return this->start < other.end && other.start < this->end;
+            }
+        };
+
+        /*
+         * Wires accessed by an instruction. For bitwise instructions, whose
+         * gates each compute one bit of the output from the same bit of each
+         * input, READS holds the inputs and SELECTOR holds the one-bit
+         * selector, if any, which is shared by all bits.
+         */
+        struct WireAccesses {
+            WireRange writes[2];
+            WireRange reads[2];
+            WireRange selector;
+            std::uint8_t num_writes;
+            std::uint8_t num_reads;
+            bool has_selector;
+
+            /*
+             * Checks that the gates for different bits of a bitwise
+             * instruction do not depend on each other, i.e., that each bit's
+             * gates overwrite only that bit of the inputs.
+             */
+            bool independent_bits() const {
+                for (std::uint8_t w = 0; w != this->num_writes; w++) {
+                    for (std::uint8_t o = w + 1; o != this->num_writes; o++) {
+                        if (this->writes[w].overlaps(this->writes[o]) && this->writes[w].start != this->writes[o].start) {
+                            return false;
+                        }
+                    }
+                    for (std::uint8_t r = 0; r != this->num_reads; r++) {
+                        if (this->reads[r].overlaps(this->writes[w]) && this->reads[r].start != this->writes[w].start) {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+        };
+
+        /*
+         * Fills in ACCESSES if PHYS is a bitwise instruction, whose gates can
+         * be batched with those of neighboring instructions, and returns
+         * whether it is.
+         */
+        static bool bitwise_accesses(const PackedPhysInstruction& phys, WireAccesses& accesses) {
+            PhysAddr output;
+            BitWidth width;
+            accesses.num_writes = 1;
+            accesses.num_reads = 0;
+            accesses.has_selector = false;
+            switch (phys.header.operation) {
+            case OpCode::Copy:
+            case OpCode::BitNOT:
+                output = phys.one_arg.output;
+                width = phys.one_arg.width;
+                accesses.reads[accesses.num_reads++] = { phys.one_arg.input1, phys.one_arg.input1 + width };
+                break;
+            case OpCode::BitAND:
+            case OpCode::BitOR:
+            case OpCode::BitXOR:
+                output = phys.two_args.output;
+                width = phys.two_args.width;
+                accesses.reads[accesses.num_reads++] = { phys.two_args.input1, phys.two_args.input1 + width };
+                accesses.reads[accesses.num_reads++] = { phys.two_args.input2, phys.two_args.input2 + width };
+                break;
+            case OpCode::ValueSelect:
+                output = phys.three_args.output;
+                width = phys.three_args.width;
+                accesses.reads[accesses.num_reads++] = { phys.three_args.input1, phys.three_args.input1 + width };
+                accesses.reads[accesses.num_reads++] = { phys.three_args.input2, phys.three_args.input2 + width };
+                accesses.selector = { phys.three_args.input3, phys.three_args.input3 + 1 };
+                accesses.has_selector = true;
+                break;
+            case OpCode::CondSwap:
+                output = phys.two_args.output;
+                width = phys.two_args.width;
+                accesses.writes[accesses.num_writes++] = { phys.two_args.input1, phys.two_args.input1 + width };
+                accesses.reads[accesses.num_reads++] = { output, output + width };
+                accesses.reads[accesses.num_reads++] = { phys.two_args.input1, phys.two_args.input1 + width };
+                accesses.selector = { phys.two_args.input2, phys.two_args.input2 + 1 };
+                accesses.has_selector = true;
+                break;
+            default:
+                return false;
+            }
+            accesses.writes[0] = { output, output + width };
+            return true;
+        }
+
+        /*
+         * Fills in ACCESSES if PHYS is an arithmetic instruction, which only
+         * accesses the wires of its operands and output, and returns whether
+         * it is.
+         */
+        static bool arithmetic_accesses(const PackedPhysInstruction& phys, WireAccesses& accesses) {
+            PhysAddr output;
+            std::uint64_t output_width;
+            accesses.num_writes = 1;
+            accesses.num_reads = 0;
+            accesses.has_selector = false;
+            switch (phys.header.operation) {
+            case OpCode::PublicConstant:
+                output = phys.constant.output;
+                output_width = phys.constant.width;
+                break;
+            case OpCode::IntIncrement:
+            case OpCode::IntDecrement:
+            case OpCode::IsZero:
+            case OpCode::NonZero:
+                output = phys.one_arg.output;
+                output_width = (phys.header.operation == OpCode::IsZero || phys.header.operation == OpCode::NonZero) ? 1 : phys.one_arg.width;
+                accesses.reads[accesses.num_reads++] = { phys.one_arg.input1, phys.one_arg.input1 + phys.one_arg.width };
+                break;
+            case OpCode::IntAdd:
+            case OpCode::IntAddWithCarry:
+            case OpCode::IntSub:
+            case OpCode::IntMultiply:
+            case OpCode::IntLess:
+            case OpCode::Equal:
+                output = phys.two_args.output;
+                switch (phys.header.operation) {
+                case OpCode::IntAddWithCarry:
+                    output_width = static_cast<std::uint64_t>(phys.two_args.width) + 1;
+                    break;
+                case OpCode::IntMultiply:
+                    output_width = 2 * static_cast<std::uint64_t>(phys.two_args.width);
+                    break;
+                case OpCode::IntLess:
+                case OpCode::Equal:
+                    output_width = 1;
+                    break;
+                default:
+                    output_width = phys.two_args.width;
+                    break;
+                }
+                accesses.reads[accesses.num_reads++] = { phys.two_args.input1, phys.two_args.input1 + phys.two_args.width };
+                accesses.reads[accesses.num_reads++] = { phys.two_args.input2, phys.two_args.input2 + phys.two_args.width };
+                break;
+            default:
+                return false;
+            }
+            accesses.writes[0] = { output, output + output_width };
+            return true;
+        }
+
+        /*
+         * Computes bit I of the output of PHYS, which must be an instruction
+         * accepted by bitwise_accesses(). SELECTOR is a copy of its selector,
+         * if it has one.
+         */
+        void execute_gate_bit(const PackedPhysInstruction& phys, const typename ProtEngine::Wire& selector, BitWidth i) {
+            switch (phys.header.operation) {
+            case OpCode::Copy:
+                this->protocol.op_copy(this->wires[phys.one_arg.output + i], this->wires[phys.one_arg.input1 + i]);
+                break;
+            case OpCode::BitNOT:
+                this->protocol.op_not(this->wires[phys.one_arg.output + i], this->wires[phys.one_arg.input1 + i]);
+                break;
+            case OpCode::BitAND: {
+                bool check1 = (phys.header.flags & FlagInput1Constant) != 0;
+                bool check2 = (phys.header.flags & FlagInput2Constant) != 0;
+                this->op_and(this->wires[phys.two_args.output + i], this->wires[phys.two_args.input1 + i], check1, this->wires[phys.two_args.input2 + i], check2);
+                break;
+            }
+            case OpCode::BitOR: {
+                bool check1 = (phys.header.flags & FlagInput1Constant) != 0;
+                bool check2 = (phys.header.flags & FlagInput2Constant) != 0;
+                typename ProtEngine::Wire temp1;
+                typename ProtEngine::Wire temp2;
+                this->protocol.op_xor(temp1, this->wires[phys.two_args.input1 + i], this->wires[phys.two_args.input2 + i]);
+                this->op_and(temp2, this->wires[phys.two_args.input1 + i], check1, this->wires[phys.two_args.input2 + i], check2);
+                this->protocol.op_xor(this->wires[phys.two_args.output + i], temp1, temp2);
+                break;
+            }
+            case OpCode::BitXOR:
+                this->protocol.op_xor(this->wires[phys.two_args.output + i], this->wires[phys.two_args.input1 + i], this->wires[phys.two_args.input2 + i]);
+                break;
+            case OpCode::ValueSelect: {
+                typename ProtEngine::Wire different;
+                typename ProtEngine::Wire temp;
+                this->protocol.op_xor(different, this->wires[phys.three_args.input1 + i], this->wires[phys.three_args.input2 + i]);
+                this->protocol.op_and(temp, different, selector);
+                this->protocol.op_xor(this->wires[phys.three_args.output + i], temp, this->wires[phys.three_args.input2 + i]);
+                break;
+            }
+            case OpCode::CondSwap: {
+                bool check2 = (phys.header.flags & FlagInput2Constant) != 0;
+                typename ProtEngine::Wire& arg0 = this->wires[phys.two_args.output + i];
+                typename ProtEngine::Wire& arg1 = this->wires[phys.two_args.input1 + i];
+                typename ProtEngine::Wire different;
+                typename ProtEngine::Wire mask;
+                this->protocol.op_xor(different, arg0, arg1);
+                this->op_and(mask, different, false, selector, check2);
+                this->protocol.op_xor(arg0, arg0, mask);
+                this->protocol.op_xor(arg1, arg1, mask);
+                break;
+            }
+            default:
+                std::abort();
+            }
+        }
+
+        /*
+         * Checks if an instruction with the specified accesses depends on, or
+         * is depended on by, an instruction in the current batch.
+         */
+        bool conflicts_with_batch(const WireAccesses& accesses) const {
+            for (const WireRange& written : this->batch_writes) {
+                for (std::uint8_t r = 0; r != accesses.num_reads; r++) {
+                    if (accesses.reads[r].overlaps(written)) {
+                        return true;
+                    }
+                }
+                for (std::uint8_t w = 0; w != accesses.num_writes; w++) {
+                    if (accesses.writes[w].overlaps(written)) {
+                        return true;
+                    }
+                }
+                if (accesses.has_selector && accesses.selector.overlaps(written)) {
+                    return true;
+                }
+            }
+            for (const WireRange& read : this->batch_reads) {
+                for (std::uint8_t w = 0; w != accesses.num_writes; w++) {
+                    if (accesses.writes[w].overlaps(read)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        /*
+         * Adds the provided instruction to the current batch of instructions
+         * whose gates are all independent, if possible, and executes it
+         * otherwise. The gates of a batch are evaluated in parallel when it
+         * is flushed. Selectors are copied when an instruction joins the
+         * batch, so later instructions may overwrite them without ending the
+         * batch; likewise, an arithmetic instruction that is independent of
+         * the batch is executed right away, ahead of it. Together, these let
+         * the conditional swaps of a sorting network, which reuse one wire
+         * for the comparison results between them, share a batch.
+         */
+        std::size_t schedule_instruction(const PackedPhysInstruction& phys) {
+            WireAccesses accesses;
+            if (!bitwise_accesses(phys, accesses) || !accesses.independent_bits()) {
+                if (!arithmetic_accesses(phys, accesses) || this->conflicts_with_batch(accesses)) {
+                    this->flush_batch();
+                }
+                return this->execute_instruction(phys);
+            }
+            if (this->batch.size() == max_batch_instructions || this->conflicts_with_batch(accesses)) {
+                this->flush_batch();
+            }
+
+            this->batch.push_back(phys);
+            this->batch_offsets.push_back(this->batch_offsets.back() + (accesses.writes[0].end - accesses.writes[0].start));
+            this->batch_selectors.emplace_back();
+            if (accesses.has_selector) {
+                this->protocol.op_copy(this->batch_selectors.back(), this->wires[accesses.selector.start]);
+            }
+            this->batch_reads.insert(this->batch_reads.end(), &accesses.reads[0], &accesses.reads[accesses.num_reads]);
+            this->batch_writes.insert(this->batch_writes.end(), &accesses.writes[0], &accesses.writes[accesses.num_writes]);
+            return PackedPhysInstruction::size(phys.header.operation);
+        }
+
+        /*
+         * Evaluates the gates of the current batch of instructions, and
+         * starts a new, empty batch.
+         */
+        void flush_batch() {
+            if (this->batch.empty()) {
+                return;
+            }
+            this->for_each_independent(this->batch_offsets.back(), [this](std::uint64_t i) {
+                std::size_t k = std::upper_bound(this->batch_offsets.begin(), this->batch_offsets.end(), i) - this->batch_offsets.begin() - 1;
+                this->execute_gate_bit(this->batch[k], this->batch_selectors[k], i - this->batch_offsets[k]);
+            });
+            this->batch.clear();
+            this->batch_offsets.resize(1);
+            this->batch_selectors.clear();
+            this->batch_reads.clear();
+            this->batch_writes.clear();
+        }
+
         /**
          * @brief Execute the provided instruction of the memory program.
          *
@@ -494,6 +1168,9 @@ namespace mage::engine {
             case OpCode::ValueSelect:
                 this->execute_value_select(phys);
                 return PackedPhysInstruction::size(OpCode::ValueSelect);
+            case OpCode::CondSwap:
+                this->execute_cond_swap(phys);
+                return PackedPhysInstruction::size(OpCode::CondSwap);
             default:
                 std::cerr << "Instruction " << opcode_to_string(phys.header.operation) << " is not supported." << std::endl;
                 std::abort();
@@ -501,6 +1178,21 @@ namespace mage::engine {
         }
 
         ProtEngine& protocol;
+        typename ProtEngine::Wire public_constants[2];
+        std::vector<typename ProtEngine::Wire> scratch_space;
+
+        /*
+         * Batch of consecutive instructions whose gates are independent, used
+         * for protocols with concurrent_gates. BATCH_OFFSETS[k] is the number
+         * of output bits of the first k instructions in BATCH.
+         */
+        static constexpr std::size_t max_batch_instructions = 256;
+        std::vector<PackedPhysInstruction> batch;
+        std::vector<std::uint64_t> batch_offsets { 0 };
+        std::vector<typename ProtEngine::Wire> batch_selectors;
+        std::vector<WireRange> batch_reads;
+        std::vector<WireRange> batch_writes;
+
         typename ProtEngine::Wire* wires;
         PhysProgramFileReader input;
     };
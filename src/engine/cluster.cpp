@@ -23,41 +23,45 @@
 #include <cstdint>
 #include <cstdlib>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <iostream>
 #include <memory>
-#include <mutex>
+#include <random>
 #include <string>
 #include <thread>
 #include <utility>
 #include <vector>
 #include "engine/cluster.hpp"
+#include "engine/transport.hpp"
 #include "platform/filesystem.hpp"
+#include "platform/memory.hpp"
 #include "platform/network.hpp"
 #include "util/config.hpp"
-#include "util/filebuffer.hpp"
+#include "util/spinwait.hpp"
 #include "util/userpipe.hpp"
 
 namespace mage::engine {
-    MessageChannel::MessageChannel(int fd, std::size_t buffer_size) : reader(fd, false, buffer_size), writer(fd, false, buffer_size), socket_fd(fd),
-        posted_reads(1 << 14), num_posted_reads(0) {
-        if (fd != -1) {
+    MessageChannel::MessageChannel(std::unique_ptr<Transport> t) : transport(std::move(t)), posted_reads(1 << 14), num_posted_reads(0) {
+        if (this->transport != nullptr) {
             this->start_reading_daemon();
         }
     }
 
-    MessageChannel::MessageChannel() : MessageChannel(-1) {
+    MessageChannel::MessageChannel(int fd, std::size_t buffer_size)
+        : MessageChannel(fd == -1 ? nullptr : std::make_unique<SocketTransport>(fd, buffer_size)) {
+    }
+
+    MessageChannel::MessageChannel() : MessageChannel(nullptr) {
     }
 
     MessageChannel::~MessageChannel() {
-        if (this->socket_fd != -1) {
-            this->writer.flush();
+        if (this->transport != nullptr) {
+            this->transport->flush();
             this->posted_reads.close();
             if (this->reading_daemon.joinable()) {
                 this->reading_daemon.join();
             }
-            platform::network_close(this->socket_fd);
         }
     }
 
@@ -66,26 +70,25 @@ namespace mage::engine {
         this->reading_daemon = std::thread([this]() {
             const AsyncRead* read_op;
             while ((read_op = this->posted_reads.start_read_in_place(1)) != nullptr) {
-                std::uint8_t* buffer = &(this->reader.start_read<std::uint8_t>(read_op->length));
-                std::copy(buffer, buffer + read_op->length, static_cast<std::uint8_t*>(read_op->into));
-                this->reader.finish_read(read_op->length);
+                if (!this->transport->read(read_op->into, read_op->length)) {
+                    std::cerr << "Connection closed with a receive outstanding" << std::endl;
+                    std::abort();
+                }
                 this->posted_reads.finish_read_in_place(1);
 
-                {
-                    std::lock_guard<std::mutex> lock(this->num_posted_reads_mutex);
-                    this->num_posted_reads--;
-                    if (this->num_posted_reads == 0) {
-                        this->no_posted_reads.notify_all();
-                    }
+                if (this->num_posted_reads.fetch_sub(1, std::memory_order_release) == 1) {
+                    this->no_posted_reads.notify();
                 }
             }
         });
     }
 
-    const std::uint32_t ClusterNetwork::max_connection_tries = 20;
-    const std::chrono::duration<std::uint32_t, std::milli> ClusterNetwork::delay_between_connection_tries(3000);
+    const std::uint32_t ClusterNetwork::max_connection_tries = 30;
+    const std::chrono::duration<std::uint32_t, std::milli> ClusterNetwork::min_connection_backoff(50);
+    const std::chrono::duration<std::uint32_t, std::milli> ClusterNetwork::max_connection_backoff(3000);
 
-    ClusterNetwork::ClusterNetwork(WorkerID self, std::size_t buffer_size) : channels(), channel_buffer_size(buffer_size), self_id(self) {
+    ClusterNetwork::ClusterNetwork(WorkerID self, std::size_t buffer_size) : channels(), channel_buffer_size(buffer_size), self_id(self),
+        time_to_ready(std::chrono::steady_clock::duration::zero()) {
     }
 
     WorkerID ClusterNetwork::get_self() const {
@@ -96,6 +99,10 @@ namespace mage::engine {
         return this->channels.size();
     }
 
+    std::chrono::steady_clock::duration ClusterNetwork::get_time_to_ready() const {
+        return this->time_to_ready;
+    }
+
     std::string ClusterNetwork::establish(const util::ConfigValue& party) {
         WorkerID num_workers = party["workers"].get_size();
         if (this->self_id >= num_workers) {
@@ -109,6 +116,8 @@ namespace mage::engine {
             }
         }
 
+        auto start = std::chrono::steady_clock::now();
+
         std::vector<int> fds;
         fds.resize(num_workers);
         std::fill(fds.begin(), fds.end(), -1);
@@ -117,59 +126,7 @@ namespace mage::engine {
         std::fill(&success[0], &success[num_workers], false);
         success[this->self_id] = true;
 
-        /* Connect to all workers with smaller index. */
-        /* TODO: use an event loop or bounded thread pool to do this. */
-        std::vector<std::thread> connectors;
-        connectors.resize(self_id);
-        for (WorkerID j = 0; j != self_id; j++) {
-            connectors[j] = std::thread([&](WorkerID i) {
-                const util::ConfigValue& worker = party["workers"][i];
-                for (std::uint32_t k = 0; k != ClusterNetwork::max_connection_tries; k++) {
-                    platform::NetworkError err;
-                    platform::network_connect(worker["internal_host"].as_string().c_str(), worker["internal_port"].as_string().c_str(), &fds[i], &err);
-                    if (err == platform::NetworkError::Success) {
-                        platform::write_to_file(fds[i], &self_id, sizeof(self_id));
-                        success[i] = true;
-                        return;
-                    } else if (err == platform::NetworkError::ConnectionRefused) {
-                        std::this_thread::sleep_for(ClusterNetwork::delay_between_connection_tries);
-                    } else if (err == platform::NetworkError::TimedOut) {
-                        break;
-                    } else {
-                        std::cerr << "Unrecognized network error " << static_cast<std::uint32_t>(err) << std::endl;
-                        std::abort();
-                    }
-                }
-                success[i] = false;
-            }, j);
-        }
-
-        /* Accept connections from all workers with a larger index. */
-        WorkerID remaining = num_workers - self_id - 1;
-        std::vector<int> accept_fds;
-        accept_fds.resize(remaining);
-
-        /*
-         * TODO: make sure to only accept connections from the internal_host
-         * specified in the configuration file.
-         */
-        if (remaining != 0) {
-            platform::network_accept(party["workers"][this->self_id]["internal_port"].as_string().c_str(), accept_fds.data(), remaining);
-            for (WorkerID i = 0; i != remaining; i++) {
-                WorkerID from;
-                platform::read_from_file(accept_fds[i], &from, sizeof(from));
-                if (from > self_id && from < num_workers && fds[from] == -1) {
-                    success[from] = true;
-                    fds[from] = accept_fds[i];
-                } else {
-                    platform::network_close(accept_fds[i]);
-                }
-            }
-        }
-
-        for (WorkerID i = 0; i != self_id; i++) {
-            connectors[i].join();
-        }
+        this->connect_workers(party, fds.data(), success);
 
         std::string rv;
         bool overall_success = true;
@@ -183,10 +140,21 @@ namespace mage::engine {
                 overall_success = false;
             }
         }
+        std::vector<std::unique_ptr<Transport>> transports(num_workers);
         if (overall_success) {
+            rv = this->establish_shared_memory(party, fds, transports);
+            overall_success = rv.empty();
+        }
+        if (overall_success) {
+            this->time_to_ready = std::chrono::steady_clock::now() - start;
             this->channels.resize(num_workers);
             for (WorkerID i = 0; i != num_workers; i++) {
-                this->channels[i] = std::make_unique<MessageChannel>(fds[i], this->channel_buffer_size);
+                if (transports[i] != nullptr) {
+                    platform::network_close(fds[i]);
+                    this->channels[i] = std::make_unique<MessageChannel>(std::move(transports[i]));
+                } else {
+                    this->channels[i] = std::make_unique<MessageChannel>(fds[i], this->channel_buffer_size);
+                }
             }
         } else {
             for (WorkerID i = 0; i != num_workers; i++) {
@@ -198,4 +166,260 @@ namespace mage::engine {
 
         return rv;
     }
+
+    namespace {
+        enum class SocketKind : std::uint32_t {
+            Listener,
+            Connecting,
+            Accepted
+        };
+
+        std::uint64_t socket_tag(SocketKind kind, std::uint32_t index) {
+            return (static_cast<std::uint64_t>(kind) << 32) | index;
+        }
+
+        /* Connection to a worker with a smaller index. */
+        struct OutgoingConnection {
+            int fd = -1;
+            std::uint32_t attempts = 0;
+            bool resolved = false;
+            std::chrono::steady_clock::time_point retry_at;
+        };
+
+        /* Connection from a worker with a larger index, which has not yet identified itself. */
+        struct IncomingConnection {
+            int fd = -1;
+            WorkerID from = 0;
+            std::size_t received = 0;
+        };
+    }
+
+    void ClusterNetwork::connect_workers(const util::ConfigValue& party, int* fds, bool* success) {
+        WorkerID num_workers = party["workers"].get_size();
+        int queue = platform::event_queue_create();
+
+        /*
+         * Accept connections from all workers with a larger index. We listen
+         * before connecting to anyone, so that workers with a larger index
+         * are not kept waiting on us.
+         *
+         * TODO: make sure to only accept connections from the internal_host
+         * specified in the configuration file.
+         */
+        int listener = -1;
+        WorkerID to_accept = num_workers - this->self_id - 1;
+        std::vector<IncomingConnection> incoming;
+        if (to_accept != 0) {
+            listener = platform::network_listen(party["workers"][this->self_id]["internal_port"].as_string().c_str(), num_workers);
+            platform::event_queue_watch(queue, listener, true, false, socket_tag(SocketKind::Listener, 0));
+        }
+
+        /*
+         * Connect to all workers with a smaller index. Connections are
+         * non-blocking, so all of them proceed concurrently. If a worker is
+         * not up yet, we retry with exponential backoff, with jitter so that
+         * many workers starting at once do not retry in lockstep.
+         */
+        std::random_device rd;
+        std::mt19937 rng(rd());
+        std::vector<OutgoingConnection> outgoing(this->self_id);
+        WorkerID to_connect = this->self_id;
+        bool any_failed = false;
+
+        auto resolve = [&](WorkerID i, bool connected) {
+            outgoing[i].resolved = true;
+            to_connect--;
+            if (connected) {
+                platform::network_set_blocking(outgoing[i].fd, true);
+                platform::write_to_file(outgoing[i].fd, &this->self_id, sizeof(this->self_id));
+                fds[i] = outgoing[i].fd;
+                success[i] = true;
+            } else {
+                any_failed = true;
+            }
+        };
+
+        auto handle_failure = [&](WorkerID i, platform::NetworkError err) {
+            outgoing[i].fd = -1;
+            if (err == platform::NetworkError::TimedOut || outgoing[i].attempts == ClusterNetwork::max_connection_tries) {
+                resolve(i, false);
+                return;
+            }
+            auto backoff = std::min<std::chrono::steady_clock::duration>(ClusterNetwork::min_connection_backoff * (1 << std::min<std::uint32_t>(outgoing[i].attempts - 1, 16)), ClusterNetwork::max_connection_backoff);
+            std::uniform_int_distribution<std::chrono::steady_clock::rep> jitter(backoff.count() / 2, backoff.count());
+            outgoing[i].retry_at = std::chrono::steady_clock::now() + std::chrono::steady_clock::duration(jitter(rng));
+        };
+
+        auto attempt = [&](WorkerID i) {
+            const util::ConfigValue& worker = party["workers"][i];
+            platform::NetworkError err;
+            outgoing[i].attempts++;
+            outgoing[i].fd = platform::network_connect_nonblocking(worker["internal_host"].as_string().c_str(), worker["internal_port"].as_string().c_str(), err);
+            if (err == platform::NetworkError::Success) {
+                resolve(i, true);
+            } else if (err == platform::NetworkError::InProgress) {
+                platform::event_queue_watch(queue, outgoing[i].fd, false, true, socket_tag(SocketKind::Connecting, i));
+            } else {
+                handle_failure(i, err);
+            }
+        };
+
+        for (WorkerID i = 0; i != this->self_id; i++) {
+            attempt(i);
+        }
+
+        platform::NetworkEvent events[platform::event_queue_max_events];
+        while ((to_connect != 0 || to_accept != 0) && !(to_connect == 0 && any_failed)) {
+            /* Sleep until the next event or the next scheduled retry. */
+            auto now = std::chrono::steady_clock::now();
+            int timeout_ms = -1;
+            for (WorkerID i = 0; i != this->self_id; i++) {
+                if (!outgoing[i].resolved && outgoing[i].fd == -1) {
+                    auto wait = std::chrono::ceil<std::chrono::milliseconds>(outgoing[i].retry_at - now).count();
+                    wait = std::max<decltype(wait)>(wait, 0);
+                    if (timeout_ms == -1 || wait < timeout_ms) {
+                        timeout_ms = wait;
+                    }
+                }
+            }
+
+            std::uint32_t num_events = platform::event_queue_wait(queue, events, platform::event_queue_max_events, timeout_ms);
+            for (std::uint32_t k = 0; k != num_events; k++) {
+                SocketKind kind = static_cast<SocketKind>(events[k].tag >> 32);
+                std::uint32_t index = static_cast<std::uint32_t>(events[k].tag);
+                if (kind == SocketKind::Listener) {
+                    int fd;
+                    while ((fd = platform::network_accept_nonblocking(listener)) != -1) {
+                        platform::event_queue_watch(queue, fd, true, false, socket_tag(SocketKind::Accepted, incoming.size()));
+                        incoming.emplace_back();
+                        incoming.back().fd = fd;
+                    }
+                } else if (kind == SocketKind::Connecting) {
+                    platform::event_queue_unwatch(queue, outgoing[index].fd);
+                    platform::NetworkError err = platform::network_connect_finish(outgoing[index].fd);
+                    if (err == platform::NetworkError::Success) {
+                        resolve(index, true);
+                    } else if (err == platform::NetworkError::InProgress) {
+                        platform::event_queue_watch(queue, outgoing[index].fd, false, true, events[k].tag);
+                    } else {
+                        handle_failure(index, err);
+                    }
+                } else {
+                    IncomingConnection& conn = incoming[index];
+                    std::uint8_t* into = reinterpret_cast<std::uint8_t*>(&conn.from);
+                    std::int64_t rv = platform::network_read_nonblocking(conn.fd, &into[conn.received], sizeof(conn.from) - conn.received);
+                    if (rv == -1) {
+                        continue;
+                    }
+                    conn.received += rv;
+                    if (rv != 0 && conn.received != sizeof(conn.from)) {
+                        continue;
+                    }
+                    platform::event_queue_unwatch(queue, conn.fd);
+                    if (rv != 0 && conn.from > this->self_id && conn.from < num_workers && fds[conn.from] == -1) {
+                        platform::network_set_blocking(conn.fd, true);
+                        fds[conn.from] = conn.fd;
+                        success[conn.from] = true;
+                        to_accept--;
+                    } else {
+                        platform::network_close(conn.fd);
+                    }
+                    conn.fd = -1;
+                }
+            }
+
+            now = std::chrono::steady_clock::now();
+            for (WorkerID i = 0; i != this->self_id; i++) {
+                if (!outgoing[i].resolved && outgoing[i].fd == -1 && outgoing[i].retry_at <= now) {
+                    attempt(i);
+                }
+            }
+        }
+
+        /* Clean up connections left over if we gave up early. */
+        for (WorkerID i = 0; i != this->self_id; i++) {
+            if (!outgoing[i].resolved && outgoing[i].fd != -1) {
+                platform::network_close(outgoing[i].fd);
+            }
+        }
+        for (IncomingConnection& conn : incoming) {
+            if (conn.fd != -1) {
+                platform::network_close(conn.fd);
+            }
+        }
+        if (listener != -1) {
+            platform::network_close(listener);
+        }
+        platform::event_queue_close(queue);
+    }
+
+    std::string ClusterNetwork::establish_shared_memory(const util::ConfigValue& party, const std::vector<int>& fds, std::vector<std::unique_ptr<Transport>>& transports) {
+        WorkerID num_workers = fds.size();
+
+        std::string mode = "auto";
+        if (party.get("internal_transport") != nullptr) {
+            mode = party["internal_transport"].as_string();
+        }
+        if (mode != "auto" && mode != "tcp" && mode != "shm") {
+            return "Unknown internal_transport \"" + mode + "\" (try \"auto\", \"tcp\", or \"shm\")";
+        }
+
+        const std::string& self_host = party["workers"][this->self_id]["internal_host"].as_string();
+        std::vector<bool> shared(num_workers, false);
+        for (WorkerID i = 0; i != num_workers; i++) {
+            if (i != this->self_id) {
+                shared[i] = (mode == "shm") || (mode == "auto" && party["workers"][i]["internal_host"].as_string() == self_host);
+            }
+        }
+
+        /*
+         * The lower-indexed worker of each pair creates the shared memory
+         * region and sends its name over the TCP connection; the other worker
+         * opens it and acknowledges. We do this in three phases (create, open,
+         * collect acknowledgments) so that no worker ever blocks on a peer
+         * that is itself blocked.
+         */
+        std::random_device rd;
+        std::uniform_int_distribution<std::uint64_t> dist;
+        std::uint64_t nonce = dist(rd);
+
+        std::vector<std::string> names(num_workers);
+        for (WorkerID i = this->self_id + 1; i < num_workers; i++) {
+            if (shared[i]) {
+                names[i] = "/mage-" + std::to_string(this->self_id) + "-" + std::to_string(i) + "-" + std::to_string(nonce);
+                transports[i] = std::make_unique<SharedMemoryTransport>(names[i], this->channel_buffer_size, true);
+                std::uint32_t length = names[i].size();
+                platform::write_to_file(fds[i], &length, sizeof(length));
+                platform::write_to_file(fds[i], names[i].data(), length);
+            }
+        }
+
+        for (WorkerID i = 0; i != this->self_id; i++) {
+            if (shared[i]) {
+                std::uint32_t length;
+                platform::read_from_file(fds[i], &length, sizeof(length));
+                std::string name(length, '\0');
+                platform::read_from_file(fds[i], name.data(), length);
+                auto transport = std::make_unique<SharedMemoryTransport>(name, this->channel_buffer_size, false);
+                std::uint8_t ack = transport->valid() ? 1 : 0;
+                platform::write_to_file(fds[i], &ack, sizeof(ack));
+                if (ack != 0) {
+                    transports[i] = std::move(transport);
+                }
+            }
+        }
+
+        for (WorkerID i = this->self_id + 1; i < num_workers; i++) {
+            if (shared[i]) {
+                std::uint8_t ack = 0;
+                platform::read_from_file(fds[i], &ack, sizeof(ack));
+                platform::unlink_shared_memory(names[i].c_str());
+                if (ack == 0) {
+                    transports[i].reset();
+                }
+            }
+        }
+
+        return "";
+    }
 }
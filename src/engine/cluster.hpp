@@ -29,15 +29,16 @@
 #define MAGE_ENGINE_CLUSTER_HPP_
 
 #include <cstdint>
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <memory>
-#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 #include "addr.hpp"
+#include "engine/transport.hpp"
 #include "util/config.hpp"
-#include "util/filebuffer.hpp"
+#include "util/spinwait.hpp"
 #include "util/userpipe.hpp"
 
 namespace mage::engine {
@@ -54,9 +55,9 @@ namespace mage::engine {
      * same party, supporting asynchronous receive and buffered send
      * operations.
      *
-     * If, in the future, we need to allow multiple implementations (e.g.,
-     * sockets, shared memory, etc.), I may change this to an abstract class.
-     * For now, we just use sockets.
+     * The bytes themselves are moved by a Transport, which is a socket for
+     * workers on different machines and shared memory for workers on the
+     * same machine.
      */
     class MessageChannel {
     public:
@@ -69,6 +70,15 @@ namespace mage::engine {
          */
         MessageChannel(int fd, std::size_t buffer_size = 1 << 18);
 
+        /**
+         * @brief Creates a new MessageChannel that communicates using the
+         * provided Transport.
+         *
+         * @param t The transport to use, of which the MessageChannel takes
+         * ownership.
+         */
+        MessageChannel(std::unique_ptr<Transport> t);
+
         /**
          * @brief Creates an invalid MessageChannel that is not suitable for
          * use.
@@ -76,8 +86,7 @@ namespace mage::engine {
         MessageChannel();
 
         /**
-         * @brief Sends any pending data and closes the underlying file
-         * descriptor.
+         * @brief Sends any pending data and closes the underlying transport.
          */
         virtual ~MessageChannel();
 
@@ -122,10 +131,7 @@ namespace mage::engine {
          * now be used to direct received data.
          */
         void finish_post_read() {
-            {
-                std::lock_guard<std::mutex> lock(this->num_posted_reads_mutex);
-                this->num_posted_reads++;
-            }
+            this->num_posted_reads.fetch_add(1, std::memory_order_relaxed);
             this->posted_reads.finish_write_in_place(1);
         }
 
@@ -133,10 +139,9 @@ namespace mage::engine {
          * @brief Blocks until there are no more pending asynchronous reads.
          */
         void wait_until_reads_finished() {
-            std::unique_lock<std::mutex> lock(this->num_posted_reads_mutex);
-            while (this->num_posted_reads != 0) {
-                this->no_posted_reads.wait(lock);
-            }
+            this->no_posted_reads.wait_until([this]() {
+                return this->num_posted_reads.load(std::memory_order_acquire) == 0;
+            });
         }
 
         /**
@@ -151,8 +156,9 @@ namespace mage::engine {
          */
         template <typename T>
         T* write(std::size_t count) {
-            T& buffer = this->writer.write<T>(count * sizeof(T));
-            return &buffer;
+            void* buffer = this->transport->start_write(count * sizeof(T));
+            this->transport->finish_write(count * sizeof(T));
+            return static_cast<T*>(buffer);
         }
 
         /**
@@ -160,20 +166,22 @@ namespace mage::engine {
          * MessageChannel's in-memory buffers.
          */
         void flush() {
-            this->writer.flush();
+            this->transport->flush();
         }
 
     private:
         void start_reading_daemon();
 
-        util::BufferedFileWriter<false> writer;
-        util::BufferedFileReader<false> reader;
-        int socket_fd;
+        std::unique_ptr<Transport> transport;
 
-        util::UserPipe<AsyncRead> posted_reads;
-        std::size_t num_posted_reads;
-        std::mutex num_posted_reads_mutex;
-        std::condition_variable no_posted_reads;
+        /*
+         * Posted reads are only ever added by the thread executing the program
+         * and removed by the reading daemon, so we can avoid taking locks on
+         * every receive operation.
+         */
+        util::SPSCUserPipe<AsyncRead> posted_reads;
+        alignas(util::cache_line_size) std::atomic<std::uint64_t> num_posted_reads;
+        util::SpinWaiter no_posted_reads;
         std::thread reading_daemon;
     };
 
@@ -224,6 +232,20 @@ namespace mage::engine {
          * @brief Establishes network communication with other workers in this
          * party.
          *
+         * Connections to all other workers are established concurrently, by
+         * a single thread using an event loop. If another worker is not yet
+         * accepting connections, the connection is retried with randomized
+         * exponential backoff.
+         *
+         * Workers whose internal_host matches this worker's are assumed to be
+         * on the same machine, and communicate via shared memory instead of
+         * TCP. The party's optional internal_transport setting overrides
+         * this: "tcp" always uses TCP, "shm" uses shared memory with all
+         * workers (e.g., if the same machine is listed under different host
+         * names), and "auto" (the default) behaves as described above. If a
+         * shared memory region cannot be set up with a worker, TCP is used
+         * for that worker instead.
+         *
          * @param party The configuration value for this party, providing the
          * internal network host and port numbers of the other workers in the
          * party.
@@ -249,6 +271,15 @@ namespace mage::engine {
             return this->channels[worker_id].get();
         }
 
+        /**
+         * @brief Returns the time that the most recent successful call to
+         * establish() took to connect to all other workers in this party.
+         *
+         * @return The time from the start of establish() until all
+         * connections were ready.
+         */
+        std::chrono::steady_clock::duration get_time_to_ready() const;
+
         /**
          * @brief The maximum number of connection attempts when connecting to
          * other workers.
@@ -256,15 +287,26 @@ namespace mage::engine {
         static const std::uint32_t max_connection_tries;
 
         /**
-         * @brief The delay between connection attempts when connecting to
-         * other workers.
+         * @brief The delay after the first failed attempt to connect to
+         * another worker; the delay doubles after each subsequent failed
+         * attempt.
          */
-        static const std::chrono::duration<std::uint32_t, std::milli> delay_between_connection_tries;
+        static const std::chrono::duration<std::uint32_t, std::milli> min_connection_backoff;
+
+        /**
+         * @brief The maximum delay between connection attempts when
+         * connecting to other workers.
+         */
+        static const std::chrono::duration<std::uint32_t, std::milli> max_connection_backoff;
 
     private:
+        void connect_workers(const util::ConfigValue& party, int* fds, bool* success);
+        std::string establish_shared_memory(const util::ConfigValue& party, const std::vector<int>& fds, std::vector<std::unique_ptr<Transport>>& transports);
+
         std::vector<std::unique_ptr<MessageChannel>> channels;
         std::size_t channel_buffer_size;
         WorkerID self_id;
+        std::chrono::steady_clock::duration time_to_ready;
     };
 }
 
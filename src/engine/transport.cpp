@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include "engine/transport.hpp"
+#include "platform/filesystem.hpp"
+#include "platform/memory.hpp"
+#include "platform/network.hpp"
+#include "util/filebuffer.hpp"
+
+namespace mage::engine {
+    const std::size_t SocketTransport::direct_read_threshold = 1 << 12;
+
+    SocketTransport::SocketTransport(int fd, std::size_t buffer_size) : writer(fd, false, buffer_size), reader(fd, false, buffer_size), socket_fd(fd) {
+    }
+
+    SocketTransport::~SocketTransport() {
+        this->writer.flush();
+        platform::network_close(this->socket_fd);
+    }
+
+    bool SocketTransport::read(void* into, std::size_t length) {
+        if (length >= SocketTransport::direct_read_threshold) {
+            return this->reader.read_into(into, length);
+        }
+        std::uint8_t* buffer = &(this->reader.start_read<std::uint8_t>(length));
+        std::copy(buffer, buffer + length, static_cast<std::uint8_t*>(into));
+        this->reader.finish_read(length);
+        return true;
+    }
+
+    std::size_t SharedMemoryTransport::round_to_pages(std::size_t length) {
+        std::size_t page_size = sysconf(_SC_PAGESIZE);
+        return ((length + page_size - 1) / page_size) * page_size;
+    }
+
+    SharedMemoryTransport::SharedMemoryTransport(const std::string& name, std::size_t buffer_size, bool create)
+        : capacity(round_to_pages(buffer_size)), control_size(round_to_pages(2 * sizeof(SharedRingControl))),
+        control(nullptr), outgoing(nullptr), incoming(nullptr), outgoing_data(nullptr), incoming_data(nullptr),
+        local_written(0), known_read(0), write_offset(0), local_read(0), known_written(0), read_offset(0) {
+        std::size_t total_size = this->control_size + 2 * this->capacity;
+        int fd;
+        if (create) {
+            fd = platform::create_shared_memory(name.c_str(), total_size);
+        } else {
+            fd = platform::open_shared_memory(name.c_str());
+            if (fd == -1) {
+                return;
+            }
+        }
+
+        this->control = platform::map_file<SharedRingControl>(fd, this->control_size);
+        if (create) {
+            new (&this->control[0]) SharedRingControl;
+            new (&this->control[1]) SharedRingControl;
+        }
+
+        /* The creator sends on ring 0 and receives on ring 1. */
+        int send_ring = create ? 0 : 1;
+        int recv_ring = 1 - send_ring;
+        this->outgoing = &this->control[send_ring];
+        this->incoming = &this->control[recv_ring];
+        this->outgoing_data = static_cast<std::uint8_t*>(platform::map_ring(fd, this->control_size + send_ring * this->capacity, this->capacity));
+        this->incoming_data = static_cast<std::uint8_t*>(platform::map_ring(fd, this->control_size + recv_ring * this->capacity, this->capacity));
+
+        platform::close_file(fd);
+    }
+
+    SharedMemoryTransport::~SharedMemoryTransport() {
+        if (this->control == nullptr) {
+            return;
+        }
+        this->flush();
+        this->outgoing->closed.store(true, std::memory_order_release);
+        this->outgoing->added.notify();
+        platform::unmap_ring(this->outgoing_data, this->capacity);
+        platform::unmap_ring(this->incoming_data, this->capacity);
+        platform::unmap_file(this->control, this->control_size);
+    }
+
+    void* SharedMemoryTransport::start_write(std::size_t length) {
+        assert(length <= this->capacity);
+        if (this->capacity - (this->local_written - this->known_read) < length) {
+            this->known_read = this->outgoing->num_read.load(std::memory_order_acquire);
+            if (this->capacity - (this->local_written - this->known_read) < length) {
+                /*
+                 * The receiver can only make space by consuming data that we
+                 * have published, so publish everything before waiting.
+                 */
+                this->flush();
+                this->outgoing->removed.wait_until([this, length]() {
+                    return this->capacity - (this->local_written - this->outgoing->num_read.load(std::memory_order_acquire)) >= length;
+                });
+                this->known_read = this->outgoing->num_read.load(std::memory_order_acquire);
+            }
+        }
+        return &this->outgoing_data[this->write_offset];
+    }
+
+    bool SharedMemoryTransport::read(void* into, std::size_t length) {
+        std::uint8_t* dest = static_cast<std::uint8_t*>(into);
+        while (length != 0) {
+            if (this->known_written == this->local_read) {
+                this->known_written = this->incoming->num_written.load(std::memory_order_acquire);
+                if (this->known_written == this->local_read) {
+                    this->incoming->added.wait_until([this]() {
+                        return this->incoming->num_written.load(std::memory_order_acquire) != this->local_read
+                            || this->incoming->closed.load(std::memory_order_acquire);
+                    });
+                    this->known_written = this->incoming->num_written.load(std::memory_order_acquire);
+                    if (this->known_written == this->local_read) {
+                        return false;
+                    }
+                }
+            }
+            std::size_t available = std::min<std::uint64_t>(this->known_written - this->local_read, length);
+            std::copy(&this->incoming_data[this->read_offset], &this->incoming_data[this->read_offset + available], dest);
+            dest += available;
+            length -= available;
+            this->local_read += available;
+            this->read_offset += available;
+            if (this->read_offset >= this->capacity) {
+                this->read_offset -= this->capacity;
+            }
+            this->incoming->num_read.store(this->local_read, std::memory_order_release);
+            this->incoming->removed.notify();
+        }
+        return true;
+    }
+}
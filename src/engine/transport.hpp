@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file engine/transport.hpp
+ * @brief Mechanisms for moving bytes between two workers in the same party,
+ * used by MessageChannel.
+ */
+
+#ifndef MAGE_ENGINE_TRANSPORT_HPP_
+#define MAGE_ENGINE_TRANSPORT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include "util/filebuffer.hpp"
+#include "util/spinwait.hpp"
+
+namespace mage::engine {
+    /**
+     * @brief A bidirectional, reliable, in-order byte stream between two
+     * workers, over which a MessageChannel is layered.
+     *
+     * Data to send is written directly into the transport's internal buffer
+     * via start_write() and finish_write(), and becomes visible to the
+     * receiver only once flush() is called (or the internal buffer fills).
+     */
+    class Transport {
+    public:
+        virtual ~Transport() {
+        }
+
+        /**
+         * @brief Provides a pointer to contiguous space in the transport's
+         * internal buffer where the next @p length bytes to send can be
+         * initialized.
+         *
+         * @param length The number of bytes to be sent, which must not exceed
+         * the size of the transport's internal buffer.
+         * @return A pointer to the space to initialize.
+         */
+        virtual void* start_write(std::size_t length) = 0;
+
+        /**
+         * @brief Commits the next @p length bytes of the space returned by
+         * start_write() to be sent.
+         *
+         * @param length The number of bytes to commit.
+         */
+        virtual void finish_write(std::size_t length) = 0;
+
+        /**
+         * @brief Initiates the sending of any committed data.
+         */
+        virtual void flush() = 0;
+
+        /**
+         * @brief Receives exactly @p length bytes into the provided memory,
+         * blocking until they are available.
+         *
+         * @param into The memory into which to receive data.
+         * @param length The number of bytes to receive.
+         * @return True if the data were received, or false if the other side
+         * closed the transport first.
+         */
+        virtual bool read(void* into, std::size_t length) = 0;
+    };
+
+    /**
+     * @brief A Transport that sends data over a socket (e.g., a TCP
+     * connection), with in-memory buffering on both the send and receive
+     * sides.
+     */
+    class SocketTransport : public Transport {
+    public:
+        /**
+         * @brief Creates a SocketTransport that takes ownership of the
+         * provided socket.
+         *
+         * @param fd The socket file descriptor to wrap.
+         * @param buffer_size The size of the send and receive buffers.
+         */
+        SocketTransport(int fd, std::size_t buffer_size);
+
+        /**
+         * @brief Sends any pending data and closes the socket.
+         */
+        ~SocketTransport() override;
+
+        void* start_write(std::size_t length) override {
+            return this->writer.start_write(length);
+        }
+
+        void finish_write(std::size_t length) override {
+            this->writer.finish_write(length);
+        }
+
+        void flush() override {
+            this->writer.flush();
+        }
+
+        bool read(void* into, std::size_t length) override;
+
+        /**
+         * @brief Reads of at least this many bytes are received directly into
+         * their destination, rather than being staged in the receive buffer
+         * and copied out.
+         *
+         * Small reads are cheaper to serve from the receive buffer, since a
+         * single system call can fetch many of them at once. For large reads
+         * (e.g., a batch of wires received in one operation), the extra copy
+         * out of the receive buffer dominates, so we avoid it.
+         */
+        static const std::size_t direct_read_threshold;
+
+    private:
+        util::BufferedFileWriter<false> writer;
+        util::BufferedFileReader<false> reader;
+        int socket_fd;
+    };
+
+    /**
+     * @brief Control data for one direction of a SharedMemoryTransport,
+     * stored in the shared memory region.
+     *
+     * The counters are cumulative numbers of bytes, so positions in the ring
+     * are obtained by reducing them modulo the ring's capacity.
+     */
+    struct SharedRingControl {
+        SharedRingControl() : num_written(0), num_read(0), closed(false), added(true), removed(true) {
+        }
+
+        alignas(util::cache_line_size) std::atomic<std::uint64_t> num_written;
+        alignas(util::cache_line_size) std::atomic<std::uint64_t> num_read;
+        alignas(util::cache_line_size) std::atomic<bool> closed;
+        alignas(util::cache_line_size) util::SpinWaiter added;
+        alignas(util::cache_line_size) util::SpinWaiter removed;
+    };
+
+    /**
+     * @brief A Transport between two processes on the same machine, which
+     * exchanges data through a pair of ring buffers in shared memory.
+     *
+     * Each ring buffer is mapped twice at adjacent virtual addresses, so that
+     * start_write() can always return contiguous space, and so that the
+     * sender's buffer and the ring are one and the same: data are written to
+     * the ring in place, and flush() merely publishes them to the receiver.
+     * Compared to a TCP connection over the loopback interface, this avoids
+     * two copies and a pair of system calls per flush.
+     */
+    class SharedMemoryTransport : public Transport {
+    public:
+        /**
+         * @brief Creates or opens the named shared memory region backing a
+         * SharedMemoryTransport.
+         *
+         * Exactly one of the two workers should create the region; the other
+         * should open it by name after it has been created. Either may remove
+         * the name (see platform::unlink_shared_memory()) once both have
+         * opened it.
+         *
+         * @param name The name of the shared memory region.
+         * @param buffer_size The capacity of each ring buffer; it is rounded
+         * up to a multiple of the page size. Must be the same for both
+         * workers.
+         * @param create True if the region should be created, or false if an
+         * existing region should be opened.
+         */
+        SharedMemoryTransport(const std::string& name, std::size_t buffer_size, bool create);
+
+        /**
+         * @brief Publishes any pending data, marks the outgoing ring as
+         * closed, and unmaps the shared memory region.
+         */
+        ~SharedMemoryTransport() override;
+
+        /**
+         * @brief Returns true if this instance successfully mapped the shared
+         * memory region, or false if it did not (e.g., because no region with
+         * the provided name exists).
+         */
+        bool valid() const {
+            return this->control != nullptr;
+        }
+
+        void* start_write(std::size_t length) override;
+
+        void finish_write(std::size_t length) override {
+            this->local_written += length;
+            this->write_offset += length;
+            if (this->write_offset >= this->capacity) {
+                this->write_offset -= this->capacity;
+            }
+        }
+
+        void flush() override {
+            this->outgoing->num_written.store(this->local_written, std::memory_order_release);
+            this->outgoing->added.notify();
+        }
+
+        bool read(void* into, std::size_t length) override;
+
+    private:
+        static std::size_t round_to_pages(std::size_t length);
+
+        std::size_t capacity;
+        std::size_t control_size;
+        SharedRingControl* control;
+        SharedRingControl* outgoing;
+        SharedRingControl* incoming;
+        std::uint8_t* outgoing_data;
+        std::uint8_t* incoming_data;
+
+        /* State for sending. */
+        std::uint64_t local_written;
+        std::uint64_t known_read;
+        std::size_t write_offset;
+
+        /* State for receiving. */
+        std::uint64_t local_read;
+        std::uint64_t known_written;
+        std::size_t read_offset;
+    };
+}
+
+#endif
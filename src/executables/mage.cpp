@@ -83,6 +83,7 @@ int main(int argc, char** argv) {
         std::cerr << err << std::endl;
         return EXIT_FAILURE;
     }
+    std::cout << "Cluster ready time: " << std::chrono::duration_cast<std::chrono::milliseconds>(cluster->get_time_to_ready()).count() << " ms" << std::endl;
 
     /* Dispatch to the protocol. */
 
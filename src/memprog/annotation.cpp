@@ -26,21 +26,28 @@
 #include <algorithm>
 #include <array>
 #include <string>
-#include <unordered_map>
+#include <thread>
+#include <utility>
+#include <vector>
 #include "addr.hpp"
 #include "instruction.hpp"
 #include "programfile.hpp"
+#include "platform/filesystem.hpp"
 #include "platform/memory.hpp"
 #include "util/filebuffer.hpp"
+#include "util/pagemap.hpp"
 #include "util/progress.hpp"
 
 namespace mage::memprog {
-    std::uint64_t annotate_program(util::BufferedFileWriter<true>& output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar) {
+    std::uint64_t annotate_program(util::BufferedFileWriter<true>& output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables) {
         VirtProgramReverseFileReader instructions(program);
         instructions.set_progress_bar(progress_bar);
         InstructionNumber inum = instructions.get_header().num_instructions;
 
-        std::unordered_map<VirtPageNumber, InstructionNumber> next_access;
+        util::PageMap<VirtPageNumber, InstructionNumber> next_access;
+        if (dense_page_tables) {
+            next_access.make_dense(instructions.get_header().num_pages);
+        }
         std::uint64_t max_working_set_size = 0;
 
         std::array<VirtPageNumber, 5> vpns;
@@ -49,20 +56,21 @@ namespace mage::memprog {
 
             std::size_t current_size;
             PackedVirtInstruction& current = instructions.read_instruction(current_size);
-            Annotation& ann = output.start_write<Annotation>();
+            Annotation ann;
             ann.header.num_pages = current.store_page_numbers(vpns.data(), page_shift);
             for (std::uint16_t i = 0; i != ann.header.num_pages; i++) {
                 /* Re-profile the code if you modify this inner loop. */
-                auto iter = next_access.find(vpns[i]);
-                if (iter == next_access.end()) {
-                    next_access.insert(std::make_pair(vpns[i], inum));
+                InstructionNumber* next = next_access.find(vpns[i]);
+                if (next == nullptr) {
+                    next_access.insert(vpns[i], inum);
                     ann.slots[i].next_use = invalid_instr;
                 } else {
-                    ann.slots[i].next_use = iter->second;
-                    iter->second = inum;
+                    ann.slots[i].next_use = *next;
+                    *next = inum;
                 }
             }
-            output.finish_write(ann.size());
+            std::uint8_t* encoded = static_cast<std::uint8_t*>(output.start_write(Annotation::max_encoded_size));
+            output.finish_write(ann.encode(encoded, inum));
             max_working_set_size = std::max(max_working_set_size, next_access.size());
 
             if ((current.header.flags & FlagOutputPageFirstUse) != 0) {
@@ -77,8 +85,223 @@ namespace mage::memprog {
         return max_working_set_size;
     }
 
-    std::uint64_t annotate_program(std::string annotations, std::string program, PageShift page_shift, util::ProgressBar* progress_bar) {
+    namespace {
+        /*
+         * A slot whose next use lies beyond the end of the chunk containing
+         * it, and therefore can only be filled in once later chunks have been
+         * annotated.
+         */
+        struct UnresolvedSlot {
+            std::uint64_t offset;
+            InstructionNumber inum;
+            std::uint16_t slot;
+            VirtPageNumber vpn;
+            InstructionNumber next_use;
+        };
+
+        /* A contiguous range of instructions annotated by a single thread. */
+        struct AnnotationChunk {
+            InstructionNumber start;
+            InstructionNumber end;
+            std::uint64_t program_end_offset;
+            std::string scratch_file;
+            std::uint64_t encoded_length;
+            std::uint64_t encoded_offset;
+            std::uint64_t max_working_set_size;
+            std::vector<UnresolvedSlot> unresolved;
+
+            /*
+             * For each page accessed in the chunk, the first access in the
+             * chunk, or invalid_instr if the first access is preceded by a
+             * first use of the page (so earlier accesses have no next use).
+             */
+            util::PageMap<VirtPageNumber, InstructionNumber> first_access;
+        };
+
+        /*
+         * Annotates a chunk using only information local to the chunk. This
+         * is the same as the serial pass, except that a page's entry is set
+         * to invalid_instr instead of being erased on first use, so that we
+         * can tell apart pages whose next use is unknown (absent) from pages
+         * with no next use (invalid_instr). Annotations are written to the
+         * scratch file uncompressed, so that unresolved slots can be filled
+         * in once known; they are compressed once all slots are resolved.
+         * Unresolved slots are counted as having no next use in the chunk's
+         * encoded length, which is corrected as they are resolved.
+         */
+        void annotate_chunk(AnnotationChunk& chunk, const std::string& program, PageShift page_shift) {
+            VirtProgramReverseFileReader instructions(program, chunk.program_end_offset);
+            util::BufferedFileWriter<true> output(chunk.scratch_file.c_str());
+            util::PageMap<VirtPageNumber, InstructionNumber>& next_access = chunk.first_access;
+            std::uint64_t offset = 0;
+            std::uint64_t working_set_size = 0;
+            chunk.encoded_length = 0;
+            chunk.max_working_set_size = 0;
+
+            std::array<VirtPageNumber, 5> vpns;
+            for (InstructionNumber inum = chunk.end; inum != chunk.start;) {
+                inum--;
+
+                std::size_t current_size;
+                PackedVirtInstruction& current = instructions.read_instruction(current_size);
+                Annotation& ann = output.start_write<Annotation>();
+                ann.header.num_pages = current.store_page_numbers(vpns.data(), page_shift);
+                for (std::uint16_t i = 0; i != ann.header.num_pages; i++) {
+                    InstructionNumber* next = next_access.find(vpns[i]);
+                    if (next == nullptr) {
+                        next_access.insert(vpns[i], inum);
+                        ann.slots[i].next_use = invalid_instr;
+                        chunk.unresolved.push_back(UnresolvedSlot { offset, inum, i, vpns[i], invalid_instr });
+                        chunk.encoded_length += util::varint_size(0);
+                        working_set_size++;
+                    } else {
+                        if (*next == invalid_instr) {
+                            working_set_size++;
+                        }
+                        ann.slots[i].next_use = *next;
+                        chunk.encoded_length += util::varint_size((*next == invalid_instr) ? 0 : *next - inum);
+                        *next = inum;
+                    }
+                }
+                chunk.encoded_length++;
+                offset += ann.size() + 1;
+                output.finish_write(ann.size());
+                chunk.max_working_set_size = std::max(chunk.max_working_set_size, working_set_size);
+
+                if ((current.header.flags & FlagOutputPageFirstUse) != 0) {
+                    next_access.at(pg_num(current.no_args.output, page_shift)) = invalid_instr;
+                    working_set_size--;
+                }
+            }
+        }
+
+        /*
+         * Fills in the slots of a chunk's annotations that refer past the end
+         * of the chunk, and compresses the annotations into the chunk's range
+         * of the output file. Both files are streamed through fixed-size
+         * buffers, so memory use does not grow with the size of the chunk.
+         */
+        void encode_chunk(AnnotationChunk& chunk, const std::string& annotations) {
+            {
+                util::BufferedFileReader<true> scratch(chunk.scratch_file.c_str());
+                int output_fd = platform::open_file(annotations.c_str(), nullptr);
+                platform::seek_file(output_fd, chunk.encoded_offset);
+                util::BufferedFileWriter<true> output(output_fd, true);
+
+                auto unresolved = chunk.unresolved.begin();
+                std::uint64_t offset = 0;
+                for (InstructionNumber inum = chunk.end; inum != chunk.start;) {
+                    inum--;
+                    Annotation& ann = scratch.start_read<Annotation>();
+                    for (; unresolved != chunk.unresolved.end() && unresolved->offset == offset; unresolved++) {
+                        ann.slots[unresolved->slot].next_use = unresolved->next_use;
+                    }
+                    std::uint8_t* encoded = static_cast<std::uint8_t*>(output.start_write(Annotation::max_encoded_size));
+                    output.finish_write(ann.encode(encoded, inum));
+                    offset += ann.size() + 1;
+                    scratch.finish_read(ann.size());
+                }
+                assert(unresolved == chunk.unresolved.end());
+            }
+            platform::remove_file(chunk.scratch_file.c_str());
+        }
+    }
+
+    static std::uint64_t annotate_program_parallel(std::string annotations, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, unsigned int num_threads) {
+        /*
+         * Find where each chunk begins with a quick backward scan that does
+         * not decode instructions.
+         */
+        std::vector<AnnotationChunk> chunks(num_threads);
+        VirtPageNumber num_pages;
+        {
+            VirtProgramReverseFileReader instructions(program);
+            instructions.set_progress_bar(progress_bar);
+            InstructionNumber num_instructions = instructions.get_header().num_instructions;
+            num_pages = instructions.get_header().num_pages;
+            InstructionNumber chunk_size = (num_instructions + num_threads - 1) / num_threads;
+            InstructionNumber inum = num_instructions;
+            for (unsigned int c = num_threads; c != 0;) {
+                c--;
+                AnnotationChunk& chunk = chunks[c];
+                chunk.start = std::min(num_instructions, c * chunk_size);
+                chunk.end = std::min(num_instructions, (c + 1) * chunk_size);
+                chunk.program_end_offset = instructions.tell();
+                chunk.scratch_file = annotations + "." + std::to_string(c);
+                if (dense_page_tables) {
+                    chunk.first_access.make_dense(num_pages);
+                }
+                for (; inum != chunk.start; inum--) {
+                    std::size_t current_size;
+                    instructions.read_instruction(current_size);
+                }
+            }
+        }
+
+        /* Annotate each chunk concurrently. */
+        std::vector<std::thread> threads;
+        for (AnnotationChunk& chunk : chunks) {
+            threads.emplace_back([&chunk, &program, page_shift]() {
+                annotate_chunk(chunk, program, page_shift);
+            });
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+        threads.clear();
+
+        /*
+         * Resolve slots whose next use lies in a later chunk, walking the
+         * chunks backward and accumulating the first access to each page
+         * after the current chunk. Annotations are written in reverse order,
+         * so the last chunk comes first in the output file.
+         */
+        util::PageMap<VirtPageNumber, InstructionNumber> next_access;
+        if (dense_page_tables) {
+            next_access.make_dense(num_pages);
+        }
+        std::uint64_t max_working_set_size = 0;
+        for (auto c = chunks.rbegin(); c != chunks.rend(); c++) {
+            for (UnresolvedSlot& unresolved : c->unresolved) {
+                InstructionNumber* next = next_access.find(unresolved.vpn);
+                if (next != nullptr && *next != invalid_instr) {
+                    unresolved.next_use = *next;
+                    c->encoded_length += util::varint_size(*next - unresolved.inum) - util::varint_size(0);
+                }
+            }
+            c->first_access.for_each([&next_access](VirtPageNumber vpn, InstructionNumber first) {
+                next_access[vpn] = first;
+            });
+            max_working_set_size = std::max(max_working_set_size, c->max_working_set_size);
+        }
+
+        /*
+         * Compress each chunk's annotations concurrently, directly into its
+         * place in the output file.
+         */
+        std::uint64_t length = 0;
+        for (auto c = chunks.rbegin(); c != chunks.rend(); c++) {
+            c->encoded_offset = length;
+            length += c->encoded_length;
+        }
+        platform::close_file(platform::create_file(annotations.c_str(), length));
+        for (AnnotationChunk& chunk : chunks) {
+            threads.emplace_back([&chunk, &annotations]() {
+                encode_chunk(chunk, annotations);
+            });
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+
+        return max_working_set_size;
+    }
+
+    std::uint64_t annotate_program(std::string annotations, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, unsigned int num_threads) {
+        if (num_threads > 1) {
+            return annotate_program_parallel(annotations, program, page_shift, progress_bar, dense_page_tables, num_threads);
+        }
         util::BufferedFileWriter<true> output(annotations.c_str());
-        return annotate_program(output, program, page_shift, progress_bar);
+        return annotate_program(output, program, page_shift, progress_bar, dense_page_tables);
     }
 }
@@ -30,10 +30,14 @@
 #ifndef MAGE_MEMPROG_ANNOTATION_HPP_
 #define MAGE_MEMPROG_ANNOTATION_HPP_
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include "addr.hpp"
 #include "memprog/program.hpp"
 #include "util/filebuffer.hpp"
+#include "util/varint.hpp"
 
 namespace mage::memprog {
     /**
@@ -42,6 +46,9 @@ namespace mage::memprog {
      * An annotation describes, for page accessed by an instruction, the
      * position of the next instruction that acesses that page, or
      * @p invalid_instr if no future instruction accesses that page.
+     *
+     * In annotation files, annotations are stored in a compact form (see
+     * @p encode), and this structure is used to work with them in memory.
      */
     struct Annotation {
         struct {
@@ -51,6 +58,55 @@ namespace mage::memprog {
             InstructionNumber next_use : instruction_number_bits;
         } __attribute__((packed)) slots[5];
 
+        /**
+         * @brief The maximum size of an annotation in compact form.
+         */
+        static constexpr std::size_t max_encoded_size = 5 * util::max_varint_size(instruction_number_bits);
+
+        /**
+         * @brief Encodes this annotation in compact form.
+         *
+         * The compact form omits the header, since the number of pages is
+         * given by the corresponding instruction. Each slot is stored as a
+         * varint containing the distance from the annotated instruction to
+         * the next use, or zero if there is no next use. Next uses tend to be
+         * close by, so this is usually much smaller than the in-memory form.
+         *
+         * @param into The buffer into which to write the compact form, which
+         * must have space for at least @p max_encoded_size bytes.
+         * @param inum The number (index) of the annotated instruction.
+         * @return The size of the compact form, in bytes.
+         */
+        std::size_t encode(std::uint8_t* into, InstructionNumber inum) const {
+            std::size_t size = 0;
+            for (std::uint16_t i = 0; i != this->header.num_pages; i++) {
+                InstructionNumber next_use = this->slots[i].next_use;
+                std::uint64_t delta = (next_use == invalid_instr) ? 0 : next_use - inum;
+                size += util::encode_varint(delta, &into[size]);
+            }
+            return size;
+        }
+
+        /**
+         * @brief Decodes an annotation in compact form into this annotation.
+         *
+         * @param from The buffer containing the compact form.
+         * @param num_pages The number of pages accessed by the annotated
+         * instruction.
+         * @param inum The number (index) of the annotated instruction.
+         * @return The size of the compact form, in bytes.
+         */
+        std::size_t decode(const std::uint8_t* from, std::uint16_t num_pages, InstructionNumber inum) {
+            std::size_t size = 0;
+            this->header.num_pages = num_pages;
+            for (std::uint16_t i = 0; i != num_pages; i++) {
+                std::uint64_t delta;
+                size += util::decode_varint(&from[size], delta);
+                this->slots[i].next_use = (delta == 0) ? invalid_instr : inum + delta;
+            }
+            return size;
+        }
+
         /**
          * @brief Computes the size of this annotation based on its header.
          *
@@ -93,6 +149,48 @@ namespace mage::memprog {
         }
     } __attribute__((packed));
 
+    /**
+     * @brief Tool for reading an annotation file, produced by
+     * @p annotate_program, in lockstep with the virtual bytecode.
+     *
+     * Annotations are written in reverse order by the reverse pass, so they
+     * are read from the end of the file, yielding them in the same order as
+     * the instructions of the virtual bytecode.
+     */
+    class AnnotationReader {
+    public:
+        /**
+         * @brief Opens the annotation file with the specified name.
+         *
+         * @param annotations_file The name of the annotation file to read.
+         */
+        AnnotationReader(const std::string& annotations_file) : input(annotations_file.c_str()), next_inum(0) {
+        }
+
+        /**
+         * @brief Reads the annotation for the next instruction.
+         *
+         * The returned reference is valid until the next call to this
+         * function.
+         *
+         * @param num_pages The number of pages accessed by the next
+         * instruction.
+         * @return A reference to the annotation for the next instruction.
+         */
+        const Annotation& read(std::uint16_t num_pages) {
+            std::size_t size;
+            const std::uint8_t* encoded = &this->input.read<std::uint8_t>(size);
+            std::size_t decoded_size = this->current.decode(encoded, num_pages, this->next_inum++);
+            assert(decoded_size == size);
+            return this->current;
+        }
+
+    private:
+        util::BufferedReverseFileReader<true> input;
+        Annotation current;
+        InstructionNumber next_inum;
+    };
+
     /**
      * @brief Computes annotations for a virtual bytecode.
      *
@@ -106,8 +204,22 @@ namespace mage::memprog {
      * @param page_shift Base-2 logarithm of the page size.
      * @param progress_bar Progress bar to use to show progress, or nullptr if
      * none should be used.
+     * @param dense_page_tables If true, track the next access to each page
+     * using a flat array indexed by virtual page number instead of a hash
+     * table. This is faster but uses memory proportional to the number of
+     * virtual pages in the program (per thread, if @p num_threads is greater
+     * than one).
+     * @param num_threads The number of threads to use. If greater than one,
+     * the program is split into that many chunks, which are annotated
+     * concurrently; the slots whose next use lies in a later chunk are then
+     * filled in by a pass over the chunk boundaries. Each chunk is written to
+     * a temporary file next to @p annotations, and then compressed directly
+     * into its place in @p annotations.
+     * @return The maximum number of pages with a future use at any point in
+     * the program (with multiple threads, the maximum within any one chunk,
+     * which is a lower bound).
      */
-    std::uint64_t annotate_program(std::string annotations, std::string program, PageShift page_shift, util::ProgressBar* progress_bar = nullptr);
+    std::uint64_t annotate_program(std::string annotations, std::string program, PageShift page_shift, util::ProgressBar* progress_bar = nullptr, bool dense_page_tables = false, unsigned int num_threads = 1);
 }
 
 #endif
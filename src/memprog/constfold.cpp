@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "memprog/constfold.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "addr.hpp"
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+#include "util/pagemap.hpp"
+#include "util/progress.hpp"
+
+namespace mage::memprog {
+    namespace {
+        /*
+         * A sequence of bits, each of which is either a known public
+         * constant or unknown. Bit i is stored at bit (i & 0x3F) of word
+         * (i >> 6). Unknown bits always have a value of zero.
+         */
+        struct ConstantBits {
+            std::vector<std::uint64_t> known;
+            std::vector<std::uint64_t> value;
+            std::uint64_t length;
+
+            void reset(std::uint64_t num_bits) {
+                std::uint64_t num_words = (num_bits + 63) >> 6;
+                this->known.assign(num_words, 0);
+                this->value.assign(num_words, 0);
+                this->length = num_bits;
+            }
+
+            /* Mask of the bits of word I that are within the sequence. */
+            std::uint64_t word_mask(std::uint64_t i) const {
+                std::uint64_t end = std::min<std::uint64_t>(this->length - (i << 6), 64);
+                return (end == 64) ? ~UINT64_C(0) : ((UINT64_C(1) << end) - 1);
+            }
+
+            bool any_known() const {
+                for (std::uint64_t word : this->known) {
+                    if (word != 0) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool all_known() const {
+                for (std::uint64_t i = 0; i != this->known.size(); i++) {
+                    if (this->known[i] != this->word_mask(i)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            bool all_equal(bool bit) const {
+                for (std::uint64_t i = 0; i != this->known.size(); i++) {
+                    std::uint64_t mask = this->word_mask(i);
+                    if (this->known[i] != mask || this->value[i] != (bit ? mask : 0)) {
+                        return false;
+                    }
+                }
+                return this->length != 0;
+            }
+
+            std::uint64_t to_integer() const {
+                return this->value.empty() ? 0 : this->value[0];
+            }
+
+            void from_integer(std::uint64_t num_bits, std::uint64_t integer) {
+                this->reset(num_bits);
+                if (num_bits != 0) {
+                    this->known[0] = this->word_mask(0);
+                    this->value[0] = integer & this->known[0];
+                }
+            }
+        };
+
+        /*
+         * Tracks which units of the MAGE-virtual address space hold a public
+         * constant, as a pair of bitmaps for each page with any such units.
+         */
+        class ConstantUnits {
+        public:
+            ConstantUnits(PageShift shift, VirtPageNumber num_pages, bool dense) : page_shift(shift) {
+                this->words_per_page = (pg_size(shift) + 63) >> 6;
+                if (dense) {
+                    this->pages.make_dense(num_pages);
+                }
+            }
+
+            void load(VirtAddr addr, std::uint64_t length, ConstantBits& bits) {
+                bits.reset(length);
+                this->for_each_unit(addr, length, false, [&bits](ConstantPage& page, std::uint64_t offset, std::uint64_t i) {
+                    std::uint64_t bit = UINT64_C(1) << (offset & 0x3F);
+                    if ((page.known[offset >> 6] & bit) != 0) {
+                        bits.known[i >> 6] |= UINT64_C(1) << (i & 0x3F);
+                        if ((page.value[offset >> 6] & bit) != 0) {
+                            bits.value[i >> 6] |= UINT64_C(1) << (i & 0x3F);
+                        }
+                    }
+                });
+            }
+
+            void store(VirtAddr addr, const ConstantBits& bits) {
+                this->for_each_unit(addr, bits.length, bits.any_known(), [&bits](ConstantPage& page, std::uint64_t offset, std::uint64_t i) {
+                    std::uint64_t bit = UINT64_C(1) << (offset & 0x3F);
+                    std::uint64_t& known = page.known[offset >> 6];
+                    std::uint64_t& value = page.value[offset >> 6];
+                    page.num_known -= ((known & bit) != 0) ? 1 : 0;
+                    known &= ~bit;
+                    value &= ~bit;
+                    if (((bits.known[i >> 6] >> (i & 0x3F)) & 0x1) != 0) {
+                        page.num_known++;
+                        known |= bit;
+                        if (((bits.value[i >> 6] >> (i & 0x3F)) & 0x1) != 0) {
+                            value |= bit;
+                        }
+                    }
+                });
+            }
+
+            void clear(VirtAddr addr, std::uint64_t length) {
+                this->for_each_unit(addr, length, false, [](ConstantPage& page, std::uint64_t offset, std::uint64_t) {
+                    std::uint64_t bit = UINT64_C(1) << (offset & 0x3F);
+                    std::uint64_t& known = page.known[offset >> 6];
+                    page.num_known -= ((known & bit) != 0) ? 1 : 0;
+                    known &= ~bit;
+                    page.value[offset >> 6] &= ~bit;
+                });
+            }
+
+        private:
+            struct ConstantPage {
+                std::vector<std::uint64_t> known;
+                std::vector<std::uint64_t> value;
+                std::uint64_t num_known = 0;
+            };
+
+            /*
+             * Invokes F on each unit in the specified range, with its offset
+             * within its page and its index within the range. Pages with no
+             * constant units are created only if CREATE is true, and are
+             * discarded once F leaves them with no constant units.
+             */
+            template <typename F>
+            void for_each_unit(VirtAddr addr, std::uint64_t length, bool create, F f) {
+                std::uint64_t i = 0;
+                while (i != length) {
+                    VirtPageNumber vpn = pg_num(addr + i, this->page_shift);
+                    std::uint64_t offset = pg_offset(addr + i, this->page_shift);
+                    std::uint64_t in_page = std::min<std::uint64_t>(length - i, pg_size(this->page_shift) - offset);
+
+                    ConstantPage* page = this->pages.find(vpn);
+                    if (page == nullptr) {
+                        if (!create) {
+                            i += in_page;
+                            continue;
+                        }
+                        page = &this->pages.insert(vpn, ConstantPage());
+                        page->known.resize(this->words_per_page);
+                        page->value.resize(this->words_per_page);
+                    }
+                    for (std::uint64_t end = i + in_page; i != end; i++, offset++) {
+                        f(*page, offset, i);
+                    }
+                    if (page->num_known == 0) {
+                        this->pages.erase(vpn);
+                    }
+                }
+            }
+
+            util::PageMap<VirtPageNumber, ConstantPage> pages;
+            std::uint64_t words_per_page;
+            PageShift page_shift;
+        };
+
+        /*
+         * Computes which bits of the output of INSTR are public constants,
+         * given which bits of its inputs are, following the semantics of
+         * MAGE's engines for boolean circuits. Returns false if the operation
+         * is not one that this pass knows the semantics of.
+         */
+        bool evaluate(const PackedVirtInstruction& instr, const ConstantBits& in1, const ConstantBits& in2, const ConstantBits& in3, ConstantBits& result) {
+            std::uint64_t width = instr.three_args.width;
+            switch (instr.header.operation) {
+            case OpCode::Copy:
+                result = in1;
+                return true;
+            case OpCode::BitNOT:
+                result.reset(width);
+                for (std::uint64_t i = 0; i != result.known.size(); i++) {
+                    result.known[i] = in1.known[i];
+                    result.value[i] = ~in1.value[i] & in1.known[i];
+                }
+                return true;
+            case OpCode::BitAND:
+                result.reset(width);
+                for (std::uint64_t i = 0; i != result.known.size(); i++) {
+                    std::uint64_t zero1 = in1.known[i] & ~in1.value[i];
+                    std::uint64_t zero2 = in2.known[i] & ~in2.value[i];
+                    result.known[i] = (in1.known[i] & in2.known[i]) | zero1 | zero2;
+                    result.value[i] = in1.value[i] & in2.value[i];
+                }
+                return true;
+            case OpCode::BitOR:
+                result.reset(width);
+                for (std::uint64_t i = 0; i != result.known.size(); i++) {
+                    result.known[i] = (in1.known[i] & in2.known[i]) | in1.value[i] | in2.value[i];
+                    result.value[i] = in1.value[i] | in2.value[i];
+                }
+                return true;
+            case OpCode::BitXOR:
+                result.reset(width);
+                for (std::uint64_t i = 0; i != result.known.size(); i++) {
+                    result.known[i] = in1.known[i] & in2.known[i];
+                    result.value[i] = (in1.value[i] ^ in2.value[i]) & result.known[i];
+                }
+                return true;
+            case OpCode::ValueSelect:
+                if (in3.all_known()) {
+                    result = (in3.to_integer() != 0) ? in1 : in2;
+                    return true;
+                }
+                result.reset(width);
+                for (std::uint64_t i = 0; i != result.known.size(); i++) {
+                    result.known[i] = in1.known[i] & in2.known[i] & ~(in1.value[i] ^ in2.value[i]);
+                    result.value[i] = in1.value[i] & result.known[i];
+                }
+                return true;
+            case OpCode::IntAdd:
+            case OpCode::IntIncrement:
+            case OpCode::IntSub:
+            case OpCode::IntDecrement:
+            case OpCode::IntLess:
+            case OpCode::Equal:
+            case OpCode::IsZero:
+            case OpCode::NonZero:
+                break;
+            case OpCode::IntAddWithCarry:
+                width++;
+                break;
+            case OpCode::IntMultiply:
+                width <<= 1;
+                break;
+            default:
+                return false;
+            }
+
+            std::uint64_t a = in1.to_integer();
+            std::uint64_t b = in2.to_integer();
+            bool inputs_known = in1.all_known() && (OpInfo(instr.header.operation).num_args() < 2 || in2.all_known());
+            switch (instr.header.operation) {
+            case OpCode::IntLess:
+                result.reset(1);
+                if (inputs_known && in1.length <= 64) {
+                    result.from_integer(1, a < b ? 1 : 0);
+                }
+                return true;
+            case OpCode::Equal:
+                result.reset(1);
+                if (inputs_known && in1.length <= 64) {
+                    result.from_integer(1, a == b ? 1 : 0);
+                }
+                return true;
+            case OpCode::IsZero:
+            case OpCode::NonZero:
+                result.reset(1);
+                return true;
+            default:
+                break;
+            }
+
+            result.reset(width);
+            if (!inputs_known || width > 64) {
+                return true;
+            }
+            switch (instr.header.operation) {
+            case OpCode::IntAdd:
+            case OpCode::IntAddWithCarry:
+                result.from_integer(width, a + b);
+                break;
+            case OpCode::IntIncrement:
+                result.from_integer(width, a + 1);
+                break;
+            case OpCode::IntSub:
+                result.from_integer(width, a - b);
+                break;
+            case OpCode::IntDecrement:
+                result.from_integer(width, a - 1);
+                break;
+            case OpCode::IntMultiply:
+                result.from_integer(width, a * b);
+                break;
+            default:
+                break;
+            }
+            return true;
+        }
+
+        /*
+         * Checks if INSTR, one of whose operands is a public constant, is
+         * equivalent to copying (or negating) another of its operands. If so,
+         * populates SIMPLIFIED with the equivalent instruction and returns
+         * the index of the operand that it reads (1 to 3); otherwise,
+         * returns 0.
+         */
+        int simplify(const PackedVirtInstruction& instr, const ConstantBits& in1, const ConstantBits& in2, const ConstantBits& in3, Instruction& simplified) {
+            int source = 0;
+            OpCode operation = OpCode::Copy;
+            switch (instr.header.operation) {
+            case OpCode::BitAND:
+                source = in1.all_equal(true) ? 2 : (in2.all_equal(true) ? 1 : 0);
+                break;
+            case OpCode::BitOR:
+            case OpCode::IntAdd:
+                source = in1.all_equal(false) ? 2 : (in2.all_equal(false) ? 1 : 0);
+                break;
+            case OpCode::IntSub:
+                source = in2.all_equal(false) ? 1 : 0;
+                break;
+            case OpCode::BitXOR:
+                if (in1.all_known() && (in1.all_equal(false) || in1.all_equal(true))) {
+                    source = 2;
+                    operation = in1.all_equal(false) ? OpCode::Copy : OpCode::BitNOT;
+                } else if (in2.all_known() && (in2.all_equal(false) || in2.all_equal(true))) {
+                    source = 1;
+                    operation = in2.all_equal(false) ? OpCode::Copy : OpCode::BitNOT;
+                }
+                break;
+            case OpCode::ValueSelect:
+                if (in3.all_known()) {
+                    source = (in3.to_integer() != 0) ? 1 : 2;
+                }
+                break;
+            default:
+                break;
+            }
+            if (source == 0) {
+                return 0;
+            }
+
+            simplified.header.operation = operation;
+            simplified.header.width = instr.three_args.width;
+            simplified.header.flags = instr.header.flags;
+            simplified.header.output = instr.three_args.output;
+            simplified.one_arg.input1 = (source == 1) ? instr.three_args.input1 : instr.three_args.input2;
+            return source;
+        }
+    }
+
+    bool fold_constants(std::string output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, ConstantFoldingStats& stats) {
+        VirtProgramFileReader input(program);
+        input.set_progress_bar(progress_bar);
+        InstructionNumber num_instructions = input.get_header().num_instructions;
+        VirtPageNumber num_pages = input.get_header().num_pages;
+        VirtProgramFileWriter folded(output, page_shift, num_pages);
+
+        ConstantUnits constants(page_shift, num_pages, dense_page_tables);
+        ConstantBits in1;
+        ConstantBits in2;
+        ConstantBits in3;
+        ConstantBits result;
+        stats = {};
+        for (InstructionNumber inum = 0; inum != num_instructions; inum++) {
+            PackedVirtInstruction& current = input.start_instruction();
+            std::size_t size = current.size();
+            std::uint8_t flags = current.header.flags;
+            Instruction rewritten;
+            bool rewrite = false;
+
+            switch (current.header.operation) {
+            case OpCode::PrintStats:
+            case OpCode::StartTimer:
+            case OpCode::StopTimer:
+            case OpCode::NetworkFinishReceive:
+            case OpCode::NetworkBufferSend:
+            case OpCode::NetworkFinishSend:
+            case OpCode::Output:
+                break;
+            case OpCode::Input:
+            case OpCode::NetworkPostReceive:
+                constants.clear(current.no_args.output, current.no_args.width);
+                break;
+            case OpCode::PublicConstant:
+                result.from_integer(current.constant.width, current.constant.constant);
+                constants.store(current.constant.output, result);
+                break;
+            case OpCode::CondSwap:
+                /* Both operands are updated in place, so neither is a public constant afterward. */
+                constants.load(current.two_args.input2, 1, in2);
+                if (in2.any_known()) {
+                    flags |= FlagInput2Constant;
+                    stats.num_constant_operands++;
+                }
+                constants.clear(current.two_args.output, current.two_args.width);
+                constants.clear(current.two_args.input1, current.two_args.width);
+                break;
+            default:
+                int num_args = OpInfo(current.header.operation).num_args();
+                constants.load(current.three_args.input1, current.three_args.width, in1);
+                constants.load(current.three_args.input2, (num_args > 1) ? current.three_args.width : 0, in2);
+                constants.load(current.three_args.input3, (num_args > 2) ? 1 : 0, in3);
+                if (!evaluate(current, in1, in2, in3, result)) {
+                    return false;
+                }
+
+                /*
+                 * Only PublicConstant and Copy instructions are guaranteed to
+                 * leave the engine's encoding of a public constant in their
+                 * outputs, so other outputs are considered to be unknown.
+                 */
+                if (result.all_known() && result.length != 0 && result.length <= 64) {
+                    rewritten.header.operation = OpCode::PublicConstant;
+                    rewritten.header.width = result.length;
+                    rewritten.header.flags = flags;
+                    rewritten.header.output = current.three_args.output;
+                    rewritten.constant.constant = result.to_integer();
+                    rewrite = true;
+                    stats.num_folded_constants++;
+                } else if (int source = simplify(current, in1, in2, in3, rewritten); source != 0) {
+                    rewrite = true;
+                    stats.num_folded_copies++;
+                    if (rewritten.header.operation != OpCode::Copy) {
+                        result.reset(result.length);
+                    }
+                } else if (current.header.operation != OpCode::Copy) {
+                    if (in1.any_known()) {
+                        flags |= FlagInput1Constant;
+                        stats.num_constant_operands++;
+                    }
+                    if (in2.any_known()) {
+                        flags |= FlagInput2Constant;
+                        stats.num_constant_operands++;
+                    }
+                    if (in3.any_known()) {
+                        flags |= FlagInput3Constant;
+                        stats.num_constant_operands++;
+                    }
+                    result.reset(result.length);
+                }
+                constants.store(current.three_args.output, result);
+                break;
+            }
+
+            if (rewrite) {
+                folded.append_instruction(rewritten);
+            } else {
+                PackedVirtInstruction& copy = folded.start_instruction(size);
+                std::copy_n(reinterpret_cast<const std::uint8_t*>(&current), size, reinterpret_cast<std::uint8_t*>(&copy));
+                copy.header.flags = flags;
+                folded.finish_instruction(size);
+            }
+            input.finish_instruction(size);
+        }
+
+        return true;
+    }
+}
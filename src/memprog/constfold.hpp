@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file memprog/constfold.hpp
+ * @brief Constant propagation and folding pass for MAGE's planner
+ *
+ * Values initialized from public constants (e.g., an accumulator that starts
+ * at zero) flow into operations that the engine would otherwise evaluate
+ * gate-by-gate. This pass evaluates such operations at planning time where
+ * possible, and marks the remaining operands that hold public constants so
+ * that the engine can avoid expensive gates for them.
+ */
+
+#ifndef MAGE_MEMPROG_CONSTFOLD_HPP_
+#define MAGE_MEMPROG_CONSTFOLD_HPP_
+
+#include <cstdint>
+#include <string>
+#include "addr.hpp"
+#include "util/progress.hpp"
+
+namespace mage::memprog {
+    /**
+     * @brief Statistics describing the effect of the constant folding pass.
+     */
+    struct ConstantFoldingStats {
+        std::uint64_t num_folded_constants;
+        std::uint64_t num_folded_copies;
+        std::uint64_t num_constant_operands;
+    };
+
+    /**
+     * @brief Copies a virtual bytecode, evaluating operations on public
+     * constants at planning time.
+     *
+     * A forward pass tracks which units of the MAGE-virtual address space
+     * hold a public constant written by a PublicConstant instruction, either
+     * directly or through Copy instructions. An instruction whose output is
+     * entirely determined by such constants is replaced with a
+     * PublicConstant instruction (if its output is at most 64 bits wide). A
+     * bitwise operation, addition, or subtraction in which one operand is an
+     * identity (e.g., AND with all ones or XOR with zero) is replaced with a
+     * Copy, or a BitNOT for XOR with all ones, and a ValueSelect with a
+     * constant selector is replaced with a Copy. For any other instruction,
+     * the FlagInput1Constant, FlagInput2Constant, and FlagInput3Constant
+     * flags are set on each operand that contains at least one public
+     * constant bit.
+     *
+     * Operations are evaluated with the semantics described on
+     * get_operands(); programs containing other instructions are left alone.
+     *
+     * @param output The file name to which the folded instructions should be
+     * written.
+     * @param program The file name containing the virtual bytecode to read.
+     * @param page_shift Base-2 logarithm of the page size.
+     * @param progress_bar Progress bar to use to show the progress of the
+     * pass, or nullptr if none should be used.
+     * @param dense_page_tables If true, track the constant parts of each
+     * page using a flat array indexed by virtual page number instead of a
+     * hash table.
+     * @param[out] stats Populated with the number of instructions folded and
+     * operands marked as constant.
+     * @return True if the folded instructions were written to @p output, or
+     * false if @p program contains instructions that are not supported, in
+     * which case @p output may be partially written and should be discarded.
+     */
+    bool fold_constants(std::string output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, ConstantFoldingStats& stats);
+}
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "memprog/copyelision.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "addr.hpp"
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+#include "memprog/operands.hpp"
+#include "util/pagemap.hpp"
+#include "util/progress.hpp"
+
+namespace mage::memprog {
+    namespace {
+        bool overlaps(VirtAddr a, std::uint64_t a_length, VirtAddr b, std::uint64_t b_length) {
+            return a < b + b_length && b < a + a_length;
+        }
+
+        bool contains(VirtAddr outer, std::uint64_t outer_length, VirtAddr inner, std::uint64_t inner_length) {
+            return outer <= inner && inner + inner_length <= outer + outer_length;
+        }
+
+        struct TrackedCopy {
+            VirtAddr destination;
+            VirtAddr source;
+            std::uint64_t width;
+            InstructionNumber inum;
+            bool destination_written;
+            bool source_written;
+        };
+
+        /*
+         * A set of Copy instructions, indexed by the pages spanned by their
+         * sources and by the pages spanned by their destinations.
+         */
+        class TrackedCopies {
+        public:
+            TrackedCopies(PageShift shift, VirtPageNumber num_pages, bool dense) : next_id(0), page_shift(shift) {
+                if (dense) {
+                    this->by_destination.make_dense(num_pages);
+                    this->by_source.make_dense(num_pages);
+                }
+            }
+
+            bool empty() const {
+                return this->copies.empty();
+            }
+
+            TrackedCopy& get(std::uint64_t id) {
+                return this->copies.at(id);
+            }
+
+            std::uint64_t track(const TrackedCopy& copy) {
+                std::uint64_t id = this->next_id++;
+                this->copies.insert(std::make_pair(id, copy));
+                this->update_index(this->by_destination, copy.destination, copy.width, id, true);
+                this->update_index(this->by_source, copy.source, copy.width, id, true);
+                return id;
+            }
+
+            void untrack(std::uint64_t id) {
+                const TrackedCopy& copy = this->copies.at(id);
+                this->update_index(this->by_destination, copy.destination, copy.width, id, false);
+                this->update_index(this->by_source, copy.source, copy.width, id, false);
+                this->copies.erase(id);
+            }
+
+            /*
+             * Populates IDS with the tracked copies whose destinations (or
+             * sources, if BY_DESTINATION is false) overlap the specified
+             * range.
+             */
+            void find(bool destination, VirtAddr addr, std::uint64_t length, std::vector<std::uint64_t>& ids) {
+                ids.clear();
+                if (this->copies.empty() || length == 0) {
+                    return;
+                }
+                util::PageMap<VirtPageNumber, std::vector<std::uint64_t>>& index = destination ? this->by_destination : this->by_source;
+                VirtPageNumber last = pg_num(addr + length - 1, this->page_shift);
+                for (VirtPageNumber vpn = pg_num(addr, this->page_shift); vpn <= last; vpn++) {
+                    std::vector<std::uint64_t>* on_page = index.find(vpn);
+                    if (on_page == nullptr) {
+                        continue;
+                    }
+                    for (std::uint64_t id : *on_page) {
+                        const TrackedCopy& copy = this->copies.at(id);
+                        VirtAddr start = destination ? copy.destination : copy.source;
+                        if (overlaps(start, copy.width, addr, length) && std::find(ids.begin(), ids.end(), id) == ids.end()) {
+                            ids.push_back(id);
+                        }
+                    }
+                }
+            }
+
+            template <typename F>
+            void for_each(F f) {
+                for (auto& [id, copy] : this->copies) {
+                    f(copy);
+                }
+            }
+
+        private:
+            void update_index(util::PageMap<VirtPageNumber, std::vector<std::uint64_t>>& index, VirtAddr addr, std::uint64_t length, std::uint64_t id, bool add) {
+                VirtPageNumber last = pg_num(addr + length - 1, this->page_shift);
+                for (VirtPageNumber vpn = pg_num(addr, this->page_shift); vpn <= last; vpn++) {
+                    std::vector<std::uint64_t>& on_page = index[vpn];
+                    if (add) {
+                        on_page.push_back(id);
+                    } else {
+                        *std::find(on_page.begin(), on_page.end(), id) = on_page.back();
+                        on_page.pop_back();
+                        if (on_page.empty()) {
+                            index.erase(vpn);
+                        }
+                    }
+                }
+            }
+
+            std::unordered_map<std::uint64_t, TrackedCopy> copies;
+            util::PageMap<VirtPageNumber, std::vector<std::uint64_t>> by_destination;
+            util::PageMap<VirtPageNumber, std::vector<std::uint64_t>> by_source;
+            std::uint64_t next_id;
+            PageShift page_shift;
+        };
+
+        /*
+         * Decides which Copy instructions in PROGRAM can be elided, returning
+         * false if PROGRAM contains instructions whose semantics are not
+         * known.
+         */
+        bool find_elidable_copies(const std::string& program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, std::vector<bool>& elide) {
+            VirtProgramFileReader input(program);
+            input.set_progress_bar(progress_bar);
+            InstructionNumber num_instructions = input.get_header().num_instructions;
+            elide.resize(num_instructions);
+
+            TrackedCopies candidates(page_shift, input.get_header().num_pages, dense_page_tables);
+            Operands operands;
+            std::vector<std::uint64_t> ids;
+            for (InstructionNumber inum = 0; inum != num_instructions; inum++) {
+                PackedVirtInstruction& current = input.start_instruction();
+                if (!get_operands(current, operands)) {
+                    return false;
+                }
+
+                if (operands.in_place) {
+                    /* Operands updated in place cannot be renamed, and overwrite any copy's source. */
+                    for (const auto& [addr, length] : { operands.output, operands.inputs[0] }) {
+                        candidates.find(true, addr, length, ids);
+                        for (std::uint64_t id : ids) {
+                            candidates.untrack(id);
+                        }
+                        candidates.find(false, addr, length, ids);
+                        for (std::uint64_t id : ids) {
+                            candidates.get(id).source_written = true;
+                        }
+                    }
+                }
+
+                VirtAddr written_addr = 0;
+                std::uint64_t written_length = 0;
+                if (operands.writes) {
+                    std::tie(written_addr, written_length) = operands.output;
+                    if ((current.header.flags & FlagOutputPageFirstUse) != 0) {
+                        /* The rest of the page's contents are discarded. */
+                        written_addr = pg_addr(pg_num(written_addr, page_shift), page_shift);
+                        written_length = std::max<std::uint64_t>(pg_size(page_shift), operands.output.first + written_length - written_addr);
+                    }
+                }
+
+                for (std::uint8_t i = 0; i != operands.num_inputs; i++) {
+                    auto [addr, length] = operands.inputs[i];
+                    candidates.find(true, addr, length, ids);
+                    for (std::uint64_t id : ids) {
+                        const TrackedCopy& copy = candidates.get(id);
+                        /* Renaming the input must not make it alias this instruction's output. */
+                        if (!contains(copy.destination, copy.width, addr, length) || copy.destination_written || copy.source_written || overlaps(copy.source, copy.width, written_addr, written_length)) {
+                            candidates.untrack(id);
+                        }
+                    }
+                }
+
+                bool eligible = false;
+                if (current.header.operation == OpCode::Copy && current.one_arg.width != 0 && !overlaps(current.one_arg.output, current.one_arg.width, current.one_arg.input1, current.one_arg.width)) {
+                    /* Reading another candidate's destination would require renaming the source. */
+                    candidates.find(true, current.one_arg.input1, current.one_arg.width, ids);
+                    eligible = ids.empty();
+                }
+
+                if (operands.writes) {
+                    candidates.find(false, written_addr, written_length, ids);
+                    for (std::uint64_t id : ids) {
+                        candidates.get(id).source_written = true;
+                    }
+                    candidates.find(true, written_addr, written_length, ids);
+                    for (std::uint64_t id : ids) {
+                        TrackedCopy& copy = candidates.get(id);
+                        if (contains(written_addr, written_length, copy.destination, copy.width)) {
+                            elide[copy.inum] = true;
+                            candidates.untrack(id);
+                        } else {
+                            copy.destination_written = true;
+                        }
+                    }
+                }
+
+                if (eligible) {
+                    candidates.track({ current.one_arg.output, current.one_arg.input1, current.one_arg.width, inum, false, false });
+                }
+                input.finish_instruction(current.size());
+            }
+
+            candidates.for_each([&elide](const TrackedCopy& copy) {
+                elide[copy.inum] = true;
+            });
+            return true;
+        }
+    }
+
+    bool elide_copies(std::string output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, CopyElisionStats& stats) {
+        std::vector<bool> elide;
+        if (!find_elidable_copies(program, page_shift, progress_bar, dense_page_tables, elide)) {
+            return false;
+        }
+
+        VirtProgramFileReader input(program);
+        input.set_progress_bar(progress_bar);
+        VirtPageNumber num_pages = input.get_header().num_pages;
+        VirtProgramFileWriter renamed(output, page_shift, num_pages);
+
+        /* Elided copies whose destinations are read from their sources. */
+        TrackedCopies renames(page_shift, num_pages, dense_page_tables);
+        std::unordered_set<VirtPageNumber> first_use_elided;
+        Operands operands;
+        std::vector<std::uint64_t> ids;
+        stats = {};
+        for (InstructionNumber inum = 0; inum != elide.size(); inum++) {
+            PackedVirtInstruction& current = input.start_instruction();
+            std::size_t size = current.size();
+            get_operands(current, operands);
+
+            PackedVirtInstruction* copy = nullptr;
+            if (!elide[inum]) {
+                copy = &renamed.start_instruction(size);
+                std::copy_n(reinterpret_cast<const std::uint8_t*>(&current), size, reinterpret_cast<std::uint8_t*>(copy));
+                for (std::uint8_t i = 0; i != operands.num_inputs; i++) {
+                    auto [addr, length] = operands.inputs[i];
+                    renames.find(true, addr, length, ids);
+                    if (ids.empty()) {
+                        continue;
+                    }
+                    assert(ids.size() == 1);
+                    const TrackedCopy& rename = renames.get(ids[0]);
+                    assert(contains(rename.destination, rename.width, addr, length));
+                    VirtAddr renamed_addr = rename.source + (addr - rename.destination);
+                    if (!operands.writes) {
+                        copy->no_args.output = renamed_addr;
+                    } else if (i == 0) {
+                        copy->three_args.input1 = renamed_addr;
+                    } else if (i == 1) {
+                        copy->three_args.input2 = renamed_addr;
+                    } else {
+                        copy->three_args.input3 = renamed_addr;
+                    }
+                }
+            }
+
+            if (operands.writes) {
+                auto [addr, length] = operands.output;
+                VirtPageNumber output_vpn = pg_num(addr, page_shift);
+                if ((current.header.flags & FlagOutputPageFirstUse) != 0) {
+                    addr = pg_addr(output_vpn, page_shift);
+                    length = std::max<std::uint64_t>(pg_size(page_shift), operands.output.first + length - addr);
+                }
+                renames.find(true, addr, length, ids);
+                for (std::uint64_t id : ids) {
+                    renames.untrack(id);
+                }
+
+                if (elide[inum]) {
+                    if ((current.header.flags & FlagOutputPageFirstUse) != 0) {
+                        first_use_elided.insert(output_vpn);
+                    }
+                } else if (OpInfo(current.header.operation).has_variable_output() && first_use_elided.erase(output_vpn) != 0) {
+                    copy->header.flags |= FlagOutputPageFirstUse;
+                }
+            }
+
+            if (elide[inum]) {
+                renames.track({ current.one_arg.output, current.one_arg.input1, current.one_arg.width, inum, false, false });
+                stats.num_copies_elided++;
+                stats.num_units_not_copied += current.one_arg.width;
+            } else {
+                renamed.finish_instruction(size);
+            }
+            input.finish_instruction(size);
+        }
+
+        return true;
+    }
+}
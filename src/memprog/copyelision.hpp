@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file memprog/copyelision.hpp
+ * @brief Copy elision pass for MAGE's planner
+ *
+ * A Copy instruction moves every wire in its range at runtime, and touches
+ * the pages of both its source and its destination. If the source is left
+ * intact for as long as the destination's value is used, the copy can be
+ * elided by having those uses read the source instead.
+ */
+
+#ifndef MAGE_MEMPROG_COPYELISION_HPP_
+#define MAGE_MEMPROG_COPYELISION_HPP_
+
+#include <cstdint>
+#include <string>
+#include "addr.hpp"
+#include "util/progress.hpp"
+
+namespace mage::memprog {
+    /**
+     * @brief Statistics describing the effect of the copy elision pass.
+     */
+    struct CopyElisionStats {
+        std::uint64_t num_copies_elided;
+        std::uint64_t num_units_not_copied;
+    };
+
+    /**
+     * @brief Copies a virtual bytecode, omitting each Copy instruction whose
+     * source is not overwritten while its destination's value is used, and
+     * renaming the operands that read its destination to read its source.
+     *
+     * This involves two forward passes over the virtual bytecode. The first
+     * decides which Copy instructions can be elided. A Copy instruction can
+     * be elided if its source and destination do not overlap, and, until
+     * its destination is overwritten, (1) every read overlapping its
+     * destination lies entirely within its destination, and (2) none of
+     * those reads happens after its source, or the page containing it, is
+     * written or partially overwritten. The second pass copies the program,
+     * renaming the operands of the affected reads. If an elided instruction
+     * was the first use of its output page, the next instruction that
+     * writes that page is marked as its first use instead.
+     *
+     * Operand extents come from get_operands(); programs it rejects are left
+     * alone.
+     *
+     * @param output The file name to which the resulting instructions should
+     * be written.
+     * @param program The file name containing the virtual bytecode to read.
+     * @param page_shift Base-2 logarithm of the page size.
+     * @param progress_bar Progress bar to use to show the progress of each
+     * pass, or nullptr if none should be used.
+     * @param dense_page_tables If true, index the copies being tracked by
+     * page using a flat array instead of a hash table.
+     * @param[out] stats Populated with the number of Copy instructions
+     * elided and the number of units of the MAGE-virtual address space that
+     * they would have copied.
+     * @return True if the resulting instructions were written to @p output,
+     * or false if @p program contains instructions that are not supported,
+     * in which case nothing is written.
+     */
+    bool elide_copies(std::string output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, CopyElisionStats& stats);
+}
+
+#endif
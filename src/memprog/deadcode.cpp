@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "memprog/deadcode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "addr.hpp"
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+#include "memprog/operands.hpp"
+#include "util/pagemap.hpp"
+#include "util/progress.hpp"
+
+namespace mage::memprog {
+    namespace {
+        /*
+         * Tracks which units of the MAGE-virtual address space hold a value
+         * that is read later on, as a bitmap for each page with any such
+         * units.
+         */
+        class LiveUnits {
+        public:
+            LiveUnits(PageShift shift, VirtPageNumber num_pages, bool dense) : page_shift(shift) {
+                this->words_per_page = (pg_size(shift) + 63) >> 6;
+                if (dense) {
+                    this->pages.make_dense(num_pages);
+                }
+            }
+
+            bool any_live(VirtAddr addr, std::uint64_t length) {
+                bool live = false;
+                this->for_each_word(addr, length, false, [&live](LivePage& page, std::uint64_t word, std::uint64_t mask) {
+                    live = live || (page.words[word] & mask) != 0;
+                });
+                return live;
+            }
+
+            void set_live(VirtAddr addr, std::uint64_t length) {
+                this->for_each_word(addr, length, true, [](LivePage& page, std::uint64_t word, std::uint64_t mask) {
+                    page.num_live += __builtin_popcountll(mask & ~page.words[word]);
+                    page.words[word] |= mask;
+                });
+            }
+
+            void set_dead(VirtAddr addr, std::uint64_t length) {
+                this->for_each_word(addr, length, false, [](LivePage& page, std::uint64_t word, std::uint64_t mask) {
+                    page.num_live -= __builtin_popcountll(mask & page.words[word]);
+                    page.words[word] &= ~mask;
+                });
+            }
+
+        private:
+            struct LivePage {
+                std::vector<std::uint64_t> words;
+                std::uint64_t num_live = 0;
+            };
+
+            /*
+             * Invokes F on each word of the bitmap overlapping the specified
+             * range, with a mask of the bits in the range. Pages with no live
+             * units are created only if CREATE is true, and are discarded
+             * once F leaves them with no live units.
+             */
+            template <typename F>
+            void for_each_word(VirtAddr addr, std::uint64_t length, bool create, F f) {
+                VirtAddr end = addr + length;
+                while (addr != end) {
+                    VirtPageNumber vpn = pg_num(addr, this->page_shift);
+                    std::uint64_t offset = pg_offset(addr, this->page_shift);
+                    std::uint64_t in_page = std::min<std::uint64_t>(end - addr, pg_size(this->page_shift) - offset);
+                    addr += in_page;
+
+                    LivePage* page = this->pages.find(vpn);
+                    if (page == nullptr) {
+                        if (!create) {
+                            continue;
+                        }
+                        page = &this->pages.insert(vpn, LivePage());
+                        page->words.resize(this->words_per_page);
+                    }
+                    while (in_page != 0) {
+                        std::uint64_t bit = offset & 0x3F;
+                        std::uint64_t num_bits = std::min<std::uint64_t>(in_page, 64 - bit);
+                        std::uint64_t mask = (num_bits == 64) ? ~UINT64_C(0) : (((UINT64_C(1) << num_bits) - 1) << bit);
+                        f(*page, offset >> 6, mask);
+                        offset += num_bits;
+                        in_page -= num_bits;
+                    }
+                    if (page->num_live == 0) {
+                        this->pages.erase(vpn);
+                    }
+                }
+            }
+
+            util::PageMap<VirtPageNumber, LivePage> pages;
+            std::uint64_t words_per_page;
+            PageShift page_shift;
+        };
+    }
+
+    bool eliminate_dead_instructions(std::string output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, std::uint64_t& num_eliminated) {
+        std::vector<bool> dead;
+        VirtPageNumber num_pages;
+        {
+            VirtProgramReverseFileReader instructions(program);
+            instructions.set_progress_bar(progress_bar);
+            InstructionNumber inum = instructions.get_header().num_instructions;
+            num_pages = instructions.get_header().num_pages;
+            dead.resize(inum);
+
+            LiveUnits live(page_shift, num_pages, dense_page_tables);
+            Operands operands;
+            while (inum != 0) {
+                inum--;
+
+                std::size_t current_size;
+                PackedVirtInstruction& current = instructions.read_instruction(current_size);
+                if (!get_operands(current, operands)) {
+                    return false;
+                }
+                if (!operands.has_side_effects && !live.any_live(operands.output.first, operands.output.second) && !(operands.in_place && live.any_live(operands.inputs[0].first, operands.inputs[0].second))) {
+                    dead[inum] = true;
+                    continue;
+                }
+
+                /* Kill the output before the inputs, which may overlap it. */
+                if (operands.writes) {
+                    live.set_dead(operands.output.first, operands.output.second);
+                }
+                for (std::uint8_t i = 0; i != operands.num_inputs; i++) {
+                    live.set_live(operands.inputs[i].first, operands.inputs[i].second);
+                }
+            }
+        }
+
+        VirtProgramFileReader input(program);
+        VirtProgramFileWriter live_program(output, page_shift, num_pages);
+        std::unordered_set<VirtPageNumber> first_use_eliminated;
+        num_eliminated = 0;
+        for (InstructionNumber inum = 0; inum != dead.size(); inum++) {
+            PackedVirtInstruction& current = input.start_instruction();
+            std::size_t size = current.size();
+            VirtPageNumber output_vpn = pg_num(current.no_args.output, page_shift);
+            if (dead[inum]) {
+                if ((current.header.flags & FlagOutputPageFirstUse) != 0) {
+                    first_use_eliminated.insert(output_vpn);
+                }
+                num_eliminated++;
+            } else {
+                PackedVirtInstruction& copy = live_program.start_instruction(size);
+                std::copy_n(reinterpret_cast<const std::uint8_t*>(&current), size, reinterpret_cast<std::uint8_t*>(&copy));
+                if (OpInfo(copy.header.operation).has_variable_output() && first_use_eliminated.erase(output_vpn) != 0) {
+                    copy.header.flags |= FlagOutputPageFirstUse;
+                }
+                live_program.finish_instruction(size);
+            }
+            input.finish_instruction(size);
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file memprog/deadcode.hpp
+ * @brief Dead instruction elimination pass for MAGE's planner
+ *
+ * DSLs emit instructions eagerly, so the virtual bytecode may compute values
+ * that are never used. This pass removes such instructions before the
+ * annotation pass, so that they are never executed, swapped, or sent.
+ */
+
+#ifndef MAGE_MEMPROG_DEADCODE_HPP_
+#define MAGE_MEMPROG_DEADCODE_HPP_
+
+#include <cstdint>
+#include <string>
+#include "addr.hpp"
+#include "util/progress.hpp"
+
+namespace mage::memprog {
+    /**
+     * @brief Copies a virtual bytecode, omitting each instruction whose
+     * output is overwritten or recycled without any part of it being read.
+     *
+     * This involves a backward liveness pass over the virtual bytecode,
+     * followed by a forward pass that copies the live instructions. Input,
+     * Output, network, and control instructions are always kept. If an
+     * omitted instruction was the first use of its output page, the next
+     * instruction that writes that page is marked as its first use instead.
+     *
+     * Operand extents come from get_operands(); programs it rejects are left
+     * alone.
+     *
+     * @param output The file name to which the live instructions should be
+     * written.
+     * @param program The file name containing the virtual bytecode to read.
+     * This sequence of instructions should be reverse-iterable (e.g., written
+     * with a BufferedFileWriter with backwards_readable == true).
+     * @param page_shift Base-2 logarithm of the page size.
+     * @param progress_bar Progress bar to use to show the progress of the
+     * backward pass, or nullptr if none should be used.
+     * @param dense_page_tables If true, track the live parts of each page
+     * using a flat array indexed by virtual page number instead of a hash
+     * table.
+     * @param[out] num_eliminated Set to the number of instructions omitted.
+     * @return True if the live instructions were written to @p output, or
+     * false if @p program contains instructions that are not supported, in
+     * which case nothing is written.
+     */
+    bool eliminate_dead_instructions(std::string output, std::string program, PageShift page_shift, util::ProgressBar* progress_bar, bool dense_page_tables, std::uint64_t& num_eliminated);
+}
+
+#endif
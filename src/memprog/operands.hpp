@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file memprog/operands.hpp
+ * @brief Extents of the operands of instructions in boolean circuits, for
+ * optimization passes over the virtual bytecode.
+ */
+
+#ifndef MAGE_MEMPROG_OPERANDS_HPP_
+#define MAGE_MEMPROG_OPERANDS_HPP_
+
+#include <cstdint>
+#include <array>
+#include <utility>
+#include "addr.hpp"
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+
+namespace mage::memprog {
+    /**
+     * @brief The parts of an instruction's operands that it reads and
+     * writes, as (address, length) pairs in the MAGE-virtual address space.
+     */
+    struct Operands {
+        bool has_side_effects;
+        bool writes;
+        bool in_place;
+        std::pair<VirtAddr, std::uint64_t> output;
+        std::uint8_t num_inputs;
+        std::array<std::pair<VirtAddr, std::uint64_t>, 3> inputs;
+    };
+
+    /**
+     * @brief Determines which parts of the MAGE-virtual address space an
+     * instruction reads and writes.
+     *
+     * The size of each operand is derived from the semantics of MAGE's
+     * engines for boolean circuits, in which each unit of the MAGE-virtual
+     * address space holds one wire; instructions for other engines (e.g.,
+     * CKKS) are rejected. For Output and NetworkBufferSend, the
+     * single input is the range described by the instruction's output
+     * field. Otherwise, the inputs are listed in the order of the
+     * instruction's input fields. For CondSwap, which updates its output and
+     * first input in place, the output is additionally listed as a final
+     * input, and the first input is also written.
+     *
+     * @param instr The instruction whose operands to determine.
+     * @param[out] operands Populated with the operands of @p instr.
+     * @return True if @p operands was populated, or false if the operation
+     * is not one whose semantics are known (e.g., a CKKS operation).
+     */
+    inline bool get_operands(const PackedVirtInstruction& instr, Operands& operands) {
+        std::uint64_t width = instr.three_args.width;
+        operands.has_side_effects = false;
+        operands.writes = true;
+        operands.in_place = false;
+        operands.output = std::make_pair(instr.three_args.output, width);
+        operands.num_inputs = 0;
+        switch (instr.header.operation) {
+        case OpCode::PrintStats:
+        case OpCode::StartTimer:
+        case OpCode::StopTimer:
+        case OpCode::NetworkFinishReceive:
+        case OpCode::NetworkFinishSend:
+            operands.has_side_effects = true;
+            operands.writes = false;
+            return true;
+        case OpCode::Input:
+            /* Consumes part of the input file. */
+        case OpCode::NetworkPostReceive:
+            operands.has_side_effects = true;
+            return true;
+        case OpCode::Output:
+        case OpCode::NetworkBufferSend:
+            operands.has_side_effects = true;
+            operands.writes = false;
+            operands.inputs[operands.num_inputs++] = std::make_pair(instr.no_args.output, width);
+            return true;
+        case OpCode::PublicConstant:
+            return true;
+        case OpCode::IntAddWithCarry:
+            operands.output.second = width + 1;
+            break;
+        case OpCode::IntMultiply:
+            operands.output.second = width << 1;
+            break;
+        case OpCode::IntLess:
+        case OpCode::Equal:
+        case OpCode::IsZero:
+        case OpCode::NonZero:
+            operands.output.second = 1;
+            break;
+        case OpCode::Copy:
+        case OpCode::IntAdd:
+        case OpCode::IntIncrement:
+        case OpCode::IntSub:
+        case OpCode::IntDecrement:
+        case OpCode::BitNOT:
+        case OpCode::BitAND:
+        case OpCode::BitOR:
+        case OpCode::BitXOR:
+        case OpCode::ValueSelect:
+            break;
+        case OpCode::CondSwap:
+            operands.in_place = true;
+            operands.inputs[operands.num_inputs++] = std::make_pair(instr.two_args.input1, width);
+            /* The selector of a CondSwap is a single bit. */
+            operands.inputs[operands.num_inputs++] = std::make_pair(instr.two_args.input2, 1);
+            operands.inputs[operands.num_inputs++] = operands.output;
+            return true;
+        default:
+            return false;
+        }
+
+        int num_args = OpInfo(instr.header.operation).num_args();
+        operands.inputs[operands.num_inputs++] = std::make_pair(instr.three_args.input1, width);
+        if (num_args > 1) {
+            operands.inputs[operands.num_inputs++] = std::make_pair(instr.three_args.input2, width);
+        }
+        if (num_args > 2) {
+            /* The selector of a ValueSelect is a single bit. */
+            operands.inputs[operands.num_inputs++] = std::make_pair(instr.three_args.input3, 1);
+        }
+        return true;
+    }
+}
+
+#endif
@@ -20,20 +20,50 @@
  */
 
 #include "memprog/pipeline.hpp"
+#include <cstdint>
+#include <cstdlib>
 #include <chrono>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <string>
+#include <thread>
 #include "memprog/annotation.hpp"
+#include "memprog/constfold.hpp"
+#include "memprog/copyelision.hpp"
+#include "memprog/deadcode.hpp"
 #include "memprog/placement.hpp"
 #include "memprog/program.hpp"
 #include "memprog/replacement.hpp"
 #include "memprog/scheduling.hpp"
+#include "platform/filesystem.hpp"
+#include "platform/network.hpp"
+#include "programfile.hpp"
 
 namespace mage::memprog {
+    /*
+     * Largest number of MAGE-virtual pages for which the planner uses flat
+     * arrays for its page tables, unless configured otherwise. Each page
+     * costs a few tens of bytes across the page tables.
+     */
+    static constexpr VirtPageNumber max_auto_dense_page_table_pages = UINT64_C(1) << 26;
+
+    /*
+     * Checks if the protocol with the specified placement plugin stores each
+     * bit of an integer in its own unit of the MAGE-virtual address space, as
+     * the engines for boolean circuits do.
+     */
+    static bool places_one_wire_per_unit(PlacementPlugin plugin) {
+        try {
+            return plugin(1, PlaceableType::Ciphertext) == 1 && plugin(64, PlaceableType::Ciphertext) == 64;
+        } catch (const InvalidPlacementException&) {
+            return false;
+        }
+    }
+
     DefaultPipeline::DefaultPipeline(const std::string& name) : Pipeline(name),
         page_shift(12), num_pages(1 << 10), prefetch_buffer_size(256), prefetch_lookahead(10000),
-        stats({}), verbose(false) {
+        receive_pin_window(0), page_tables(PageTableKind::Auto), annotation_threads(1), stream_physical_bytecode(false), memprog_format(ProgramFormat::Packed), lifetime_placement(false), placement_stats_interval(0), constant_folding(false), copy_elision(false), dead_code_elimination(false), num_virtual_pages(0), stats({}), verbose(false) {
     }
 
     DefaultPipeline::DefaultPipeline(const std::string& name, const util::ConfigValue& worker) : Pipeline(name) {
@@ -49,60 +79,349 @@ namespace mage::memprog {
         this->num_pages = worker["num_pages"].as_int();
         this->prefetch_buffer_size = worker["prefetch_buffer_size"].as_int();
         this->prefetch_lookahead = worker["prefetch_lookahead"].as_int();
+        if (worker.get("receive_pin_window") == nullptr) {
+            this->receive_pin_window = 0;
+        } else {
+            this->receive_pin_window = worker["receive_pin_window"].as_int();
+        }
+        if (worker.get("annotation_threads") == nullptr) {
+            this->annotation_threads = 1;
+        } else {
+            this->annotation_threads = worker["annotation_threads"].as_int();
+        }
+        if (worker.get("stream_physical_bytecode") == nullptr) {
+            this->stream_physical_bytecode = false;
+        } else {
+            this->stream_physical_bytecode = worker["stream_physical_bytecode"].as_int() != 0;
+        }
+        if (worker.get("lifetime_placement") == nullptr) {
+            this->lifetime_placement = false;
+        } else {
+            this->lifetime_placement = worker["lifetime_placement"].as_int() != 0;
+        }
+        if (worker.get("placement_stats_interval") == nullptr) {
+            this->placement_stats_interval = 0;
+        } else {
+            this->placement_stats_interval = worker["placement_stats_interval"].as_int();
+        }
+        if (worker.get("fold_constants") == nullptr) {
+            this->constant_folding = false;
+        } else {
+            this->constant_folding = worker["fold_constants"].as_int() != 0;
+        }
+        if (worker.get("elide_copies") == nullptr) {
+            this->copy_elision = false;
+        } else {
+            this->copy_elision = worker["elide_copies"].as_int() != 0;
+        }
+        if (worker.get("eliminate_dead_instructions") == nullptr) {
+            this->dead_code_elimination = false;
+        } else {
+            this->dead_code_elimination = worker["eliminate_dead_instructions"].as_int() != 0;
+        }
+        if (worker.get("memprog_format") == nullptr) {
+            this->memprog_format = ProgramFormat::Packed;
+        } else {
+            const std::string& format = worker["memprog_format"].as_string();
+            if (format == "packed") {
+                this->memprog_format = ProgramFormat::Packed;
+            } else if (format == "compact") {
+                this->memprog_format = ProgramFormat::Compact;
+            } else {
+                std::cerr << "Unknown memory program format \"" << format << "\" (expected packed or compact)" << std::endl;
+                std::abort();
+            }
+        }
+        if (worker.get("page_tables") == nullptr) {
+            this->page_tables = PageTableKind::Auto;
+        } else {
+            const std::string& kind = worker["page_tables"].as_string();
+            if (kind == "auto") {
+                this->page_tables = PageTableKind::Auto;
+            } else if (kind == "dense") {
+                this->page_tables = PageTableKind::Dense;
+            } else if (kind == "hash") {
+                this->page_tables = PageTableKind::Hash;
+            } else {
+                std::cerr << "Unknown page table kind \"" << kind << "\" (expected auto, dense, or hash)" << std::endl;
+                std::abort();
+            }
+        }
     }
 
     void DefaultPipeline::program(Program<BinnedPlacer>** p, PlacementPlugin plugin, std::function<void()> dsl_program, const std::string& prog_file) {
         Program<BinnedPlacer> program(prog_file, this->page_shift, plugin);
+        if (this->lifetime_profile) {
+            program.get_placer().use_lifetime_hints(this->lifetime_profile.get());
+        }
+        if (this->placement_stats_interval != 0) {
+            program.sample_utilization(this->placement_stats_interval);
+        }
         *p = &program;
         dsl_program();
         *p = nullptr;
+        program.flush_network_batch();
         this->stats.num_instructions = program.num_instructions();
+        this->num_virtual_pages = program.num_pages();
+        this->stats.num_virtual_pages = program.num_pages();
+        this->stats.num_coalesced_network_ops = program.get_num_coalesced_network_ops();
 
         if (this->verbose) {
-            std::cout << "Created program with " << program.num_instructions() << " instructions" << std::endl;
+            std::cout << "Created program with " << program.num_instructions() << " instructions (" << program.get_num_coalesced_network_ops() << " network instructions coalesced) and " << program.num_pages() << " virtual pages" << std::endl;
         }
+        this->record_placement_stats(program);
     }
 
-    void DefaultPipeline::allocate(const std::string& prog_file, const std::string& repprog_file) {
+    void DefaultPipeline::record_placement_stats(Program<BinnedPlacer>& program) {
+        const BinnedPlacer& placer = program.get_placer();
+        this->stats.peak_virtual_pages = placer.get_peak_allocated_pages();
+        this->stats.peak_pages_by_size = placer.get_peak_pages_by_size();
+        this->stats.placement_utilization = program.get_utilization_samples();
+
+        if (this->placement_stats_interval != 0) {
+            std::string dump_file = this->program_name + ".placement.csv";
+            std::ofstream dump(dump_file);
+            dump << "instruction,live_bytes,allocated_bytes" << std::endl;
+            for (const PlacementUtilizationSample& sample : this->stats.placement_utilization) {
+                dump << sample.instruction << "," << sample.utilization.live_bytes << "," << pg_addr(sample.utilization.allocated_pages, this->page_shift) << std::endl;
+            }
+            if (!dump) {
+                std::cerr << "Could not write placement statistics to " << dump_file << std::endl;
+                std::abort();
+            }
+        }
+
+        if (this->verbose) {
+            std::cout << "Peak virtual footprint: " << this->stats.peak_virtual_pages << " pages (";
+            const char* separator = "";
+            for (const auto& [width, pages] : this->stats.peak_pages_by_size) {
+                std::cout << separator << pages << " for width " << width;
+                separator = ", ";
+            }
+            std::cout << ")" << std::endl;
+        }
+    }
+
+    void DefaultPipeline::profile_lifetimes(Program<BinnedPlacer>** p, PlacementPlugin plugin, std::function<void()> dsl_program) {
+        std::string profile_file = this->program_name + ".lifetimes.prog";
+        this->lifetime_profile = std::make_unique<LifetimeProfile>();
+        {
+            Program<BinnedPlacer> program(profile_file, this->page_shift, plugin);
+            program.get_placer().record_lifetimes(this->lifetime_profile.get());
+            *p = &program;
+            dsl_program();
+            *p = nullptr;
+            program.flush_network_batch();
+            this->stats.num_unhinted_virtual_pages = program.num_pages();
+        }
+        platform::remove_file(profile_file.c_str());
+
+        if (this->verbose) {
+            std::cout << "Profiled allocation lifetimes (" << this->stats.num_unhinted_virtual_pages << " virtual pages without lifetime hints)" << std::endl;
+        }
+    }
+
+    std::string DefaultPipeline::fold_public_constants(const std::string& prog_file, const std::string& folded_prog_file) {
+        this->progress_bar.set_label("Constant Folding");
+        bool folded = fold_constants(folded_prog_file, prog_file, this->page_shift, &this->progress_bar, this->use_dense_page_tables(), this->stats.constant_folding);
+        this->progress_bar.finish();
+        if (!folded) {
+            platform::remove_file(folded_prog_file.c_str());
+            if (this->verbose) {
+                std::cout << "Skipped constant folding (unsupported instructions)" << std::endl;
+            }
+            return prog_file;
+        }
+        if (this->verbose) {
+            const ConstantFoldingStats& folding = this->stats.constant_folding;
+            std::cout << "Folded " << folding.num_folded_constants << " instructions into constants and " << folding.num_folded_copies << " into copies, and marked " << folding.num_constant_operands << " constant operands" << std::endl;
+        }
+        return folded_prog_file;
+    }
+
+    std::string DefaultPipeline::elide_redundant_copies(const std::string& prog_file, const std::string& elided_prog_file) {
+        this->progress_bar.set_label("Copy Elision");
+        bool elided = elide_copies(elided_prog_file, prog_file, this->page_shift, &this->progress_bar, this->use_dense_page_tables(), this->stats.copy_elision);
+        this->progress_bar.finish();
+        if (!elided) {
+            if (this->verbose) {
+                std::cout << "Skipped copy elision (unsupported instructions)" << std::endl;
+            }
+            return prog_file;
+        }
+        if (this->verbose) {
+            std::cout << "Elided " << this->stats.copy_elision.num_copies_elided << " copies (" << this->stats.copy_elision.num_units_not_copied << " units not copied)" << std::endl;
+        }
+        return elided_prog_file;
+    }
+
+    std::string DefaultPipeline::eliminate_dead_code(const std::string& prog_file, const std::string& live_prog_file) {
+        this->progress_bar.set_label("Liveness Pass");
+        bool eliminated = eliminate_dead_instructions(live_prog_file, prog_file, this->page_shift, &this->progress_bar, this->use_dense_page_tables(), this->stats.num_dead_instructions);
+        this->progress_bar.finish();
+        if (!eliminated) {
+            if (this->verbose) {
+                std::cout << "Skipped dead instruction elimination (unsupported instructions)" << std::endl;
+            }
+            return prog_file;
+        }
+        if (this->verbose) {
+            std::cout << "Eliminated " << this->stats.num_dead_instructions << " dead instructions" << std::endl;
+        }
+        return live_prog_file;
+    }
+
+    bool DefaultPipeline::use_dense_page_tables() const {
+        switch (this->page_tables) {
+        case PageTableKind::Dense:
+            return true;
+        case PageTableKind::Hash:
+            return false;
+        default:
+            return this->num_virtual_pages <= max_auto_dense_page_table_pages;
+        }
+    }
+
+    std::string DefaultPipeline::annotate(const std::string& prog_file, bool dense_page_tables) {
         this->progress_bar.set_label("Annotations Pass");
         std::string ann_file = this->program_name + ".ann";
-        annotate_program(ann_file, prog_file, this->page_shift, &this->progress_bar);
+        annotate_program(ann_file, prog_file, this->page_shift, &this->progress_bar, dense_page_tables, this->annotation_threads);
         this->progress_bar.finish();
         if (this->verbose) {
-            std::cout << "Computed annotations" << std::endl;
+            std::cout << "Computed annotations (" << (dense_page_tables ? "dense" : "hash") << " page tables)" << std::endl;
         }
+        return ann_file;
+    }
 
-        this->progress_bar.set_label("Replacement Pass");
-        BeladyAllocator allocator(repprog_file, prog_file, ann_file, this->num_pages, this->page_shift);
-        allocator.allocate(&this->progress_bar);
-        this->progress_bar.finish();
+    void DefaultPipeline::record_replacement_stats(const BeladyAllocator& allocator) {
         this->stats.num_swapouts = allocator.get_num_swapouts();
         this->stats.num_swapins = allocator.get_num_swapins();
+        this->stats.num_storage_frames = allocator.get_num_storage_frames();
+        this->stats.num_receive_barriers = allocator.get_num_receive_barriers();
+        this->stats.num_receive_barriers_avoided = allocator.get_num_receive_barriers_avoided();
         if (this->verbose) {
-            std::cout << "Finished replacement stage: " << allocator.get_num_swapouts() << " swapouts, " << allocator.get_num_swapins() << " swapins" << std::endl;
+            std::cout << "Finished replacement stage: " << allocator.get_num_swapouts() << " swapouts, " << allocator.get_num_swapins() << " swapins, " << allocator.get_num_receive_barriers() << " receive barriers (" << allocator.get_num_receive_barriers_avoided() << " avoided)" << std::endl;
         }
     }
 
-    void DefaultPipeline::schedule(const std::string& repprog_file, const std::string& memprog_file) {
-        this->progress_bar.set_label("Scheduling Pass");
-        BackdatingScheduler scheduler(repprog_file, memprog_file, this->prefetch_lookahead, this->prefetch_buffer_size);
-        scheduler.schedule(&this->progress_bar);
-        this->progress_bar.finish();
+    void DefaultPipeline::record_scheduling_stats(const BackdatingScheduler& scheduler) {
         this->stats.num_prefetch_alloc_failures = scheduler.get_num_allocation_failures();
         this->stats.num_synchronous_swapins = scheduler.get_num_synchronous_swapins();
+        this->stats.num_hoisted_receives = scheduler.get_num_hoisted_receives();
+        this->stats.num_deferred_finish_receives = scheduler.get_num_deferred_finish_receives();
         if (this->verbose) {
             std::cout << "Finished scheduling swaps: " << scheduler.get_num_allocation_failures() << " allocation failures, " << scheduler.get_num_synchronous_swapins() << " synchronous swapins" << std::endl;
+            std::cout << "Finished scheduling receives: " << scheduler.get_num_hoisted_receives() << " hoisted receives, " << scheduler.get_num_deferred_finish_receives() << " deferred receive barriers" << std::endl;
         }
     }
 
+    void DefaultPipeline::allocate(const std::string& prog_file, const std::string& repprog_file) {
+        bool dense_page_tables = this->use_dense_page_tables();
+        std::string ann_file = this->annotate(prog_file, dense_page_tables);
+
+        this->progress_bar.set_label("Replacement Pass");
+        BeladyAllocator allocator(repprog_file, prog_file, ann_file, this->num_pages, this->page_shift, this->receive_pin_window, dense_page_tables);
+        allocator.allocate(&this->progress_bar);
+        this->progress_bar.finish();
+        this->record_replacement_stats(allocator);
+    }
+
+    void DefaultPipeline::schedule(const std::string& repprog_file, const std::string& memprog_file) {
+        this->progress_bar.set_label("Scheduling Pass");
+        BackdatingScheduler scheduler(repprog_file, memprog_file, this->prefetch_lookahead, this->prefetch_buffer_size);
+        scheduler.set_output_format(this->memprog_format);
+        scheduler.schedule(&this->progress_bar);
+        this->progress_bar.finish();
+        this->record_scheduling_stats(scheduler);
+    }
+
+    void DefaultPipeline::allocate_and_schedule(const std::string& prog_file, const std::string& memprog_file) {
+        /* As in the non-streaming path, replacement time includes annotation. */
+        auto start = std::chrono::steady_clock::now();
+        bool dense_page_tables = this->use_dense_page_tables();
+        std::string ann_file = this->annotate(prog_file, dense_page_tables);
+
+        int pipe_fds[2];
+        platform::pipe_open(pipe_fds);
+
+        /*
+         * The physical bytecode has no header, since the pipe isn't seekable.
+         * The scheduler only needs an upper bound on the page frames used,
+         * which is the number of page frames given to the replacement stage.
+         */
+        ProgramFileHeader repprog_header = { 0 };
+        repprog_header.num_pages = this->num_pages;
+        repprog_header.page_shift = this->page_shift;
+
+        std::chrono::steady_clock::time_point replacement_end;
+        StoragePageNumber num_storage_frames;
+
+        this->progress_bar.set_label("Replacement and Scheduling Pass");
+        BackdatingScheduler scheduler(pipe_fds[0], repprog_header, memprog_file, this->prefetch_lookahead, this->prefetch_buffer_size);
+        scheduler.set_output_format(this->memprog_format);
+        std::thread replacement([&]() {
+            /* Destroying the allocator closes the pipe, ending the stream. */
+            BeladyAllocator allocator(pipe_fds[1], prog_file, ann_file, this->num_pages, this->page_shift, this->receive_pin_window, dense_page_tables);
+            allocator.allocate(&this->progress_bar);
+            replacement_end = std::chrono::steady_clock::now();
+            num_storage_frames = allocator.get_num_storage_frames();
+            this->record_replacement_stats(allocator);
+        });
+        scheduler.schedule();
+        replacement.join();
+        scheduler.set_swap_page_count(num_storage_frames);
+        this->progress_bar.finish();
+        this->record_scheduling_stats(scheduler);
+
+        auto end = std::chrono::steady_clock::now();
+        this->stats.replacement_duration = std::chrono::duration_cast<std::chrono::milliseconds>(replacement_end - start);
+        this->stats.scheduling_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - replacement_end);
+    }
+
     void DefaultPipeline::plan(Program<BinnedPlacer>** p, PlacementPlugin plugin, std::function<void()> program) {
         auto program_start = std::chrono::steady_clock::now();
+        if (this->lifetime_placement) {
+            this->profile_lifetimes(p, plugin, program);
+        }
         this->program(p, plugin, program, this->program_name + ".prog");
+        this->lifetime_profile.reset();
         auto program_end = std::chrono::steady_clock::now();
         this->stats.placement_duration = std::chrono::duration_cast<std::chrono::milliseconds>(program_end - program_start);
 
+        /*
+         * The constant folding, copy elision, and dead instruction
+         * elimination passes assume one wire per unit of the MAGE-virtual
+         * address space.
+         */
+        bool boolean_circuit = places_one_wire_per_unit(plugin);
+
+        std::string prog_file = this->program_name + ".prog";
+        if (this->constant_folding && boolean_circuit) {
+            auto folding_start = std::chrono::steady_clock::now();
+            prog_file = this->fold_public_constants(prog_file, this->program_name + ".folded.prog");
+            auto folding_end = std::chrono::steady_clock::now();
+            this->stats.constant_folding_duration = std::chrono::duration_cast<std::chrono::milliseconds>(folding_end - folding_start);
+        }
+        if (this->copy_elision && boolean_circuit) {
+            auto elision_start = std::chrono::steady_clock::now();
+            prog_file = this->elide_redundant_copies(prog_file, this->program_name + ".elided.prog");
+            auto elision_end = std::chrono::steady_clock::now();
+            this->stats.copy_elision_duration = std::chrono::duration_cast<std::chrono::milliseconds>(elision_end - elision_start);
+        }
+        if (this->dead_code_elimination && boolean_circuit) {
+            auto elimination_start = std::chrono::steady_clock::now();
+            prog_file = this->eliminate_dead_code(prog_file, this->program_name + ".live.prog");
+            auto elimination_end = std::chrono::steady_clock::now();
+            this->stats.dead_code_elimination_duration = std::chrono::duration_cast<std::chrono::milliseconds>(elimination_end - elimination_start);
+        }
+
+        if (this->stream_physical_bytecode) {
+            this->allocate_and_schedule(prog_file, this->program_name + ".memprog");
+            return;
+        }
+
         auto replacement_start = std::chrono::steady_clock::now();
-        this->allocate(this->program_name + ".prog", this->program_name + ".repprog");
+        this->allocate(prog_file, this->program_name + ".repprog");
         auto replacement_end = std::chrono::steady_clock::now();
         this->stats.replacement_duration = std::chrono::duration_cast<std::chrono::milliseconds>(replacement_end - replacement_start);
 
@@ -30,10 +30,17 @@
 #include <cstdint>
 #include <chrono>
 #include <functional>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 #include "memprog/annotation.hpp"
+#include "memprog/constfold.hpp"
+#include "memprog/copyelision.hpp"
 #include "memprog/placement.hpp"
+#include "memprog/program.hpp"
 #include "memprog/replacement.hpp"
+#include "memprog/scheduling.hpp"
 #include "util/config.hpp"
 #include "util/progress.hpp"
 
@@ -110,6 +117,27 @@ namespace mage::memprog {
         std::string program_name;
     };
 
+    /**
+     * @brief Representation of the page tables used by the planner.
+     */
+    enum class PageTableKind : std::uint8_t {
+        /**
+         * @brief Flat arrays if the program has few enough MAGE-virtual
+         * pages for them to fit comfortably in memory, otherwise hash tables.
+         */
+        Auto,
+
+        /**
+         * @brief Flat arrays indexed by MAGE-virtual page number.
+         */
+        Dense,
+
+        /**
+         * @brief Hash tables keyed by MAGE-virtual page number.
+         */
+        Hash
+    };
+
     /**
      * @brief Contains statistics collected by MAGE's planner.
      *
@@ -118,13 +146,29 @@ namespace mage::memprog {
      */
     struct DefaultPipelineStats {
         InstructionNumber num_instructions;
+        std::uint64_t num_coalesced_network_ops;
         std::uint64_t num_swapouts;
         std::uint64_t num_swapins;
         StoragePageNumber num_storage_frames;
+        std::uint64_t num_receive_barriers;
+        std::uint64_t num_receive_barriers_avoided;
         std::uint64_t num_prefetch_alloc_failures;
         std::uint64_t num_synchronous_swapins;
+        std::uint64_t num_hoisted_receives;
+        std::uint64_t num_deferred_finish_receives;
+        VirtPageNumber num_virtual_pages;
+        VirtPageNumber num_unhinted_virtual_pages;
+        VirtPageNumber peak_virtual_pages;
+        std::map<AllocationSize, VirtPageNumber> peak_pages_by_size;
+        std::vector<PlacementUtilizationSample> placement_utilization;
+        ConstantFoldingStats constant_folding;
+        CopyElisionStats copy_elision;
+        std::uint64_t num_dead_instructions;
 
         std::chrono::milliseconds placement_duration;
+        std::chrono::milliseconds constant_folding_duration;
+        std::chrono::milliseconds copy_elision_duration;
+        std::chrono::milliseconds dead_code_elimination_duration;
         std::chrono::milliseconds replacement_duration;
         std::chrono::milliseconds scheduling_duration;
     };
@@ -171,6 +215,53 @@ namespace mage::memprog {
          */
         virtual void program(Program<BinnedPlacer>** p, PlacementPlugin plugin, std::function<void()> dsl_program, const std::string& prog_file);
 
+        /**
+         * @brief Runs the constant folding pass on the output of the
+         * "Placement" stage. Invoked by the @p plan function if the pipeline
+         * is configured to fold constants.
+         *
+         * @param prog_file The name of the file containing the virtual
+         * bytecode (output of the "Placement" stage).
+         * @param folded_prog_file The name of the file to which to write the
+         * virtual bytecode with constants folded.
+         * @return The name of the file containing the virtual bytecode that
+         * the later stages should read: @p folded_prog_file, or @p prog_file
+         * if the program contains instructions that the pass does not
+         * support.
+         */
+        virtual std::string fold_public_constants(const std::string& prog_file, const std::string& folded_prog_file);
+
+        /**
+         * @brief Runs the copy elision pass on the virtual bytecode. Invoked
+         * by the @p plan function if the pipeline is configured to elide
+         * copies.
+         *
+         * @param prog_file The name of the file containing the virtual
+         * bytecode.
+         * @param elided_prog_file The name of the file to which to write the
+         * virtual bytecode with copies elided.
+         * @return The name of the file containing the virtual bytecode that
+         * the later stages should read: @p elided_prog_file, or @p prog_file
+         * if the program contains instructions that the pass does not
+         * support.
+         */
+        virtual std::string elide_redundant_copies(const std::string& prog_file, const std::string& elided_prog_file);
+
+        /**
+         * @brief Runs the dead instruction elimination pass on the output of
+         * the "Placement" stage. Invoked by the @p plan function if the
+         * pipeline is configured to eliminate dead instructions.
+         *
+         * @param prog_file The name of the file containing the virtual
+         * bytecode (output of the "Placement" stage).
+         * @param live_prog_file The name of the file to which to write the
+         * virtual bytecode without dead instructions.
+         * @return The name of the file containing the virtual bytecode that
+         * the later stages should read: @p live_prog_file, or @p prog_file if
+         * the program contains instructions that the pass does not support.
+         */
+        virtual std::string eliminate_dead_code(const std::string& prog_file, const std::string& live_prog_file);
+
         /**
          * @brief Runs the "Replacement" stage of the planning pipeline,
          * including the preceding reverse pass to annotate the proram. Invoked
@@ -200,6 +291,24 @@ namespace mage::memprog {
          */
         virtual void schedule(const std::string& repprog_file, const std::string& memprog_file);
 
+        /**
+         * @brief Runs the "Replacement" and "Scheduling" stages of the
+         * planning pipeline concurrently, including the preceding reverse
+         * pass to annotate the program. Invoked by the @p plan function if
+         * the pipeline is configured to stream the physical bytecode.
+         *
+         * The replacement stage runs in a separate thread and writes the
+         * physical bytecode into a pipe, from which the scheduling stage
+         * reads it, so the physical bytecode is never written to a file.
+         *
+         * @param prog_file The name of the file containing the virtual
+         * bytecode (output of the "Placement" stage), which is read as input
+         * in this stage.
+         * @param memprog_file The name of the file to which to write the
+         * output of the "Scheduling" stage (the final memory program).
+         */
+        virtual void allocate_and_schedule(const std::string& prog_file, const std::string& memprog_file);
+
         void plan(Program<BinnedPlacer>** p, PlacementPlugin plugin, std::function<void()> program) override;
 
         /**
@@ -211,10 +320,61 @@ namespace mage::memprog {
         const DefaultPipelineStats& get_stats() const;
 
     private:
+        /**
+         * @brief Runs the DSL program once without lifetime hints, discarding
+         * the virtual bytecode, to record in @p lifetime_profile which
+         * allocations are deallocated.
+         */
+        void profile_lifetimes(Program<BinnedPlacer>** p, PlacementPlugin plugin, std::function<void()> dsl_program);
+
+        /**
+         * @brief Copies utilization statistics from the placement stage into
+         * @p stats, writes the sampled utilization to a file if configured
+         * to, and prints out the peak footprint if verbose.
+         */
+        void record_placement_stats(Program<BinnedPlacer>& program);
+
+        /**
+         * @brief Decides whether the planner's page tables should be flat
+         * arrays, based on the configuration and the number of MAGE-virtual
+         * pages in the program.
+         */
+        bool use_dense_page_tables() const;
+
+        /**
+         * @brief Runs the reverse pass to annotate the program, returning the
+         * name of the file containing the annotations.
+         */
+        std::string annotate(const std::string& prog_file, bool dense_page_tables);
+
+        /**
+         * @brief Copies statistics from the replacement stage into
+         * @p stats, and prints them out if verbose.
+         */
+        void record_replacement_stats(const BeladyAllocator& allocator);
+
+        /**
+         * @brief Copies statistics from the scheduling stage into
+         * @p stats, and prints them out if verbose.
+         */
+        void record_scheduling_stats(const BackdatingScheduler& scheduler);
+
         PageShift page_shift;
         VirtPageNumber num_pages;
         VirtPageNumber prefetch_buffer_size;
         InstructionNumber prefetch_lookahead;
+        InstructionNumber receive_pin_window;
+        PageTableKind page_tables;
+        unsigned int annotation_threads;
+        bool stream_physical_bytecode;
+        ProgramFormat memprog_format;
+        bool lifetime_placement;
+        InstructionNumber placement_stats_interval;
+        bool constant_folding;
+        bool copy_elision;
+        bool dead_code_elimination;
+        VirtPageNumber num_virtual_pages;
+        std::unique_ptr<LifetimeProfile> lifetime_profile;
 
         DefaultPipelineStats stats;
         util::ProgressBar progress_bar;
@@ -32,7 +32,9 @@
 
 #include <cassert>
 #include <cstdint>
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
@@ -102,6 +104,24 @@ namespace mage::memprog {
         }
     };
 
+    /**
+     * @brief Describes how much of the MAGE-virtual address space a placement
+     * module is using at some point in time.
+     */
+    struct PlacementUtilization {
+        /**
+         * @brief Bytes of MAGE-virtual memory occupied by variables that have
+         * been placed and not yet deallocated.
+         */
+        std::uint64_t live_bytes;
+
+        /**
+         * @brief Number of MAGE-virtual pages that the placement module is
+         * currently using to hold variables.
+         */
+        VirtPageNumber allocated_pages;
+    };
+
     /**
      * @brief Abstract class for a Placement module in MAGE's planner.
      */
@@ -135,6 +155,14 @@ namespace mage::memprog {
          * @return The number of pages used in the MAGE-virtual address space.
          */
         virtual VirtPageNumber get_num_pages() const = 0;
+
+        /**
+         * @brief Returns how much of the MAGE-virtual address space is in use
+         * right now, as opposed to the total number of pages ever used.
+         *
+         * @return The current utilization of the MAGE-virtual address space.
+         */
+        virtual PlacementUtilization get_utilization() const = 0;
     };
 
     /**
@@ -147,7 +175,7 @@ namespace mage::memprog {
          *
          * @param shift Base-2 logarithm of the page size.
          */
-        SimplePlacer(PageShift shift) : next_free_address(0), page_shift(shift) {
+        SimplePlacer(PageShift shift) : next_free_address(0), page_shift(shift), live_bytes(0) {
         }
 
         VirtAddr allocate_virtual(AllocationSize width, bool& fresh_page) {
@@ -159,6 +187,7 @@ namespace mage::memprog {
                 addr = pg_next(this->next_free_address, this->page_shift);
             }
             this->next_free_address = addr + width;
+            this->live_bytes += width;
             fresh_page = (pg_offset(addr, this->page_shift) == 0);
             return addr;
         }
@@ -175,9 +204,17 @@ namespace mage::memprog {
             return num_pages;
         }
 
+        PlacementUtilization get_utilization() const {
+            PlacementUtilization utilization;
+            utilization.live_bytes = this->live_bytes;
+            utilization.allocated_pages = pg_num(this->next_free_address + pg_size(this->page_shift) - 1, this->page_shift);
+            return utilization;
+        }
+
     private:
         VirtAddr next_free_address;
         PageShift page_shift;
+        std::uint64_t live_bytes;
     };
 
     /**
@@ -191,7 +228,7 @@ namespace mage::memprog {
          *
          * @param shift Base-2 logarithm of the page size.
          */
-        FIFOPlacer(PageShift shift) : next_page(0), page_shift(shift) {
+        FIFOPlacer(PageShift shift) : next_page(0), page_shift(shift), live_bytes(0) {
         }
 
         VirtAddr allocate_virtual(AllocationSize width, bool& fresh_page) {
@@ -215,6 +252,7 @@ namespace mage::memprog {
 
             assert(!this->allocated.contains(result));
             this->allocated.insert(result);
+            this->live_bytes += width;
 
             return result;
         }
@@ -223,17 +261,79 @@ namespace mage::memprog {
             assert(this->allocated.contains(addr));
             this->allocated.erase(addr);
             this->slot_map[width].push_back(addr);
+            this->live_bytes -= width;
         }
 
         VirtPageNumber get_num_pages() const {
             return this->next_page;
         }
 
+        PlacementUtilization get_utilization() const {
+            /* Pages are never freed, only slots within them. */
+            PlacementUtilization utilization;
+            utilization.live_bytes = this->live_bytes;
+            utilization.allocated_pages = this->next_page;
+            return utilization;
+        }
+
     private:
         std::unordered_map<AllocationSize, std::vector<VirtAddr>> slot_map;
         std::unordered_set<VirtAddr> allocated;
         VirtPageNumber next_page;
         PageShift page_shift;
+        std::uint64_t live_bytes;
+    };
+
+    /**
+     * @brief Records which allocations made by a placer live until the end of
+     * the program, so that a later placement of the same program can keep
+     * them apart from allocations that die along the way.
+     *
+     * DSL programs make the same sequence of allocations and deallocations
+     * each time they are run, so the n-th allocation of a later run
+     * corresponds to the n-th allocation of the recorded run.
+     */
+    class LifetimeProfile {
+    public:
+        /**
+         * @brief Records that an allocation was made at the specified
+         * address.
+         *
+         * @param addr The address of the allocation.
+         */
+        void record_allocation(VirtAddr addr) {
+            this->live_allocations[addr] = this->immortal.size();
+            this->immortal.push_back(true);
+        }
+
+        /**
+         * @brief Records that the allocation at the specified address was
+         * deallocated.
+         *
+         * @param addr The address of the allocation.
+         */
+        void record_deallocation(VirtAddr addr) {
+            auto iter = this->live_allocations.find(addr);
+            assert(iter != this->live_allocations.end());
+            this->immortal[iter->second] = false;
+            this->live_allocations.erase(iter);
+        }
+
+        /**
+         * @brief Checks if the specified allocation was never deallocated.
+         *
+         * @param allocation The index of the allocation in the sequence of
+         * allocations made by the program.
+         * @return True if the allocation was made and never deallocated,
+         * otherwise false.
+         */
+        bool is_immortal(std::uint64_t allocation) const {
+            return allocation < this->immortal.size() && this->immortal[allocation];
+        }
+
+    private:
+        std::vector<bool> immortal;
+        std::unordered_map<VirtAddr, std::uint64_t> live_allocations;
     };
 
     /**
@@ -282,6 +382,12 @@ namespace mage::memprog {
      * In addition to the equal-width heuristic used by the @p FIFOPlacer, it
      * aims to reduce fragmentation by trying to avoid keeping pages only
      * partially filled.
+     *
+     * Optionally, it can use lifetime hints from a @p LifetimeProfile of the
+     * same program. Then, allocations that are never deallocated (e.g., the
+     * program's inputs and outputs) get their own pages, instead of pinning
+     * pages whose other contents die early, and pages emptied by the
+     * remaining allocations are handed out again instead of new ones.
      */
     class BinnedPlacer {
     public:
@@ -290,21 +396,63 @@ namespace mage::memprog {
          *
          * @param shift Base-2 logarithm of the page size.
          */
-        BinnedPlacer(PageShift shift) : next_page(0), page_shift(shift) {
+        BinnedPlacer(PageShift shift) : next_page(0), page_shift(shift), live_bytes(0), allocated_pages(0), peak_allocated_pages(0), num_allocations(0), recording(nullptr), hints(nullptr) {
+        }
+
+        /**
+         * @brief Records which allocations are deallocated in the specified
+         * profile.
+         *
+         * @pre No allocations have been made yet.
+         *
+         * @param profile The profile in which to record lifetimes.
+         */
+        void record_lifetimes(LifetimeProfile* profile) {
+            assert(this->num_allocations == 0);
+            this->recording = profile;
+        }
+
+        /**
+         * @brief Places allocations that the specified profile marks as
+         * immortal on separate pages, and reuses emptied pages.
+         *
+         * @pre No allocations have been made yet.
+         *
+         * @param profile A profile recorded by placing the same program,
+         * which must remain valid as long as this placer is used.
+         */
+        void use_lifetime_hints(const LifetimeProfile* profile) {
+            assert(this->num_allocations == 0);
+            this->hints = profile;
         }
 
         VirtAddr allocate_virtual(AllocationSize width, bool& fresh_page) {
-            AllocationSizeInfo& bwi = this->get_info(width);
+            bool immortal = false;
+            if (this->hints != nullptr) {
+                immortal = this->hints->is_immortal(this->num_allocations);
+            }
+            this->num_allocations++;
+            AllocationSizeInfo& bwi = this->get_info(width, immortal);
 
             VirtAddr result;
             if (bwi.unfilled_pages.empty()) {
-                VirtPageNumber page = this->next_page++;
+                VirtPageNumber page;
+                if (this->empty_pages.empty()) {
+                    page = this->next_page++;
+                } else {
+                    page = this->empty_pages.back();
+                    this->empty_pages.pop_back();
+                }
+                fresh_page = true;
                 VirtAddr page_addr = pg_addr(page, this->page_shift);
 
                 PageInfo& page_info = bwi.page_info[page];
                 page_info.next_free_offset = width;
                 result = page_addr;
-                fresh_page = true;
+                if (immortal) {
+                    this->immortal_pages.insert(page);
+                }
+                this->acquire_page(width);
 
                 // std::vector<VirtAddr>& free_slots = bwi.free_slots_by_page[page];
                 // free_slots.reserve(pg_size(this->page_shift) / width);
@@ -344,18 +492,27 @@ namespace mage::memprog {
                 }
             }
 
+            if (this->recording != nullptr) {
+                this->recording->record_allocation(result);
+            }
+            this->live_bytes += width;
             return result;
         }
 
         void deallocate_virtual(VirtAddr addr, AllocationSize width) {
-            AllocationSizeInfo& bwi = this->get_info(width);
+            if (this->recording != nullptr) {
+                this->recording->record_deallocation(addr);
+            }
             VirtPageNumber page = pg_num(addr, this->page_shift);
+            bool immortal = this->hints != nullptr && this->immortal_pages.contains(page);
+            AllocationSizeInfo& bwi = this->get_info(width, immortal);
+            this->live_bytes -= width;
 
             std::uint64_t num_free_slots;
             if (!bwi.unfilled_pages.contains(page)) {
                 num_free_slots = 1;
                 if (num_free_slots == bwi.fresh_page_free_slots && bwi.unfilled_pages.size() > 0) {
-                    bwi.page_info.erase(page);
+                    this->release_page(bwi, width, page);
                 } else {
                     bwi.unfilled_pages.insert(num_free_slots, page);
                     bwi.page_info[page].reusable_slots.push_back(addr);
@@ -389,7 +546,7 @@ namespace mage::memprog {
              */
             if (num_free_slots == bwi.fresh_page_free_slots && bwi.unfilled_pages.size() > 1) {
                 bwi.unfilled_pages.erase(page);
-                bwi.page_info.erase(page);
+                this->release_page(bwi, width, page);
             } else {
                 bwi.unfilled_pages.increase_key(num_free_slots, page);
                 bwi.page_info[page].reusable_slots.push_back(addr);
@@ -400,24 +557,110 @@ namespace mage::memprog {
             return this->next_page;
         }
 
+        PlacementUtilization get_utilization() const {
+            PlacementUtilization utilization;
+            utilization.live_bytes = this->live_bytes;
+            utilization.allocated_pages = this->allocated_pages;
+            return utilization;
+        }
+
+        /**
+         * @brief Returns the largest number of MAGE-virtual pages that this
+         * placer has used at once (the peak virtual footprint).
+         *
+         * @return The peak number of pages in use.
+         */
+        VirtPageNumber get_peak_allocated_pages() const {
+            return this->peak_allocated_pages;
+        }
+
+        /**
+         * @brief Returns, for each allocation size, the largest number of
+         * MAGE-virtual pages that this placer has used at once to hold
+         * allocations of that size.
+         *
+         * @return A map from each allocation size to its peak number of
+         * pages.
+         */
+        std::map<AllocationSize, VirtPageNumber> get_peak_pages_by_size() const {
+            std::map<AllocationSize, VirtPageNumber> peaks;
+            for (const auto& [width, count] : this->pages_by_size) {
+                peaks[width] = count.peak;
+            }
+            return peaks;
+        }
+
     private:
+        /**
+         * @brief Current and peak number of pages used for allocations of
+         * some size.
+         */
+        struct PageCount {
+            VirtPageNumber current = 0;
+            VirtPageNumber peak = 0;
+        };
+
+        /**
+         * @brief Accounts for a page taken into use for allocations of the
+         * specified size.
+         */
+        void acquire_page(AllocationSize width) {
+            this->allocated_pages++;
+            this->peak_allocated_pages = std::max(this->peak_allocated_pages, this->allocated_pages);
+            PageCount& count = this->pages_by_size[width];
+            count.current++;
+            count.peak = std::max(count.peak, count.current);
+        }
+
+        /**
+         * @brief Forgets about a MAGE-virtual page once all allocations in it
+         * are deallocated.
+         *
+         * With lifetime hints, the page is kept to serve as a fresh page for
+         * any allocation width. Reusing it is still reported as the page's
+         * first use, so later stages know that its old contents are dead.
+         */
+        void release_page(AllocationSizeInfo& bwi, AllocationSize width, VirtPageNumber page) {
+            bwi.page_info.erase(page);
+            this->allocated_pages--;
+            this->pages_by_size[width].current--;
+            if (this->hints != nullptr) {
+                this->immortal_pages.erase(page);
+                this->empty_pages.push_back(page);
+            }
+        }
+
         /**
          * @brief Obtains a reference to the @p AllocationSizeInfo object for a
-         * given allocation size, creating the @p AllocationSizeInfo object for
-         * that size if it does not yet exist.
+         * given allocation size and lifetime, creating the
+         * @p AllocationSizeInfo object for them if it does not yet exist.
          */
-        AllocationSizeInfo& get_info(AllocationSize width) {
-            auto iter = this->slot_map.find(width);
+        AllocationSizeInfo& get_info(AllocationSize width, bool immortal) {
+            AllocationSize key = (width << 1) | (immortal ? 1 : 0);
+            auto iter = this->slot_map.find(key);
             if (iter != this->slot_map.end()) {
                 return iter->second;
             }
-            auto p = this->slot_map.try_emplace(width, this->page_shift, width);
+            auto p = this->slot_map.try_emplace(key, this->page_shift, width);
             return p.first->second;
         }
 
         std::unordered_map<AllocationSize, AllocationSizeInfo> slot_map;
         VirtPageNumber next_page;
         PageShift page_shift;
+
+        /* Utilization statistics. */
+        std::uint64_t live_bytes;
+        VirtPageNumber allocated_pages;
+        VirtPageNumber peak_allocated_pages;
+        std::unordered_map<AllocationSize, PageCount> pages_by_size;
+
+        /* Lifetime hints (see LifetimeProfile). */
+        std::uint64_t num_allocations;
+        LifetimeProfile* recording;
+        const LifetimeProfile* hints;
+        std::unordered_set<VirtPageNumber> immortal_pages;
+        std::vector<VirtPageNumber> empty_pages;
     };
 }
 
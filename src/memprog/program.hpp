@@ -34,6 +34,7 @@
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
+#include <limits>
 #include <memory>
 #include <vector>
 #include "addr.hpp"
@@ -43,6 +44,15 @@
 #include "programfile.hpp"
 
 namespace mage::memprog {
+    /**
+     * @brief Utilization of the MAGE-virtual address space, sampled by a
+     * @p Program when it emits a particular instruction.
+     */
+    struct PlacementUtilizationSample {
+        InstructionNumber instruction;
+        PlacementUtilization utilization;
+    };
+
     /**
      * @brief Used by DSLs to emit virtual bytecode instructions and interact
      * with MAGE's planner's placement module as they execute.
@@ -62,13 +72,14 @@ namespace mage::memprog {
          * @param prot Plugin with sizing information specific to the target
          * protocol, used for placement.
          */
-        Program(std::string filename, PageShift shift, PlacementPlugin prot) : VirtProgramFileWriter(filename, shift), placer(shift), protocol(prot) {
+        Program(std::string filename, PageShift shift, PlacementPlugin prot) : VirtProgramFileWriter(filename, shift), placer(shift), protocol(prot), page_shift(shift), num_coalesced(0), utilization_interval(0), next_utilization_sample(0) {
         }
 
         /**
          * @brief Destructor.
          */
         ~Program() {
+            this->flush_network_batch();
             this->set_page_count(this->placer.get_num_pages());
             if (Program<Placer>::current_working_program == this) {
                 Program<Placer>::current_working_program = nullptr;
@@ -104,6 +115,10 @@ namespace mage::memprog {
          * @return The address of the instruction's output field.
          */
         VirtAddr commit_instruction(memprog::AllocationSize output_width) {
+            if (this->utilization_interval != 0 && this->num_instructions() >= this->next_utilization_sample) {
+                this->utilization_samples.push_back({ this->num_instructions(), this->placer.get_utilization() });
+                this->next_utilization_sample = this->num_instructions() + this->utilization_interval;
+            }
             if (output_width != 0) {
                 bool fresh_page;
                 this->current.header.output = this->placer.allocate_virtual(output_width, fresh_page);
@@ -112,7 +127,7 @@ namespace mage::memprog {
                 }
             }
             assert(this->current.header.output != invalid_vaddr);
-            this->append_instruction(this->current);
+            this->emit_instruction(this->current);
             return this->current.header.output;
         }
 
@@ -139,7 +154,7 @@ namespace mage::memprog {
             instr.header.operation = OpCode::NetworkFinishSend;
             instr.header.flags = 0;
             instr.control.data = to;
-            this->append_instruction(instr);
+            this->emit_instruction(instr);
         }
 
         /**
@@ -154,7 +169,7 @@ namespace mage::memprog {
             instr.header.operation = OpCode::NetworkFinishReceive;
             instr.header.flags = 0;
             instr.control.data = from;
-            this->append_instruction(instr);
+            this->emit_instruction(instr);
         }
 
         /**
@@ -166,7 +181,7 @@ namespace mage::memprog {
             instr.header.operation = OpCode::PrintStats;
             instr.header.flags = 0;
             instr.control.data = 0;
-            this->append_instruction(instr);
+            this->emit_instruction(instr);
         }
 
         /**
@@ -178,7 +193,7 @@ namespace mage::memprog {
             instr.header.operation = OpCode::StartTimer;
             instr.header.flags = 0;
             instr.control.data = 0;
-            this->append_instruction(instr);
+            this->emit_instruction(instr);
         }
 
         /**
@@ -190,7 +205,73 @@ namespace mage::memprog {
             instr.header.operation = OpCode::StopTimer;
             instr.header.flags = 0;
             instr.control.data = 0;
-            this->append_instruction(instr);
+            this->emit_instruction(instr);
+        }
+
+        /**
+         * @brief Writes out any network instructions held back so that
+         * subsequent ones could be merged into them.
+         *
+         * This happens automatically whenever a non-network instruction is
+         * emitted and when this Program is destroyed; calling it explicitly
+         * is only needed to get an accurate instruction count before then.
+         */
+        void flush_network_batch() {
+            for (const Instruction& batched : this->network_batch) {
+                this->append_instruction(batched);
+            }
+            this->network_batch.clear();
+        }
+
+        /**
+         * @brief Obtains the number of network instructions that were merged
+         * into an adjacent network instruction instead of being emitted.
+         *
+         * @return The number of network instructions saved by coalescing.
+         */
+        std::uint64_t get_num_coalesced_network_ops() const {
+            return this->num_coalesced;
+        }
+
+        /**
+         * @brief Starts recording the utilization of the MAGE-virtual address
+         * space, roughly every @p interval instructions.
+         *
+         * @param interval The number of instructions between samples.
+         */
+        void sample_utilization(InstructionNumber interval) {
+            this->utilization_interval = interval;
+            this->next_utilization_sample = this->num_instructions();
+        }
+
+        /**
+         * @brief Obtains the utilization samples recorded so far (see
+         * @p sample_utilization).
+         *
+         * @return The samples, in order of instruction number.
+         */
+        const std::vector<PlacementUtilizationSample>& get_utilization_samples() const {
+            return this->utilization_samples;
+        }
+
+        /**
+         * @brief Obtains the placement module used to place data in the
+         * MAGE-virtual address space.
+         *
+         * @return A reference to the placement module.
+         */
+        Placer& get_placer() {
+            return this->placer;
+        }
+
+        /**
+         * @brief Obtains the number of MAGE-virtual pages allocated by the
+         * placer so far.
+         *
+         * @return The number of MAGE-virtual pages allocated so far.
+         */
+        VirtPageNumber num_pages() const {
+            return this->placer.get_num_pages();
         }
 
         /**
@@ -229,9 +310,83 @@ namespace mage::memprog {
         }
 
     private:
+        /**
+         * @brief Determines if the specified instruction may be coalesced with
+         * adjacent network instructions of the same kind.
+         *
+         * The width of a network instruction is only additive if each unit of
+         * width takes one unit of MAGE-virtual address space (as it does for
+         * bit-level protocols); otherwise, merging two instructions would not
+         * describe the same bytes.
+         */
+        bool is_coalescable(const Instruction& instr) const {
+            if (instr.header.operation != OpCode::NetworkBufferSend && instr.header.operation != OpCode::NetworkPostReceive) {
+                return false;
+            }
+            return this->get_physical_width(instr.header.width, PlaceableType::Ciphertext) == instr.header.width;
+        }
+
+        /**
+         * @brief Emits an instruction to the virtual bytecode, coalescing
+         * network sends (and receives) to the same worker from contiguous
+         * memory into a single instruction.
+         *
+         * Network instructions are held back as long as only network
+         * instructions follow them. Each new one is merged into the pending
+         * instruction of the same kind for the same worker if it starts right
+         * where that one ends, it has the same flags, and the merged range
+         * does not cross a page boundary (so later stages still see one page
+         * per network instruction). Held-back instructions may be reordered
+         * relative to each other if they are for different workers or are of
+         * different kinds, since they then use different streams, unless the
+         * memory they access overlaps. Instructions of the same kind for the
+         * same worker are never reordered.
+         *
+         * @param instr The instruction to emit.
+         */
+        void emit_instruction(const Instruction& instr) {
+            if (!this->is_coalescable(instr)) {
+                this->flush_network_batch();
+                this->append_instruction(instr);
+                return;
+            }
+            VirtAddr start = instr.header.output;
+            VirtAddr end = start + instr.header.width;
+            for (const Instruction& pending : this->network_batch) {
+                if (pending.header.operation != instr.header.operation && start < pending.header.output + pending.header.width && pending.header.output < end) {
+                    this->flush_network_batch();
+                    break;
+                }
+            }
+            for (Instruction& pending : this->network_batch) {
+                if (pending.header.operation != instr.header.operation || pending.constant.constant != instr.constant.constant) {
+                    continue;
+                }
+                VirtAddr pending_end = pending.header.output + pending.header.width;
+                if (start == pending_end && (instr.header.flags & FlagOutputPageFirstUse) == 0
+                    && (pending.header.flags & ~FlagOutputPageFirstUse) == instr.header.flags
+                    && pg_num(pending.header.output, this->page_shift) == pg_num(end - 1, this->page_shift)
+                    && pending.header.width + instr.header.width <= std::numeric_limits<BitWidth>::max()) {
+                    pending.header.width += instr.header.width;
+                    this->num_coalesced++;
+                    return;
+                }
+                /* Keep instructions of the same kind for the same worker in order. */
+                this->flush_network_batch();
+                break;
+            }
+            this->network_batch.push_back(instr);
+        }
+
         Instruction current;
         Placer placer;
         PlacementPlugin protocol;
+        PageShift page_shift;
+        std::vector<Instruction> network_batch;
+        std::uint64_t num_coalesced;
+        InstructionNumber utilization_interval;
+        InstructionNumber next_utilization_sample;
+        std::vector<PlacementUtilizationSample> utilization_samples;
         static Program<Placer>* current_working_program;
     };
 
@@ -30,7 +30,16 @@
 
 namespace mage::memprog {
     Allocator::Allocator(std::string output_file, PhysPageNumber num_page_frames, PageShift shift)
-        : next_storage_frame(0), pages_end(0), page_shift(shift), num_swapouts(0), num_swapins(0), phys_prog(output_file, 0, num_page_frames) {
+        : next_storage_frame(0), pages_end(0), page_shift(shift), num_swapouts(0), num_swapins(0), phys_prog(output_file, 0, num_page_frames), num_receive_barriers(0) {
+        this->init_page_frames(num_page_frames);
+    }
+
+    Allocator::Allocator(int output_fd, PhysPageNumber num_page_frames, PageShift shift)
+        : next_storage_frame(0), pages_end(0), page_shift(shift), num_swapouts(0), num_swapins(0), phys_prog(output_fd), num_receive_barriers(0) {
+        this->init_page_frames(num_page_frames);
+    }
+
+    void Allocator::init_page_frames(PhysPageNumber num_page_frames) {
         this->free_page_frames.reserve(num_page_frames);
         PhysPageNumber curr = num_page_frames;
         do {
@@ -60,6 +69,10 @@ namespace mage::memprog {
         return this->next_storage_frame;
     }
 
+    std::uint64_t Allocator::get_num_receive_barriers() const {
+        return this->num_receive_barriers;
+    }
+
     void Allocator::emit_swapout(PhysPageNumber primary, StoragePageNumber secondary) {
         /*
          * Before swapping out this page, make sure to finish any outstanding
@@ -95,7 +108,11 @@ namespace mage::memprog {
                 phys.header.flags = 0;
                 phys.control.data = i;
                 this->phys_prog.finish_instruction(control_length);
+                for (PhysPageNumber ppn : pending) {
+                    this->pending_receive_times.erase(ppn);
+                }
                 pending.clear();
+                this->num_receive_barriers++;
             }
         }
 
@@ -124,21 +141,27 @@ namespace mage::memprog {
         this->num_swapins++;
     }
 
-    void Allocator::update_network_state(const PackedPhysInstruction& phys) {
+    void Allocator::update_network_state(const PackedPhysInstruction& phys, InstructionNumber i) {
         WorkerID other;
         switch (phys.header.operation) {
-        case OpCode::NetworkPostReceive:
+        case OpCode::NetworkPostReceive: {
             other = phys.constant.constant;
             if (other + 1 > this->pending_receive_ops.size()) {
                 this->pending_receive_ops.resize(other + 1);
             }
-            this->pending_receive_ops[other].insert(pg_num(phys.constant.output, this->page_shift));
+            PhysPageNumber ppn = pg_num(phys.constant.output, this->page_shift);
+            this->pending_receive_ops[other].insert(ppn);
+            this->pending_receive_times[ppn] = i;
             break;
+        }
         case OpCode::NetworkFinishReceive:
             other = phys.control.data;
             if (other + 1 > this->pending_receive_ops.size()) {
                 this->pending_receive_ops.resize(other + 1);
             }
+            for (PhysPageNumber ppn : this->pending_receive_ops[other]) {
+                this->pending_receive_times.erase(ppn);
+            }
             this->pending_receive_ops[other].clear();
             break;
         case OpCode::NetworkBufferSend:
@@ -160,9 +183,69 @@ namespace mage::memprog {
         }
     }
 
-    BeladyAllocator::BeladyAllocator(std::string output_file, std::string virtual_program_file, std::string annotations_file, PhysPageNumber num_page_frames, PageShift shift)
-        : Allocator(output_file, num_page_frames, shift), virt_prog(virtual_program_file.c_str()), annotations(annotations_file.c_str()) {
+    bool Allocator::receive_pinned(PhysPageNumber ppn, InstructionNumber i, InstructionNumber window) const {
+        auto iter = this->pending_receive_times.find(ppn);
+        return iter != this->pending_receive_times.end() && i - iter->second < window;
+    }
+
+    BeladyAllocator::BeladyAllocator(std::string output_file, std::string virtual_program_file, std::string annotations_file, PhysPageNumber num_page_frames, PageShift shift, InstructionNumber receive_pin_window, bool dense_page_tables)
+        : Allocator(output_file, num_page_frames, shift), virt_prog(virtual_program_file.c_str()), annotations(annotations_file), receive_pin_window(receive_pin_window), num_receive_barriers_avoided(0) {
+        this->init_page_tables(dense_page_tables);
+    }
+
+    BeladyAllocator::BeladyAllocator(int output_fd, std::string virtual_program_file, std::string annotations_file, PhysPageNumber num_page_frames, PageShift shift, InstructionNumber receive_pin_window, bool dense_page_tables)
+        : Allocator(output_fd, num_page_frames, shift), virt_prog(virtual_program_file.c_str()), annotations(annotations_file), receive_pin_window(receive_pin_window), num_receive_barriers_avoided(0) {
+        this->init_page_tables(dense_page_tables);
+    }
+
+    void BeladyAllocator::init_page_tables(bool dense_page_tables) {
         this->set_page_shift(this->virt_prog.get_header().page_shift);
+        if (dense_page_tables) {
+            VirtPageNumber num_pages = this->virt_prog.get_header().num_pages;
+            this->page_table.make_dense(num_pages);
+            this->next_use_heap.make_dense(num_pages);
+        }
+    }
+
+    std::uint64_t BeladyAllocator::get_num_receive_barriers_avoided() const {
+        return this->num_receive_barriers_avoided;
+    }
+
+    std::pair<BeladyScore, VirtPageNumber> BeladyAllocator::remove_eviction_candidate(InstructionNumber i) {
+        std::pair<BeladyScore, VirtPageNumber> pair = this->next_use_heap.remove_min();
+        if (this->receive_pin_window == 0) {
+            return pair;
+        }
+
+        /*
+         * Set aside pinned candidates until we find one that isn't pinned.
+         * Pages used by the current instruction have i as their key, so we
+         * stop there rather than evict one of them.
+         */
+        while (true) {
+            const PageTableEntry& pte = this->page_table.at(pair.second);
+            if (!this->receive_pinned(pte.ppn, i, this->receive_pin_window)) {
+                if (!this->pinned_candidates.empty()) {
+                    this->num_receive_barriers_avoided++;
+                }
+                break;
+            }
+            this->pinned_candidates.push_back(pair);
+            if (this->next_use_heap.empty() || this->next_use_heap.min().first.get_usage_time() == i) {
+                /* Every candidate is pinned; fall back to the best one. */
+                pair = this->pinned_candidates.front();
+                this->pinned_candidates.front() = this->pinned_candidates.back();
+                this->pinned_candidates.pop_back();
+                break;
+            }
+            pair = this->next_use_heap.remove_min();
+        }
+
+        for (const std::pair<BeladyScore, VirtPageNumber>& pinned : this->pinned_candidates) {
+            this->next_use_heap.insert(pinned.first, pinned.second);
+        }
+        this->pinned_candidates.clear();
+        return pair;
     }
 
     void BeladyAllocator::allocate(util::ProgressBar* progress_bar) {
@@ -175,18 +258,20 @@ namespace mage::memprog {
             PackedVirtInstruction& current = this->virt_prog.start_instruction();
             OpInfo info(current.header.operation);
             std::uint8_t num_pages = current.store_page_numbers(vpns.data(), this->page_shift);
-            std::size_t ann_size;
-            Annotation& ann = this->annotations.read<Annotation>(ann_size);
-            assert(num_pages == ann.header.num_pages);
+            const Annotation& ann = this->annotations.read(num_pages);
             for (std::uint8_t j = 0; j != num_pages; j++) {
                 VirtPageNumber vpn = vpns[j];
                 bool dirties_page = (j == 0) && info.has_variable_output();
+                if (info.updates_in_place() && vpn == pg_num(current.two_args.input1, this->page_shift)) {
+                    /* The first input is written in place along with the output. */
+                    dirties_page = true;
+                }
 
-                auto iter = this->page_table.find(vpn);
-                if (iter != this->page_table.end() && iter->second.resident) {
+                PageTableEntry* entry = this->page_table.find(vpn);
+                if (entry != nullptr && entry->resident) {
                     /* Page is already resident; just use its current frame. */
                     just_swapped_in[j] = false;
-                    PageTableEntry& pte = iter->second;
+                    PageTableEntry& pte = *entry;
                     ppns[j] = pte.ppn;
                     pte.dirty |= dirties_page;
 
@@ -203,7 +288,7 @@ namespace mage::memprog {
                         if (pte.spn_allocated) {
                             this->free_storage_frame(pte.spn);
                         }
-                        this->page_table.erase(iter);
+                        this->page_table.erase(vpn);
                         this->next_use_heap.erase(vpn);
                     }
                 } else {
@@ -222,11 +307,9 @@ namespace mage::memprog {
                          * have i as their key, whereas all other VPNs in the
                          * heap will have some later instruction.
                          */
-                        std::pair<BeladyScore, VirtPageNumber> pair = this->next_use_heap.remove_min();
+                        std::pair<BeladyScore, VirtPageNumber> pair = this->remove_eviction_candidate(i);
                         VirtPageNumber evict_vpn = pair.second;
-                        auto k = this->page_table.find(evict_vpn);
-                        assert(k != this->page_table.end());
-                        PageTableEntry& evict_pte = k->second;
+                        PageTableEntry& evict_pte = this->page_table.at(evict_vpn);
                         assert(evict_pte.resident);
                         ppn = evict_pte.ppn;
                         assert(pair.first.get_usage_time() != invalid_instr);
@@ -242,7 +325,7 @@ namespace mage::memprog {
                     }
 
                     /* Now, swap the desired vpn into the page frame. */
-                    if (iter == this->page_table.end()) {
+                    if (entry == nullptr) {
                         /*
                          * First use of this VPN, so no need to swap it in.
                          * Just update the page table. If the page is never
@@ -256,9 +339,7 @@ namespace mage::memprog {
                             pte.spn_allocated = false;
                             pte.dirty = true; // we're guaranteed to be an output on first use
                             pte.ppn = ppn;
-                            auto rv = this->page_table.insert(std::make_pair(vpn, pte));
-                            assert(rv.second);
-                            iter = rv.first;
+                            this->page_table.insert(vpn, pte);
                         }
                     } else {
                         /* Swap the desired VPN into the page frame and update
@@ -266,12 +347,12 @@ namespace mage::memprog {
                          * remove the page table entry (see the comment above:
                          * "If page is never used again...").
                          */
-                        PageTableEntry& pte = iter->second;
+                        PageTableEntry& pte = *entry;
                         assert(!pte.resident);
                         assert(pte.spn_allocated);
                         this->emit_swapin(pte.spn, ppn);
                         if (ann.slots[j].next_use == invalid_instr) {
-                            this->page_table.erase(iter);
+                            this->page_table.erase(vpn);
                         } else {
                             pte.dirty |= dirties_page;
                             pte.resident = true;
@@ -287,24 +368,9 @@ namespace mage::memprog {
             phys.no_args.width = current.no_args.width;
             phys.header.flags = current.header.flags;
             phys.restore_page_numbers(current, ppns.data(), this->page_shift);
-            this->update_network_state(phys);
+            this->update_network_state(phys, i);
             this->phys_prog.finish_instruction(phys.size());
 
-            /*
-             * Possible optimization: try to avoid swapping out a page for which
-             * an asynchronous receive was recently issued. It's unclear if
-             * this would provide benefit; I'll need to do benchmarks first.
-             *
-             * The idea is that if we keep issuing async receives and
-             * immediately swapping out the page we're receiving into, we have
-             * to stall, waiting for the receive to finish, before swapping out
-             * the page. So perhaps the replacement should take async receives
-             * into account by marking the page as "pinned" or "busy" for a
-             * short time after the async receive is issued, to give the
-             * data some time to arrive, so we stall for less/no time waiting
-             * for it to arrive before swapping out the page.
-             */
-
             for (std::uint8_t j = 0; j != num_pages; j++) {
                 InstructionNumber next_use = ann.slots[j].next_use;
                 /*
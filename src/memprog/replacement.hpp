@@ -23,12 +23,17 @@
 #define MAGE_MEMPROG_REPLACEMENT_HPP_
 
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 #include "addr.hpp"
 #include "instruction.hpp"
 #include "memprog/annotation.hpp"
 #include "opcode.hpp"
 #include "platform/memory.hpp"
 #include "programfile.hpp"
+#include "util/pagemap.hpp"
 #include "util/prioqueue.hpp"
 
 /**
@@ -60,6 +65,21 @@ namespace mage::memprog {
          */
         Allocator(std::string output_file, PhysPageNumber num_page_frames, PageShift page_shift);
 
+        /**
+         * @brief Initializes an @p Allocator that computes replacement for
+         * the specified memory constraints and writes the resulting physical
+         * bytecode, without a metadata header, to the specified file
+         * descriptor (e.g., a pipe to the scheduling stage).
+         *
+         * The file descriptor is closed when the @p Allocator is destroyed.
+         *
+         * @param output_fd The file descriptor to which to write the physical
+         * bytecode.
+         * @param num_page_frames The number of physical pages available.
+         * @param page_shift Base-2 logarithm of the page size.
+         */
+        Allocator(int output_fd, PhysPageNumber num_page_frames, PageShift page_shift);
+
         /**
          * @brief Destructor.
          */
@@ -106,6 +126,15 @@ namespace mage::memprog {
          */
         StoragePageNumber get_num_storage_frames() const;
 
+        /**
+         * @brief Obtains the number of network barriers emitted before
+         * swapping out a page with an outstanding network receive.
+         *
+         * @return The number of "finish receive" instructions emitted by
+         * the replacement stage.
+         */
+        std::uint64_t get_num_receive_barriers() const;
+
     protected:
         /**
          * @brief Emits one or more instructions to the physical bytecode to
@@ -141,8 +170,25 @@ namespace mage::memprog {
          * operations initiated or completed by the specified instruction.
          *
          * @param phys A reference to the provided instruction.
+         * @param i The number (index) of the provided instruction.
          */
-        void update_network_state(const PackedPhysInstruction& phys);
+        void update_network_state(const PackedPhysInstruction& phys, InstructionNumber i);
+
+        /**
+         * @brief Checks if the specified page frame is the target of a
+         * network receive that is still outstanding and was posted fewer than
+         * @p window instructions before the specified instruction.
+         *
+         * Swapping out such a page would require a network barrier, which
+         * would likely stall until the data arrives.
+         *
+         * @param ppn The physical page number of the page frame to check.
+         * @param i The number (index) of the current instruction.
+         * @param window The number of instructions after a receive is posted
+         * for which its destination page frame is considered pinned.
+         * @return True if the page frame is pinned, otherwise false.
+         */
+        bool receive_pinned(PhysPageNumber ppn, InstructionNumber i, InstructionNumber window) const;
 
         /**
          * @brief Allocates a new page frame in storage to which a page can be
@@ -222,6 +268,8 @@ namespace mage::memprog {
         PageShift page_shift;
 
     private:
+        void init_page_frames(PhysPageNumber num_page_frames);
+
         std::vector<PhysPageNumber> free_page_frames;
         std::vector<StoragePageNumber> free_storage_frames;
         StoragePageNumber next_storage_frame;
@@ -235,9 +283,13 @@ namespace mage::memprog {
         std::vector<std::unordered_set<PhysPageNumber>> pending_receive_ops;
         std::vector<bool> buffered_send_ops;
 
+        /* Instruction at which the pending receive into each page was posted. */
+        std::unordered_map<PhysPageNumber, InstructionNumber> pending_receive_times;
+
         /* Keeps track of the number of swaps performed in the allocation. */
         std::uint64_t num_swapouts;
         std::uint64_t num_swapins;
+        std::uint64_t num_receive_barriers;
     };
 
     /**
@@ -319,6 +371,14 @@ namespace mage::memprog {
      *
      * This Replacement module uses Belady's theoretically-optimal paging
      * algorithm (MIN) to optimize for storage bandwidth.
+     *
+     * Optionally, it can also take asynchronous network receives into
+     * account. Evicting a page frame shortly after a receive into it was
+     * posted requires a network barrier, which stalls until the data arrives.
+     * With a nonzero receive pin window, such page frames are pinned for that
+     * many instructions after the receive is posted, and the best unpinned
+     * candidate is evicted instead. If every candidate is pinned, the best
+     * candidate overall is evicted, as in plain MIN.
      */
     class BeladyAllocator : public Allocator {
     public:
@@ -339,16 +399,76 @@ namespace mage::memprog {
          * next-use annotations for the virtual bytecode.
          * @param num_page_frames The number of physical pages available.
          * @param shift Base-2 logarithm of the page size.
+         * @param receive_pin_window The number of instructions for which a
+         * page frame is pinned after a network receive into it is posted, or
+         * zero to ignore network receives when choosing pages to evict.
+         * @param dense_page_tables If true, the page table and the locator of
+         * the heap of next uses are flat arrays indexed by virtual page
+         * number instead of hash tables. This is faster but uses memory
+         * proportional to the number of virtual pages in the program.
+         */
+        BeladyAllocator(std::string output_file, std::string virtual_program_file, std::string annotations_file, PhysPageNumber num_page_frames, PageShift shift, InstructionNumber receive_pin_window = 0, bool dense_page_tables = false);
+
+        /**
+         * @brief Creates a @p BeladyAllocator instance like the above, except
+         * that it writes the resulting physical bytecode, without a metadata
+         * header, to the specified file descriptor.
+         *
+         * This allows the scheduling stage to consume the physical bytecode
+         * as it is produced, for example via a pipe, without it ever being
+         * written to a file. The file descriptor is closed when the
+         * @p BeladyAllocator is destroyed.
+         *
+         * @param output_fd The file descriptor to which to write the
+         * resulting physical bytecode.
+         * @param virtual_program_file The name of the file from which to read
+         * the virtual bytecode.
+         * @param annotations_file The name of the file from which to read the
+         * next-use annotations for the virtual bytecode.
+         * @param num_page_frames The number of physical pages available.
+         * @param shift Base-2 logarithm of the page size.
+         * @param receive_pin_window The number of instructions for which a
+         * page frame is pinned after a network receive into it is posted.
+         * @param dense_page_tables If true, use flat arrays for the page
+         * table and the locator of the heap of next uses.
          */
-        BeladyAllocator(std::string output_file, std::string virtual_program_file, std::string annotations_file, PhysPageNumber num_page_frames, PageShift shift);
+        BeladyAllocator(int output_fd, std::string virtual_program_file, std::string annotations_file, PhysPageNumber num_page_frames, PageShift shift, InstructionNumber receive_pin_window = 0, bool dense_page_tables = false);
 
         void allocate(util::ProgressBar* progress_bar = nullptr) override;
 
+        /**
+         * @brief Obtains the number of times that the best candidate for
+         * eviction was pinned by an outstanding network receive, and a
+         * different page was evicted instead.
+         *
+         * @return The number of network barriers avoided by pinning pages.
+         */
+        std::uint64_t get_num_receive_barriers_avoided() const;
+
     private:
-        std::unordered_map<VirtPageNumber, PageTableEntry> page_table;
+        /**
+         * @brief Removes the page to evict from the heap of next uses.
+         *
+         * @param i The number (index) of the current instruction.
+         * @return The score and virtual page number of the page to evict.
+         */
+        std::pair<BeladyScore, VirtPageNumber> remove_eviction_candidate(InstructionNumber i);
+
+        /**
+         * @brief Finishes initialization once the input files are open.
+         *
+         * @param dense_page_tables If true, use flat arrays for the page
+         * table and the locator of the heap of next uses.
+         */
+        void init_page_tables(bool dense_page_tables);
+
+        util::PageMap<VirtPageNumber, PageTableEntry> page_table;
         util::PriorityQueue<BeladyScore, VirtPageNumber> next_use_heap;
         VirtProgramFileReader virt_prog;
-        util::BufferedReverseFileReader<true> annotations;
+        AnnotationReader annotations;
+        InstructionNumber receive_pin_window;
+        std::uint64_t num_receive_barriers_avoided;
+        std::vector<std::pair<BeladyScore, VirtPageNumber>> pinned_candidates;
     };
 }
 
@@ -22,8 +22,11 @@
 #include "memprog/scheduling.hpp"
 #include <cstdint>
 #include <cstdlib>
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <string>
+#include <utility>
 #include "addr.hpp"
 #include "instruction.hpp"
 #include "opcode.hpp"
@@ -31,14 +34,27 @@
 
 namespace mage::memprog {
     static constexpr bool elide_page_copies = true;
+    static constexpr bool schedule_network_receives = true;
 
     Scheduler::Scheduler(std::string input_file, std::string output_file)
         : input(input_file), output(output_file) {
     }
 
+    Scheduler::Scheduler(int input_fd, const ProgramFileHeader& input_header, std::string output_file)
+        : input(input_fd, input_header), output(output_file) {
+    }
+
     Scheduler::~Scheduler() {
     }
 
+    void Scheduler::set_swap_page_count(StoragePageNumber num_swap_pages) {
+        this->output.set_swap_page_count(num_swap_pages);
+    }
+
+    void Scheduler::set_output_format(ProgramFormat format) {
+        this->output.set_format(format);
+    }
+
     void Scheduler::emit_issue_swapin(StoragePageNumber secondary, PhysPageNumber primary) {
         constexpr std::size_t length = PackedPhysInstruction::size(InstructionFormat::Swap);
 
@@ -124,7 +140,16 @@ namespace mage::memprog {
     }
 
     BackdatingScheduler::BackdatingScheduler(std::string input_file, std::string output_file, std::uint64_t lookahead, std::uint32_t prefetch_buffer_size)
-        : Scheduler(input_file, output_file), readahead(input_file), gap(lookahead), current_instruction(0), num_allocation_failures(0), num_synchronous_swapins(0) {
+        : Scheduler(input_file, output_file), gap(lookahead), current_instruction(0), back(0), num_allocation_failures(0), num_synchronous_swapins(0), num_hoisted_receives(0), num_deferred_finish_receives(0) {
+        this->init(prefetch_buffer_size);
+    }
+
+    BackdatingScheduler::BackdatingScheduler(int input_fd, const ProgramFileHeader& input_header, std::string output_file, std::uint64_t lookahead, std::uint32_t prefetch_buffer_size)
+        : Scheduler(input_fd, input_header, output_file), gap(lookahead), current_instruction(0), back(0), num_allocation_failures(0), num_synchronous_swapins(0), num_hoisted_receives(0), num_deferred_finish_receives(0) {
+        this->init(prefetch_buffer_size);
+    }
+
+    void BackdatingScheduler::init(std::uint32_t prefetch_buffer_size) {
         const ProgramFileHeader& header = this->input.get_header();
         this->output.set_page_count(header.num_pages + prefetch_buffer_size);
         this->output.set_swap_page_count(header.num_swap_pages);
@@ -147,6 +172,9 @@ namespace mage::memprog {
         }
 
         this->page_shift = header.page_shift;
+
+        /* One more than the gap, so that the gap can be zero. */
+        this->window.resize(this->gap + 1);
     }
 
     std::uint64_t BackdatingScheduler::get_num_allocation_failures() const {
@@ -157,6 +185,14 @@ namespace mage::memprog {
         return this->num_synchronous_swapins;
     }
 
+    std::uint64_t BackdatingScheduler::get_num_hoisted_receives() const {
+        return this->num_hoisted_receives;
+    }
+
+    std::uint64_t BackdatingScheduler::get_num_deferred_finish_receives() const {
+        return this->num_deferred_finish_receives;
+    }
+
     void BackdatingScheduler::emit_issue_swapin(StoragePageNumber secondary, PhysPageNumber primary) {
         assert(this->in_flight_swapins.find(secondary) == this->in_flight_swapins.end());
         assert(this->in_flight_swapouts.find(secondary) == this->in_flight_swapouts.end());
@@ -198,6 +234,36 @@ namespace mage::memprog {
     }
 
     void BackdatingScheduler::process_gap_increase(PackedPhysInstruction& phys, InstructionNumber i) {
+        if constexpr (schedule_network_receives) {
+            /*
+             * Track, for each page frame, the last instruction in the gap
+             * that uses it, and for each worker, the last barrier for receives
+             * from that worker, so we know how far back each "post receive"
+             * operation can go. A barrier counts as a use of the pages it
+             * waits for.
+             */
+            if (phys.header.operation == OpCode::NetworkPostReceive) {
+                this->schedule_post_receive(phys, i);
+                this->posted_receive_pages[phys.constant.constant].insert(pg_num(phys.constant.output, this->page_shift));
+            } else if (phys.header.operation == OpCode::NetworkFinishReceive) {
+                WorkerID from = phys.control.data;
+                this->last_finish_receive_in_gap[from] = i;
+                std::unordered_set<PhysPageNumber>& posted = this->posted_receive_pages[from];
+                for (PhysPageNumber ppn : posted) {
+                    this->last_page_use_in_gap[ppn] = i;
+                }
+                posted.clear();
+            } else if (phys.header.operation == OpCode::IssueSwapIn || phys.header.operation == OpCode::IssueSwapOut) {
+                this->last_page_use_in_gap[phys.swap.memory] = i;
+            } else {
+                std::array<PhysPageNumber, 5> ppns;
+                std::uint8_t num_pages = phys.store_page_numbers(ppns.data(), this->page_shift);
+                for (std::uint8_t j = 0; j != num_pages; j++) {
+                    this->last_page_use_in_gap[ppns[j]] = i;
+                }
+            }
+        }
+
         if (phys.header.operation == OpCode::IssueSwapIn) {
             /*
              * Check if the most recent swapout to SPN was during the gap.
@@ -241,6 +307,34 @@ namespace mage::memprog {
     }
 
     void BackdatingScheduler::process_gap_decrease(PackedPhysInstruction& phys, InstructionNumber i) {
+        this->back = i + 1;
+        if constexpr (schedule_network_receives) {
+            auto hoisted = this->hoisted_receives.find(i);
+            if (hoisted != this->hoisted_receives.end()) {
+                for (PackedPhysInstruction& post : hoisted->second) {
+                    this->resolve_deferred_finish_receives(post);
+                    this->outstanding_receive_pages[post.constant.constant].insert(pg_num(post.constant.output, this->page_shift));
+                    this->emit_translated(post);
+                }
+                this->hoisted_receives.erase(hoisted);
+            }
+            if (this->hoisted_instructions.erase(i) != 0) {
+                return;
+            }
+            if (phys.header.operation == OpCode::NetworkFinishReceive) {
+                /* Merge with an already-deferred barrier, if any. */
+                WorkerID from = phys.control.data;
+                if (!this->deferred_finish_receives.emplace(from, i).second) {
+                    this->num_deferred_finish_receives++;
+                }
+                return;
+            }
+            this->resolve_deferred_finish_receives(phys);
+            if (phys.header.operation == OpCode::NetworkPostReceive) {
+                this->outstanding_receive_pages[phys.constant.constant].insert(pg_num(phys.constant.output, this->page_shift));
+            }
+        }
+
         if (phys.header.operation == OpCode::IssueSwapIn) {
             /*
              * Check if a swap in is in flight for this PPN --- if so, add a
@@ -328,54 +422,170 @@ namespace mage::memprog {
                 this->emit_finish_swapout(this->translation_map[phys.swap.memory]);
             }
         } else {
-            /* Copy instruction to output. */
-            const std::uint8_t* phys_start = reinterpret_cast<const std::uint8_t*>(&phys);
-            std::size_t phys_size = phys.size();
-            PackedPhysInstruction& into = this->output.start_instruction();
-            std::copy(phys_start, phys_start + phys_size, reinterpret_cast<std::uint8_t*>(&into));
+            this->emit_translated(phys);
+        }
+    }
 
-            /* Translate address according to the translation map. */
-            std::array<PhysPageNumber, 5> ppns;
-            std::uint8_t num_pages = into.store_page_numbers(ppns.data(), this->page_shift);
+    void BackdatingScheduler::schedule_post_receive(const PackedPhysInstruction& phys, InstructionNumber i) {
+        WorkerID from = phys.constant.constant;
+        PhysPageNumber ppn = pg_num(phys.constant.output, this->page_shift);
+
+        /*
+         * The receive can be posted before instruction "earliest" as long as
+         * (1) no instruction from there on uses the destination page frame,
+         * including barriers for other receives into it, (2) it stays after
+         * any barrier for receives from the same worker (the barrier would
+         * otherwise wait for data the sender may not have sent yet, which can
+         * deadlock), and (3) it stays in order with other receives from the
+         * same worker, since they read from one stream.
+         */
+        InstructionNumber earliest = this->back;
+        auto use = this->last_page_use_in_gap.find(ppn);
+        if (use != this->last_page_use_in_gap.end()) {
+            earliest = std::max(earliest, use->second + 1);
+        }
+        auto barrier = this->last_finish_receive_in_gap.find(from);
+        if (barrier != this->last_finish_receive_in_gap.end()) {
+            earliest = std::max(earliest, barrier->second + 1);
+        }
+        auto previous = this->last_post_in_gap.find(from);
+        if (previous != this->last_post_in_gap.end()) {
+            earliest = std::max(earliest, previous->second);
+        }
+
+        /*
+         * Hoisted receives are emitted just before the instruction they are
+         * hoisted to, so a subsequent receive from the same worker may be
+         * hoisted to the same instruction and emitted after this one.
+         */
+        if (earliest < i) {
+            this->hoisted_receives[earliest].push_back(phys);
+            this->hoisted_instructions.insert(i);
+            this->num_hoisted_receives++;
+            this->last_post_in_gap[from] = earliest;
+        } else {
+            this->last_post_in_gap[from] = i + 1;
+        }
+    }
+
+    void BackdatingScheduler::resolve_deferred_finish_receives(PackedPhysInstruction& phys) {
+        if (this->deferred_finish_receives.empty()) {
+            return;
+        }
+
+        std::array<PhysPageNumber, 5> ppns;
+        std::uint8_t num_pages = 0;
+        switch (phys.header.operation) {
+        case OpCode::PrintStats:
+        case OpCode::StartTimer:
+        case OpCode::StopTimer:
+            /* Don't let deferred receives leak across timer boundaries. */
+            while (!this->deferred_finish_receives.empty()) {
+                this->emit_finish_receive(this->deferred_finish_receives.begin()->first);
+            }
+            return;
+        case OpCode::NetworkPostReceive:
+            if (this->deferred_finish_receives.contains(phys.constant.constant)) {
+                this->emit_finish_receive(phys.constant.constant);
+            }
+            num_pages = phys.store_page_numbers(ppns.data(), this->page_shift);
+            break;
+        case OpCode::IssueSwapIn:
+        case OpCode::IssueSwapOut:
+            ppns[num_pages++] = phys.swap.memory;
+            break;
+        default:
+            num_pages = phys.store_page_numbers(ppns.data(), this->page_shift);
+            break;
+        }
+
+        for (auto iter = this->deferred_finish_receives.begin(); iter != this->deferred_finish_receives.end();) {
+            WorkerID from = iter->first;
+            const std::unordered_set<PhysPageNumber>& pending = this->outstanding_receive_pages[from];
+            iter++;
             for (std::uint8_t j = 0; j != num_pages; j++) {
-                ppns[j] = this->translation_map[ppns[j]];
+                if (pending.contains(ppns[j])) {
+                    this->emit_finish_receive(from);
+                    break;
+                }
             }
-            into.restore_page_numbers(phys, ppns.data(), this->page_shift);
+        }
+    }
 
-            this->output.finish_instruction(phys_size);
+    void BackdatingScheduler::emit_finish_receive(WorkerID from) {
+        constexpr std::size_t length = PackedPhysInstruction::size(InstructionFormat::Control);
+
+        PackedPhysInstruction& phys = this->output.start_instruction(length);
+        phys.header.operation = OpCode::NetworkFinishReceive;
+        phys.header.flags = 0;
+        phys.control.data = from;
+        this->output.finish_instruction(length);
+
+        /* Count it if at least one instruction was emitted before it. */
+        auto iter = this->deferred_finish_receives.find(from);
+        if (iter->second + 1 < this->back - 1) {
+            this->num_deferred_finish_receives++;
         }
+        this->deferred_finish_receives.erase(iter);
+        this->outstanding_receive_pages[from].clear();
+    }
+
+    void BackdatingScheduler::emit_translated(const PackedPhysInstruction& phys) {
+        /* Copy instruction to output. */
+        const std::uint8_t* phys_start = reinterpret_cast<const std::uint8_t*>(&phys);
+        std::size_t phys_size = phys.size();
+        PackedPhysInstruction& into = this->output.start_instruction();
+        std::copy(phys_start, phys_start + phys_size, reinterpret_cast<std::uint8_t*>(&into));
+
+        /* Translate address according to the translation map. */
+        std::array<PhysPageNumber, 5> ppns;
+        std::uint8_t num_pages = into.store_page_numbers(ppns.data(), this->page_shift);
+        for (std::uint8_t j = 0; j != num_pages; j++) {
+            ppns[j] = this->translation_map[ppns[j]];
+        }
+        into.restore_page_numbers(phys, ppns.data(), this->page_shift);
+
+        this->output.finish_instruction(phys_size);
+    }
+
+    PackedPhysInstruction& BackdatingScheduler::read_into_window(InstructionNumber i) {
+        const PackedPhysInstruction& phys = this->input.start_instruction();
+        const std::uint8_t* phys_start = reinterpret_cast<const std::uint8_t*>(&phys);
+        std::size_t phys_size = phys.size();
+
+        PackedPhysInstruction& into = this->window[i % this->window.size()];
+        std::copy(phys_start, phys_start + phys_size, reinterpret_cast<std::uint8_t*>(&into));
+        this->input.finish_instruction(phys_size);
+        return into;
     }
 
     void BackdatingScheduler::schedule(util::ProgressBar* progress_bar) {
         this->input.set_progress_bar(progress_bar);
 
-        std::uint64_t num_instructions = this->input.get_header().num_instructions;
         InstructionNumber i;
 
         // First, create a gap
-        for (i = 0; i != this->gap && i != num_instructions; i++) {
-            PackedPhysInstruction& phys = this->readahead.start_instruction();
+        for (i = 0; i != this->gap && !this->input.at_end(); i++) {
+            PackedPhysInstruction& phys = this->read_into_window(i);
             this->process_gap_increase(phys, i);
-            this->readahead.finish_instruction(phys.size());
         }
 
         // Process the remaining instructions
-        for (; i != num_instructions; i++, this->current_instruction++) {
-            PackedPhysInstruction& current = this->input.start_instruction();
+        for (; !this->input.at_end(); i++, this->current_instruction++) {
+            PackedPhysInstruction& phys = this->read_into_window(i);
+            PackedPhysInstruction& current = this->window[this->current_instruction % this->window.size()];
             this->process_gap_decrease(current, this->current_instruction);
-            this->input.finish_instruction(current.size());
-
-            PackedPhysInstruction& phys = this->readahead.start_instruction();
             this->process_gap_increase(phys, i);
-            this->readahead.finish_instruction(phys.size());
         }
 
         // Drain the gap
-        for (; this->current_instruction != num_instructions; this->current_instruction++) {
-            PackedPhysInstruction& current = this->input.start_instruction();
+        for (; this->current_instruction != i; this->current_instruction++) {
+            PackedPhysInstruction& current = this->window[this->current_instruction % this->window.size()];
             this->process_gap_decrease(current, this->current_instruction);
-            this->input.finish_instruction(current.size());
         }
 
+        while (!this->deferred_finish_receives.empty()) {
+            this->emit_finish_receive(this->deferred_finish_receives.begin()->first);
+        }
     }
 }
@@ -34,6 +34,8 @@
 #include <queue>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 #include "addr.hpp"
 #include "instruction.hpp"
 #include "programfile.hpp"
@@ -61,6 +63,25 @@ namespace mage::memprog {
          */
         Scheduler(std::string input_file, std::string output_file);
 
+        /**
+         * @brief Initializes a @p Scheduler that reads physical bytecode,
+         * without a metadata header, from the specified file descriptor and
+         * writes a memory program to the specified output file.
+         *
+         * This allows the scheduling stage to run concurrently with the
+         * replacement stage, consuming its output via a pipe.
+         *
+         * @param input_fd The file descriptor from which to read the physical
+         * bytecode; the @p Scheduler takes ownership of it.
+         * @param input_header Metadata describing the physical bytecode, in
+         * place of the header that it lacks. Its @p num_pages field should
+         * be an upper bound on the page frames used, and its
+         * @p num_instructions and @p num_swap_pages fields are ignored.
+         * @param output_file The name of the file to which to write the memory
+         * program.
+         */
+        Scheduler(int input_fd, const ProgramFileHeader& input_header, std::string output_file);
+
         /**
          * @brief Destructor.
          */
@@ -75,6 +96,28 @@ namespace mage::memprog {
          */
         virtual void schedule(util::ProgressBar* progress_bar = nullptr) = 0;
 
+        /**
+         * @brief Sets the number of swap pages recorded in the memory
+         * program's metadata header.
+         *
+         * This is necessary if the physical bytecode was read without a
+         * metadata header, since the number of swap pages it uses is only
+         * known once the replacement stage is done.
+         *
+         * @param num_swap_pages The number of swap pages used by the program.
+         */
+        void set_swap_page_count(StoragePageNumber num_swap_pages);
+
+        /**
+         * @brief Sets the format in which to encode the instructions of the
+         * memory program.
+         *
+         * @pre This is called before @p schedule.
+         *
+         * @param format The format in which to encode instructions.
+         */
+        void set_output_format(ProgramFormat format);
+
     protected:
         /**
          * @brief Emits an "issue swap in" instruction to the memory program.
@@ -170,6 +213,13 @@ namespace mage::memprog {
      * current swap operations in the final plan. The maximum number of
      * concurrent swap operations is the number of page frames in the prefetch
      * buffer plus one.
+     *
+     * The same gap is used to schedule network receives. Each "post receive"
+     * operation is hoisted as far back into the gap as its destination page
+     * frame allows, so that data from other workers arrives while preceding
+     * instructions execute. Each "finish receive" operation is deferred until
+     * an instruction actually touches a page with an outstanding receive from
+     * that worker (or until the next receive from that worker is posted).
      */
     class BackdatingScheduler : public Scheduler {
     public:
@@ -190,6 +240,27 @@ namespace mage::memprog {
          */
         BackdatingScheduler(std::string input_file, std::string output_file, std::uint64_t lookahead, std::uint32_t prefetch_buffer_size);
 
+        /**
+         * @brief Initializes a @p BackdatingScheduler that reads physical
+         * bytecode, without a metadata header, from the specified file
+         * descriptor and writes a memory program to the specified output
+         * file.
+         *
+         * @param input_fd The file descriptor from which to read the physical
+         * bytecode; the @p BackdatingScheduler takes ownership of it.
+         * @param input_header Metadata describing the physical bytecode, in
+         * place of the header that it lacks (see the corresponding
+         * @p Scheduler constructor).
+         * @param output_file The name of the file to which to write the memory
+         * program.
+         * @param lookahead The number of instructions by which to prefetch
+         * each "swap in" operation.
+         * @param prefetch_buffer_size The number of extra MAGE-physical page
+         * frames (beyond those used in the replacement phase) used for
+         * scheduling swap operations.
+         */
+        BackdatingScheduler(int input_fd, const ProgramFileHeader& input_header, std::string output_file, std::uint64_t lookahead, std::uint32_t prefetch_buffer_size);
+
         /**
          * @brief Obtains the number of times the scheduler was unable to
          * allocate a page from from the prefetch buffer.
@@ -215,6 +286,23 @@ namespace mage::memprog {
          */
         std::uint64_t get_num_synchronous_swapins() const;
 
+        /**
+         * @brief Obtains the number of "post receive" operations that the
+         * scheduler moved earlier in the memory program.
+         *
+         * @return The number of hoisted "post receive" operations.
+         */
+        std::uint64_t get_num_hoisted_receives() const;
+
+        /**
+         * @brief Obtains the number of "finish receive" operations that the
+         * scheduler moved later in the memory program (or merged with a
+         * subsequent one).
+         *
+         * @return The number of deferred "finish receive" operations.
+         */
+        std::uint64_t get_num_deferred_finish_receives() const;
+
         /**
          * @brief Allocates a page frame from the prefetch buffer.
          *
@@ -287,7 +375,65 @@ namespace mage::memprog {
         void schedule(util::ProgressBar* progress_bar = nullptr) override;
 
     private:
-        PhysProgramFileReader readahead;
+        /**
+         * @brief Sets up the output header, prefetch buffer, and translation
+         * map based on the input's metadata header.
+         *
+         * @param prefetch_buffer_size The number of page frames in the
+         * prefetch buffer.
+         */
+        void init(std::uint32_t prefetch_buffer_size);
+
+        /**
+         * @brief Reads the next instruction of the physical bytecode into the
+         * window of instructions in the gap.
+         *
+         * @param i The number (index) of the instruction to read.
+         * @return A reference to the copy of the instruction in the window.
+         */
+        PackedPhysInstruction& read_into_window(InstructionNumber i);
+
+        /**
+         * @brief Determines how early in the gap a "post receive" operation
+         * can be issued, and if it can be issued earlier than instruction
+         * @p i, where it appears in the physical bytecode, schedules it there.
+         *
+         * @param phys A reference to the "post receive" instruction.
+         * @param i The number (index) of the instruction referenced by
+         * @p phys.
+         */
+        void schedule_post_receive(const PackedPhysInstruction& phys, InstructionNumber i);
+
+        /**
+         * @brief Emits any deferred "finish receive" operations that must
+         * complete before the specified instruction executes.
+         *
+         * @param phys A reference to the instruction about to be emitted.
+         */
+        void resolve_deferred_finish_receives(PackedPhysInstruction& phys);
+
+        /**
+         * @brief Emits a "finish receive" operation for the specified worker.
+         *
+         * @param from The ID of the worker whose receives to wait for.
+         */
+        void emit_finish_receive(WorkerID from);
+
+        /**
+         * @brief Copies an instruction from the physical bytecode to the
+         * memory program, translating its addresses according to the
+         * translation map.
+         *
+         * @param phys A reference to the instruction to copy.
+         */
+        void emit_translated(const PackedPhysInstruction& phys);
+
+        /*
+         * Copies of the instructions in the gap, indexed by instruction
+         * number modulo its size, so that the physical bytecode only needs
+         * to be read once (and can therefore be read from a pipe).
+         */
+        std::vector<PackedPhysInstruction> window;
         // util::PriorityQueue<InstructionNumber, std::pair<StoragePageNumber, PhysPageNumber>> queued_swapins;
         std::unordered_map<StoragePageNumber, PhysPageNumber> finished_swapout_elisions;
         std::unordered_set<InstructionNumber> scheduled_swapout_elisions;
@@ -302,8 +448,21 @@ namespace mage::memprog {
         std::vector<PhysPageNumber> translation_map;
         PageShift page_shift;
 
+        /* Number of instructions processed at the back end of the gap. */
+        InstructionNumber back;
+        std::unordered_map<PhysPageNumber, InstructionNumber> last_page_use_in_gap;
+        std::unordered_map<WorkerID, std::unordered_set<PhysPageNumber>> posted_receive_pages;
+        std::unordered_map<WorkerID, InstructionNumber> last_post_in_gap;
+        std::unordered_map<WorkerID, InstructionNumber> last_finish_receive_in_gap;
+        std::unordered_map<InstructionNumber, std::vector<PackedPhysInstruction>> hoisted_receives;
+        std::unordered_set<InstructionNumber> hoisted_instructions;
+        std::unordered_map<WorkerID, std::unordered_set<PhysPageNumber>> outstanding_receive_pages;
+        std::unordered_map<WorkerID, InstructionNumber> deferred_finish_receives;
+
         std::uint64_t num_allocation_failures;
         std::uint64_t num_synchronous_swapins;
+        std::uint64_t num_hoisted_receives;
+        std::uint64_t num_deferred_finish_receives;
     };
 }
 
@@ -71,6 +71,7 @@ namespace mage {
         BitOR, // 2 arguments
         BitXOR, // 2 arguments
         ValueSelect, // 3 arguments
+        CondSwap, // 2 arguments
         SwitchLevel, // 1 argument
         AddPlaintext, // 2 arguments
         MultiplyPlaintext, // 2 arguments
@@ -152,6 +153,8 @@ namespace mage {
             return "BitXOR";
         case OpCode::ValueSelect:
             return "ValueSelect";
+        case OpCode::CondSwap:
+            return "CondSwap";
         case OpCode::SwitchLevel:
             return "SwitchLevel";
         case OpCode::AddPlaintext:
@@ -259,7 +262,7 @@ namespace mage {
          *
          * @param op The specified operation.
          */
-        constexpr OpInfo(OpCode op) : layout(InstructionFormat::NoArgs), single_bit(false), has_output(true) {
+        constexpr OpInfo(OpCode op) : layout(InstructionFormat::NoArgs), single_bit(false), has_output(true), in_place(false) {
             this->set(op);
         }
 
@@ -282,6 +285,7 @@ namespace mage {
          * @param op The specified operation.
          */
         constexpr void set(OpCode op)  {
+            this->in_place = false;
             switch (op) {
             case OpCode::PrintStats:
             case OpCode::StartTimer:
@@ -389,6 +393,12 @@ namespace mage {
                 this->single_bit = false;
                 this->has_output = true;
                 break;
+            case OpCode::CondSwap:
+                this->layout = InstructionFormat::TwoArgs;
+                this->single_bit = false;
+                this->has_output = true;
+                this->in_place = true;
+                break;
             default:
                 std::abort();
             }
@@ -441,6 +451,18 @@ namespace mage {
             return this->has_output;
         }
 
+        /**
+         * @brief Returns whether the operation represented by this OpInfo
+         * instance updates its output and its first input in place, reading
+         * and writing both of them.
+         *
+         * @return True if this operation writes its first input in addition
+         * to its output, otherwise false.
+         */
+        constexpr bool updates_in_place() const {
+            return this->in_place;
+        }
+
         /**
          * @brief Returns the instruction format for the operation represented
          * by this OpInfo instance.
@@ -455,6 +477,7 @@ namespace mage {
         InstructionFormat layout;
         bool single_bit;
         bool has_output;
+        bool in_place;
     };
 }
 
@@ -25,6 +25,7 @@
 #include <cstdlib>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <algorithm>
@@ -177,6 +178,20 @@ namespace mage::platform {
         return rv;
     }
 
+    std::size_t read_available_from_file_vectored(int fd, void* first, std::size_t first_length, void* second, std::size_t second_length) {
+        struct iovec iov[2];
+        iov[0].iov_base = first;
+        iov[0].iov_len = first_length;
+        iov[1].iov_base = second;
+        iov[1].iov_len = second_length;
+        ssize_t rv = readv(fd, iov, 2);
+        if (rv < 0) {
+            std::perror("read_available_from_file_vectored -> readv");
+            std::abort();
+        }
+        return rv;
+    }
+
     void seek_file(int fd, std::int64_t amount, bool relative) {
         if (lseek(fd, (off_t) amount, relative ? SEEK_CUR : SEEK_SET) == -1) {
             std::perror("seek_file -> lseek");
@@ -206,4 +221,11 @@ namespace mage::platform {
             std::abort();
         }
     }
+
+    void remove_file(const char* filename) {
+        if (unlink(filename) == -1) {
+            std::perror("remove_file -> unlink");
+            std::abort();
+        }
+    }
 }
@@ -160,6 +160,29 @@ namespace mage::platform {
      */
     std::size_t read_available_from_file(int fd, void* buffer, std::size_t length);
 
+    /**
+     * @brief Reads up to the specified number of bytes from the file
+     * associated with the provided file descriptor into two arrays, filling
+     * the first array before placing any data in the second, and advances the
+     * file descriptor's offset accordingly.
+     *
+     * This is useful for reading a large item directly into its destination
+     * while opportunistically refilling an in-memory buffer with whatever
+     * data follows it, using a single system call.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param fd The provided file descriptor.
+     * @param first The first array into which to read data.
+     * @param first_length The length of the first array.
+     * @param second The second array into which to read data.
+     * @param second_length The length of the second array.
+     * @return The total number of bytes read from the file, which may be less
+     * than @p first_length + @p second_length for any reason, and is 0 if and
+     * only if the end-of-file condition is reached.
+     */
+    std::size_t read_available_from_file_vectored(int fd, void* first, std::size_t first_length, void* second, std::size_t second_length);
+
     /**
      * @brief Gives the kernel a hint to prefetch data at the speified position
      * in the file associated with the provided file descriptor.
@@ -205,6 +228,15 @@ namespace mage::platform {
      * @param fd The file descriptor to close.
      */
     void close_file(int fd);
+
+    /**
+     * @brief Removes the file with the specified name.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param filename The name of the file to remove.
+     */
+    void remove_file(const char* filename);
 }
 
 #endif
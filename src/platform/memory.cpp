@@ -19,10 +19,15 @@
  * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cerrno>
 #include <cstdio>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace mage::platform {
     void* allocate_resident_memory(std::size_t num_bytes, bool lazy) {
@@ -60,4 +65,58 @@ namespace mage::platform {
             std::abort();
         }
     }
+
+    int create_shared_memory(const char* name, std::size_t length) {
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+        if (fd == -1) {
+            std::perror("create_shared_memory -> shm_open");
+            std::abort();
+        }
+        if (ftruncate(fd, (off_t) length) != 0) {
+            std::perror("create_shared_memory -> ftruncate");
+            std::abort();
+        }
+        return fd;
+    }
+
+    int open_shared_memory(const char* name) {
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd == -1 && errno != ENOENT) {
+            std::perror("open_shared_memory -> shm_open");
+            std::abort();
+        }
+        return fd;
+    }
+
+    void unlink_shared_memory(const char* name) {
+        if (shm_unlink(name) != 0) {
+            std::perror("unlink_shared_memory -> shm_unlink");
+            std::abort();
+        }
+    }
+
+    void* map_ring(int fd, std::uint64_t offset, std::size_t length) {
+        /* Reserve enough address space for both mappings, then fill it. */
+        void* reserved = mmap(NULL, 2 * length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) {
+            std::perror("map_ring -> mmap (reserve)");
+            std::abort();
+        }
+        std::uint8_t* base = static_cast<std::uint8_t*>(reserved);
+        for (std::size_t i = 0; i != 2; i++) {
+            void* region = mmap(base + i * length, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | MAP_POPULATE, fd, (off_t) offset);
+            if (region == MAP_FAILED) {
+                std::perror("map_ring -> mmap");
+                std::abort();
+            }
+        }
+        return reserved;
+    }
+
+    void unmap_ring(void* memory, std::size_t length) {
+        if (munmap(memory, 2 * length) != 0) {
+            std::perror("unmap_ring -> munmap");
+            std::abort();
+        }
+    }
 }
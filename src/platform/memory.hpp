@@ -28,6 +28,7 @@
 #define MAGE_PLATFORM_MEMORY_HPP_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "platform/filesystem.hpp"
 
@@ -128,6 +129,69 @@ namespace mage::platform {
         return reinterpret_cast<T*>(memory);
     }
 
+    /**
+     * @brief Creates a named shared memory object of the specified length,
+     * which other processes on the same machine can open by name.
+     *
+     * If an error occurs (including if an object with the given name already
+     * exists), then the process is aborted.
+     *
+     * @param name The name of the shared memory object, which should begin
+     * with a slash and contain no other slashes.
+     * @param length The size, in bytes, of the shared memory object.
+     * @return A file descriptor for the created shared memory object.
+     */
+    int create_shared_memory(const char* name, std::size_t length);
+
+    /**
+     * @brief Opens an existing named shared memory object.
+     *
+     * @param name The name of the shared memory object.
+     * @return A file descriptor for the shared memory object, or -1 if no
+     * shared memory object with that name exists.
+     */
+    int open_shared_memory(const char* name);
+
+    /**
+     * @brief Removes the name of a shared memory object. The memory itself
+     * is released once all processes have unmapped it and closed their file
+     * descriptors for it.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param name The name of the shared memory object.
+     */
+    void unlink_shared_memory(const char* name);
+
+    /**
+     * @brief Maps a region of a file into memory twice, at adjacent virtual
+     * addresses, for use as a ring buffer.
+     *
+     * Because the second mapping immediately follows the first, any range of
+     * up to @p length bytes starting within the first mapping is contiguous
+     * in memory, even if it wraps around the end of the region in the file.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param fd A file descriptor for the file to map.
+     * @param offset The offset of the region in the file, which must be a
+     * multiple of the page size.
+     * @param length The size of the region, which must be a multiple of the
+     * page size.
+     * @return A pointer to the first of the two mappings.
+     */
+    void* map_ring(int fd, std::uint64_t offset, std::size_t length);
+
+    /**
+     * @brief Unmaps a ring buffer mapping created with map_ring().
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param memory The pointer returned by map_ring().
+     * @param length The length passed to map_ring().
+     */
+    void unmap_ring(void* memory, std::size_t length);
+
     /**
      * @brief RAII-style wrapper for a memory mapping or allocated memory.
      *
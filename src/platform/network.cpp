@@ -26,11 +26,16 @@
 #include <cstdint>
 #include <cstdlib>
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 namespace mage::platform {
@@ -130,6 +135,224 @@ namespace mage::platform {
         freeaddrinfo(info);
     }
 
+    static void set_keepalive(int socket, const char* caller) {
+        /* Maintain firewall state through idle periods. */
+        int keepalive = 1;
+        if (setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive)) == -1) {
+            std::cerr << caller << " -> setsockopt: " << std::strerror(errno) << std::endl;
+            std::abort();
+        }
+    }
+
+    int network_listen(const char* port, int backlog) {
+        struct addrinfo hints = { 0 };
+        hints.ai_flags = AI_PASSIVE;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo* info;
+        int rv = getaddrinfo(NULL, port, &hints, &info);
+        if (rv != 0) {
+            std::cerr << "network_listen -> getaddrinfo: " << gai_strerror(rv) << std::endl;
+            std::abort();
+        }
+
+        int server_socket = socket(info->ai_family, info->ai_socktype | SOCK_NONBLOCK, info->ai_protocol);
+        if (server_socket == -1) {
+            std::perror("network_listen -> socket");
+            std::abort();
+        }
+
+        /* Allow a restarted worker to listen again right away. */
+        int reuse = 1;
+        if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1) {
+            std::perror("network_listen -> setsockopt");
+            std::abort();
+        }
+
+        if (bind(server_socket, info->ai_addr, info->ai_addrlen) == -1) {
+            std::perror("network_listen -> bind");
+            std::abort();
+        }
+
+        freeaddrinfo(info);
+
+        if (listen(server_socket, backlog) == -1) {
+            std::perror("network_listen -> listen");
+            std::abort();
+        }
+
+        return server_socket;
+    }
+
+    int network_accept_nonblocking(int listener) {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK);
+        if (fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED || errno == EINTR) {
+                return -1;
+            }
+            std::perror("network_accept_nonblocking -> accept4");
+            std::abort();
+        }
+        set_keepalive(fd, "network_accept_nonblocking");
+        return fd;
+    }
+
+    static NetworkError classify_connect_error(int error) {
+        switch (error) {
+        case 0:
+            return NetworkError::Success;
+        case EINPROGRESS:
+            return NetworkError::InProgress;
+        case ECONNREFUSED:
+        case ECONNRESET:
+            return NetworkError::ConnectionRefused;
+        case ETIMEDOUT:
+            return NetworkError::TimedOut;
+        case ENETUNREACH:
+        case EHOSTUNREACH:
+            return NetworkError::Unreachable;
+        default:
+            std::cerr << "network_connect -> connect: " << std::strerror(error) << std::endl;
+            std::abort();
+        }
+    }
+
+    int network_connect_nonblocking(const char* host, const char* port, NetworkError& err) {
+        struct addrinfo hints = { 0 };
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo* info;
+        int rv = getaddrinfo(host, port, &hints, &info);
+        if (rv != 0) {
+            std::cerr << "network_connect_nonblocking -> getaddrinfo: " << gai_strerror(rv) << std::endl;
+            std::abort();
+        }
+
+        int fd = socket(info->ai_family, info->ai_socktype | SOCK_NONBLOCK, info->ai_protocol);
+        if (fd == -1) {
+            std::perror("network_connect_nonblocking -> socket");
+            std::abort();
+        }
+        set_keepalive(fd, "network_connect_nonblocking");
+
+        if (connect(fd, info->ai_addr, info->ai_addrlen) == -1) {
+            err = classify_connect_error(errno);
+        } else {
+            err = NetworkError::Success;
+        }
+        freeaddrinfo(info);
+
+        if (err != NetworkError::Success && err != NetworkError::InProgress) {
+            network_close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    NetworkError network_connect_finish(int socket) {
+        int error;
+        socklen_t error_length = sizeof(error);
+        if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1) {
+            std::perror("network_connect_finish -> getsockopt");
+            std::abort();
+        }
+        NetworkError err = classify_connect_error(error);
+        if (err != NetworkError::Success && err != NetworkError::InProgress) {
+            network_close(socket);
+        }
+        return err;
+    }
+
+    void network_set_blocking(int socket, bool blocking) {
+        int flags = fcntl(socket, F_GETFL);
+        if (flags == -1) {
+            std::perror("network_set_blocking -> fcntl (get)");
+            std::abort();
+        }
+        flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+        if (fcntl(socket, F_SETFL, flags) == -1) {
+            std::perror("network_set_blocking -> fcntl (set)");
+            std::abort();
+        }
+    }
+
+    std::int64_t network_read_nonblocking(int socket, void* buffer, std::size_t length) {
+        ssize_t rv = read(socket, buffer, length);
+        if (rv == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return -1;
+            }
+            if (errno == ECONNRESET) {
+                return 0;
+            }
+            std::perror("network_read_nonblocking -> read");
+            std::abort();
+        }
+        return rv;
+    }
+
+    int event_queue_create() {
+        int queue = epoll_create1(EPOLL_CLOEXEC);
+        if (queue == -1) {
+            std::perror("event_queue_create -> epoll_create1");
+            std::abort();
+        }
+        return queue;
+    }
+
+    void event_queue_watch(int queue, int socket, bool readable, bool writable, std::uint64_t tag, bool already_watched) {
+        struct epoll_event ev = {};
+        std::uint32_t mask = 0;
+        if (readable) {
+            mask |= EPOLLIN;
+        }
+        if (writable) {
+            mask |= EPOLLOUT;
+        }
+        ev.events = mask;
+        ev.data.u64 = tag;
+        if (epoll_ctl(queue, already_watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, socket, &ev) == -1) {
+            std::perror("event_queue_watch -> epoll_ctl");
+            std::abort();
+        }
+    }
+
+    void event_queue_unwatch(int queue, int socket) {
+        if (epoll_ctl(queue, EPOLL_CTL_DEL, socket, NULL) == -1) {
+            std::perror("event_queue_unwatch -> epoll_ctl");
+            std::abort();
+        }
+    }
+
+    std::uint32_t event_queue_wait(int queue, NetworkEvent* events, std::uint32_t max_events, int timeout_ms) {
+        struct epoll_event evs[event_queue_max_events];
+        max_events = std::min(max_events, event_queue_max_events);
+        int rv;
+        do {
+            rv = epoll_wait(queue, evs, max_events, timeout_ms);
+        } while (rv == -1 && errno == EINTR);
+        if (rv == -1) {
+            std::perror("event_queue_wait -> epoll_wait");
+            std::abort();
+        }
+        for (int i = 0; i != rv; i++) {
+            events[i].tag = evs[i].data.u64;
+            events[i].readable = (evs[i].events & EPOLLIN) != 0;
+            events[i].writable = (evs[i].events & EPOLLOUT) != 0;
+            events[i].error = (evs[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+        }
+        return rv;
+    }
+
+    void event_queue_close(int queue) {
+        if (close(queue) == -1) {
+            std::perror("event_queue_close -> close");
+            std::abort();
+        }
+    }
+
     void network_close(int socket) {
         if (close(socket) == -1) {
             std::perror("network_close -> close");
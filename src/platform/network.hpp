@@ -38,6 +38,8 @@ namespace mage::platform {
         Success,
         ConnectionRefused,
         TimedOut,
+        InProgress,
+        Unreachable,
     };
 
     /**
@@ -78,6 +80,165 @@ namespace mage::platform {
      */
     void network_connect(const char* host, const char* port, int* into, NetworkError* err, std::uint32_t count = 1);
 
+    /**
+     * @brief Creates a TCP socket listening for incoming connections on the
+     * specified port, without blocking to accept any.
+     *
+     * The socket is non-blocking, so connections can be accepted with
+     * network_accept_nonblocking() once an event queue reports that it is
+     * readable. If an error occurs, then the process is aborted.
+     *
+     * @param port The port on which to listen for incoming connections,
+     * provided as a string.
+     * @param backlog The maximum number of pending connections to queue.
+     * @return A file descriptor for the listening socket.
+     */
+    int network_listen(const char* port, int backlog);
+
+    /**
+     * @brief Accepts an incoming connection on a listening socket created
+     * with network_listen(), if one is pending.
+     *
+     * The accepted socket is non-blocking. If an error occurs, then the
+     * process is aborted.
+     *
+     * @param listener The listening socket.
+     * @return A file descriptor for the accepted connection, or -1 if no
+     * connection is pending.
+     */
+    int network_accept_nonblocking(int listener);
+
+    /**
+     * @brief Initiates a TCP connection to the specified endpoint without
+     * blocking for it to be established.
+     *
+     * If @p err is set to @p InProgress, the caller should wait until the
+     * returned socket is writable (e.g., using an event queue) and then call
+     * network_connect_finish(). If it is set to another error, then the
+     * returned socket is -1. Errors that cannot be described by a
+     * @p NetworkError cause the process to abort.
+     *
+     * @param host The hostname of the TCP endpoint to which to connect.
+     * @param port The port of the TCP endpoint to which to connect.
+     * @param[out] err Populated with the result of initiating the connection.
+     * @return A non-blocking socket for the connection.
+     */
+    int network_connect_nonblocking(const char* host, const char* port, NetworkError& err);
+
+    /**
+     * @brief Obtains the result of a connection initiated by
+     * network_connect_nonblocking().
+     *
+     * If the result is not @p Success, then the socket is closed.
+     *
+     * @param socket The socket returned by network_connect_nonblocking().
+     * @return The result of the connection attempt.
+     */
+    NetworkError network_connect_finish(int socket);
+
+    /**
+     * @brief Puts a socket into blocking or non-blocking mode.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param socket The socket whose mode to set.
+     * @param blocking True to make the socket blocking, or false to make it
+     * non-blocking.
+     */
+    void network_set_blocking(int socket, bool blocking);
+
+    /**
+     * @brief Reads up to the specified number of bytes from a non-blocking
+     * socket, without blocking.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param socket The socket from which to read.
+     * @param buffer The array into which to read data.
+     * @param length The maximum number of bytes to read.
+     * @return The number of bytes read, 0 if the connection was closed, or
+     * -1 if no data is currently available.
+     */
+    std::int64_t network_read_nonblocking(int socket, void* buffer, std::size_t length);
+
+    /**
+     * @brief Describes an event reported by an event queue.
+     */
+    struct NetworkEvent {
+        std::uint64_t tag;
+        bool readable;
+        bool writable;
+        bool error;
+    };
+
+    /**
+     * @brief Creates an event queue, which allows a single thread to wait for
+     * events on many sockets at once.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @return A file descriptor for the event queue.
+     */
+    int event_queue_create();
+
+    /**
+     * @brief Starts or stops watching a socket for events, or changes which
+     * events are watched for.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param queue The event queue.
+     * @param socket The socket to watch.
+     * @param readable Watch for the socket becoming readable.
+     * @param writable Watch for the socket becoming writable.
+     * @param tag A value reported with each event for this socket, so that
+     * the caller can identify it.
+     * @param already_watched True if the socket was previously added to the
+     * event queue, and has not been removed since.
+     */
+    void event_queue_watch(int queue, int socket, bool readable, bool writable, std::uint64_t tag, bool already_watched = false);
+
+    /**
+     * @brief Stops watching a socket for events.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param queue The event queue.
+     * @param socket The socket to stop watching.
+     */
+    void event_queue_unwatch(int queue, int socket);
+
+    /**
+     * @brief The maximum number of events returned by a single call to
+     * event_queue_wait().
+     */
+    constexpr std::uint32_t event_queue_max_events = 64;
+
+    /**
+     * @brief Waits for events on the sockets watched by an event queue.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param queue The event queue.
+     * @param[out] events An array into which to write the events.
+     * @param max_events The length of the @p events array. At most
+     * @p event_queue_max_events events are written, regardless.
+     * @param timeout_ms The maximum amount of time to wait, in milliseconds,
+     * or -1 to wait indefinitely.
+     * @return The number of events written to @p events, which is zero if
+     * the timeout expired.
+     */
+    std::uint32_t event_queue_wait(int queue, NetworkEvent* events, std::uint32_t max_events, int timeout_ms);
+
+    /**
+     * @brief Closes an event queue.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param queue The event queue to close.
+     */
+    void event_queue_close(int queue);
+
     /**
      * @brief Closes a file descriptor corresponding to a TCP connection,
      * shutting down the connection.
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2021 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "platform/sync.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mage::platform {
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+
+    void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected, bool process_shared) {
+        int op = process_shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+        long rv = syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), op, expected, nullptr, nullptr, 0);
+        if (rv == -1 && errno != EAGAIN && errno != EINTR) {
+            std::perror("futex_wait -> futex");
+            std::abort();
+        }
+    }
+
+    void futex_wake_all(std::atomic<std::uint32_t>& word, bool process_shared) {
+        int op = process_shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+        long rv = syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), op, INT_MAX, nullptr, nullptr, 0);
+        if (rv == -1) {
+            std::perror("futex_wake_all -> futex");
+            std::abort();
+        }
+    }
+}
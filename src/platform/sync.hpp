@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2021 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2021 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file platform/sync.hpp
+ * @brief System-level primitives for blocking threads without holding locks.
+ */
+
+#ifndef MAGE_PLATFORM_SYNC_HPP_
+#define MAGE_PLATFORM_SYNC_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+namespace mage::platform {
+    /**
+     * @brief Blocks the calling thread until it is woken by
+     * futex_wake_all(), but only if @p word contains @p expected.
+     *
+     * This function may return spuriously, so the caller should re-check the
+     * condition that it is waiting for in a loop. If an unexpected error
+     * occurs, then the process is aborted.
+     *
+     * @param word The word on which to wait.
+     * @param expected The value that @p word must contain for the calling
+     * thread to block.
+     * @param process_shared True if @p word may be in memory shared with
+     * other processes, in which case threads in those processes may wake the
+     * calling thread.
+     */
+    void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected, bool process_shared = false);
+
+    /**
+     * @brief Wakes all threads blocked in futex_wait() on @p word.
+     *
+     * If an error occurs, then the process is aborted.
+     *
+     * @param word The word on which threads to wake are waiting.
+     * @param process_shared True if @p word may be in memory shared with
+     * other processes; must match the value passed to futex_wait().
+     */
+    void futex_wake_all(std::atomic<std::uint32_t>& word, bool process_shared = false);
+}
+
+#endif
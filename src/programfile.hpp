@@ -27,17 +27,35 @@
 #ifndef MAGE_PROGRAMFILE_HPP_
 #define MAGE_PROGRAMFILE_HPP_
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 
+#include <algorithm>
+#include <array>
 #include <string>
 #include <vector>
 
 #include "addr.hpp"
 #include "instruction.hpp"
+#include "opcode.hpp"
 #include "util/filebuffer.hpp"
+#include "util/varint.hpp"
 #include "platform/filesystem.hpp"
 
 namespace mage {
+    /**
+     * @brief Describes how instructions are encoded in a bytecode.
+     */
+    enum class ProgramFormat : std::uint8_t {
+        /* Each instruction is a PackedInstruction. */
+        Packed = 0,
+
+        /* Each instruction is encoded by a CompactInstructionCodec. */
+        Compact = 1
+    };
+
     /**
      * @brief Header containing metadata at the start of any of MAGE's
      * bytecodes.
@@ -48,6 +66,189 @@ namespace mage {
         std::uint64_t num_swap_pages;
         std::uint32_t max_concurrent_swaps;
         PageShift page_shift;
+        ProgramFormat format;
+    };
+
+    /**
+     * @brief Translates instructions between their PackedInstruction form
+     * and a more compact, variable-length encoding used in bytecodes with
+     * the ProgramFormat::Compact format.
+     *
+     * In the compact encoding, the opcode and flags are followed by fields
+     * that depend on the instruction format. Widths, constants, page
+     * numbers, and control data are stored as varints. Instructions tend to
+     * reuse the operands of instructions shortly before them, so the codec
+     * keeps a table of recently used addresses. Each address is stored
+     * either as its index in this table, or, if not present, as the
+     * (zigzag-encoded) difference from the previous address, in which case
+     * it is added to the table.
+     *
+     * Because of this, the encoding of an instruction depends on the
+     * preceding instructions, so instructions must be encoded and decoded
+     * in order, each exactly once.
+     *
+     * @tparam addr_bits,storage_bits Parameters of the type of instruction
+     * being encoded.
+     */
+    template <std::uint8_t addr_bits, std::uint8_t storage_bits>
+    class CompactInstructionCodec {
+    public:
+        /**
+         * @brief The maximum size of an instruction in compact form.
+         */
+        static constexpr std::size_t max_encoded_size = sizeof(PackedInstruction<addr_bits, storage_bits>::header) + util::max_varint_size(8 * sizeof(BitWidth)) + 4 * util::max_varint_size(64);
+
+        CompactInstructionCodec() : previous(0), next_slot(0) {
+            std::fill(this->recent.begin(), this->recent.end(), 0);
+        }
+
+        /**
+         * @brief Encodes the specified instruction in compact form.
+         *
+         * @param instr The instruction to encode.
+         * @param into The buffer into which to write the compact form, which
+         * must have space for at least @p max_encoded_size bytes.
+         * @return The size of the compact form, in bytes.
+         */
+        std::size_t encode(const PackedInstruction<addr_bits, storage_bits>& instr, std::uint8_t* into) {
+            into[0] = static_cast<std::uint8_t>(instr.header.operation);
+            into[1] = instr.header.flags;
+            std::size_t size = sizeof(instr.header);
+
+            OpInfo info(instr.header.operation);
+            switch (info.format()) {
+            case InstructionFormat::NoArgs:
+            case InstructionFormat::OneArg:
+            case InstructionFormat::TwoArgs:
+            case InstructionFormat::ThreeArgs:
+            case InstructionFormat::Constant:
+            {
+                int num_args = info.num_args();
+                size += util::encode_varint(instr.three_args.width, &into[size]);
+                size += this->encode_address(instr.three_args.output, &into[size]);
+                if (num_args > 0) {
+                    size += this->encode_address(instr.three_args.input1, &into[size]);
+                    if (num_args > 1) {
+                        size += this->encode_address(instr.three_args.input2, &into[size]);
+                        if (num_args > 2) {
+                            size += this->encode_address(instr.three_args.input3, &into[size]);
+                        }
+                    }
+                } else if (info.uses_constant()) {
+                    size += util::encode_varint(instr.constant.constant, &into[size]);
+                }
+                return size;
+            }
+            case InstructionFormat::Swap:
+                size += util::encode_varint(instr.swap.memory, &into[size]);
+                size += util::encode_varint(instr.swap.storage, &into[size]);
+                return size;
+            case InstructionFormat::SwapFinish:
+                size += util::encode_varint(instr.swap_finish.memory, &into[size]);
+                return size;
+            case InstructionFormat::Control:
+                size += util::encode_varint(instr.control.data, &into[size]);
+                return size;
+            default:
+                std::abort();
+            }
+        }
+
+        /**
+         * @brief Decodes an instruction in compact form.
+         *
+         * @param from The buffer containing the compact form.
+         * @param[out] instr Populated with the decoded instruction.
+         * @return The size of the compact form, in bytes.
+         */
+        std::size_t decode(const std::uint8_t* from, PackedInstruction<addr_bits, storage_bits>& instr) {
+            instr.header.operation = static_cast<OpCode>(from[0]);
+            instr.header.flags = from[1];
+            std::size_t size = sizeof(instr.header);
+            std::uint64_t value;
+
+            OpInfo info(instr.header.operation);
+            switch (info.format()) {
+            case InstructionFormat::NoArgs:
+            case InstructionFormat::OneArg:
+            case InstructionFormat::TwoArgs:
+            case InstructionFormat::ThreeArgs:
+            case InstructionFormat::Constant:
+            {
+                int num_args = info.num_args();
+                size += util::decode_varint(&from[size], value);
+                instr.three_args.width = value;
+                size += this->decode_address(&from[size], value);
+                instr.three_args.output = value;
+                if (num_args > 0) {
+                    size += this->decode_address(&from[size], value);
+                    instr.three_args.input1 = value;
+                    if (num_args > 1) {
+                        size += this->decode_address(&from[size], value);
+                        instr.three_args.input2 = value;
+                        if (num_args > 2) {
+                            size += this->decode_address(&from[size], value);
+                            instr.three_args.input3 = value;
+                        }
+                    }
+                } else if (info.uses_constant()) {
+                    size += util::decode_varint(&from[size], value);
+                    instr.constant.constant = value;
+                }
+                return size;
+            }
+            case InstructionFormat::Swap:
+                size += util::decode_varint(&from[size], value);
+                instr.swap.memory = value;
+                size += util::decode_varint(&from[size], value);
+                instr.swap.storage = value;
+                return size;
+            case InstructionFormat::SwapFinish:
+                size += util::decode_varint(&from[size], value);
+                instr.swap_finish.memory = value;
+                return size;
+            case InstructionFormat::Control:
+                size += util::decode_varint(&from[size], value);
+                instr.control.data = value;
+                return size;
+            default:
+                std::abort();
+            }
+        }
+
+    private:
+        /* Must be a power of two. */
+        static constexpr std::size_t num_recent = 16;
+
+        std::size_t encode_address(std::uint64_t address, std::uint8_t* into) {
+            std::uint64_t code;
+            auto hit = std::find(this->recent.begin(), this->recent.end(), address);
+            if (hit != this->recent.end()) {
+                code = hit - this->recent.begin();
+            } else {
+                code = num_recent + util::zigzag_encode(static_cast<std::int64_t>(address - this->previous));
+                this->recent[this->next_slot++ & (num_recent - 1)] = address;
+            }
+            this->previous = address;
+            return util::encode_varint(code, into);
+        }
+
+        std::size_t decode_address(const std::uint8_t* from, std::uint64_t& address) {
+            std::uint64_t code;
+            std::size_t size = util::decode_varint(from, code);
+            if (code < num_recent) {
+                address = this->recent[code];
+            } else {
+                address = this->previous + util::zigzag_decode(code - num_recent);
+                this->recent[this->next_slot++ & (num_recent - 1)] = address;
+            }
+            this->previous = address;
+            return size;
+        }
+
+        std::array<std::uint64_t, num_recent> recent;
+        std::uint64_t previous;
+        std::uint64_t next_slot;
     };
 
     /**
@@ -75,17 +276,38 @@ namespace mage {
          * on).
          */
         ProgramFileWriter(std::string filename, PageShift shift = 0, std::uint64_t num_pages = 0)
-            : util::BufferedFileWriter<backwards_readable>(filename.c_str()), instruction_count(0), page_shift(shift), page_count(num_pages), swap_page_count(0), concurrent_swaps(1) {
+            : util::BufferedFileWriter<backwards_readable>(filename.c_str()), instruction_count(0), page_count(num_pages), swap_page_count(0), concurrent_swaps(1), page_shift(shift), headerless(false), program_format(ProgramFormat::Packed) {
             ProgramFileHeader header = { 0 };
             platform::write_to_file(this->fd, &header, sizeof(header));
         }
 
+        /**
+         * @brief Creates a ProgramFileWriter set up to write a stream of
+         * instructions, without a metadata header, to the specified file
+         * descriptor.
+         *
+         * This is useful for writing to a file descriptor that is not
+         * seekable, such as a pipe; the reader must obtain the information
+         * in the metadata header in some other way. The ProgramFileWriter
+         * takes ownership of the file descriptor and closes it when it is
+         * destroyed, signalling the end of the stream to the reader.
+         *
+         * @param file_descriptor The file descriptor to write to.
+         */
+        ProgramFileWriter(int file_descriptor)
+            : util::BufferedFileWriter<backwards_readable>(file_descriptor, true), instruction_count(0), page_count(0), swap_page_count(0), concurrent_swaps(1), page_shift(0), headerless(true), program_format(ProgramFormat::Packed) {
+        }
+
         /**
          * @brief Writes any remaining buffered data to the file, and then
-         * writes the metadata header to the beginning of the file.
+         * writes the metadata header to the beginning of the file (unless
+         * this ProgramFileWriter writes a stream without a header).
          */
         virtual ~ProgramFileWriter() {
             this->flush();
+            if (this->headerless) {
+                return;
+            }
             platform::seek_file(this->fd, 0);
 
             ProgramFileHeader header = { 0 };
@@ -94,6 +316,7 @@ namespace mage {
             header.num_swap_pages = this->swap_page_count;
             header.max_concurrent_swaps = this->concurrent_swaps;
             header.page_shift = this->page_shift;
+            header.format = this->program_format;
             platform::write_to_file(this->fd, &header, sizeof(header));
         }
 
@@ -149,6 +372,23 @@ namespace mage {
             this->page_shift = shift;
         }
 
+        /**
+         * @brief Sets the format in which instructions are encoded, which
+         * is written to the file as part of the metadata header.
+         *
+         * The compact format cannot be read in reverse order, so it may only
+         * be used if @p backwards_readable is false.
+         *
+         * @pre No instructions have been written yet.
+         *
+         * @param format The format in which to encode instructions.
+         */
+        void set_format(ProgramFormat format) {
+            static_assert(!backwards_readable);
+            assert(this->instruction_count == 0);
+            this->program_format = format;
+        }
+
         /**
          * @brief Allocates space in the output buffer for a new instruction
          * and returns a reference to it so that a caller can initialize it.
@@ -158,6 +398,9 @@ namespace mage {
          * initialized with the new instruction.
          */
         PackedInstruction<addr_bits, storage_bits>& start_instruction(std::size_t maximum_size = sizeof(PackedInstruction<addr_bits, storage_bits>)) {
+            if (this->program_format == ProgramFormat::Compact) {
+                return this->staging;
+            }
             return this->template start_write<PackedInstruction<addr_bits, storage_bits>>(maximum_size);
         }
 
@@ -170,6 +413,10 @@ namespace mage {
          * which may be less than the size allocated by start_instruction().
          */
         void finish_instruction(std::size_t actual_size) {
+            if (this->program_format == ProgramFormat::Compact) {
+                std::uint8_t* into = static_cast<std::uint8_t*>(this->start_write(CompactInstructionCodec<addr_bits, storage_bits>::max_encoded_size));
+                actual_size = this->codec.encode(this->staging, into);
+            }
             this->finish_write(actual_size);
             this->instruction_count++;
         }
@@ -192,6 +439,12 @@ namespace mage {
         std::uint64_t swap_page_count;
         std::uint32_t concurrent_swaps;
         PageShift page_shift;
+        bool headerless;
+        ProgramFormat program_format;
+
+        /* Used to encode instructions in the compact format. */
+        CompactInstructionCodec<addr_bits, storage_bits> codec;
+        PackedInstruction<addr_bits, storage_bits> staging;
     };
 
     /**
@@ -213,11 +466,28 @@ namespace mage {
          * @param filename The name of the file containing the MAGE bytecode
          * program to read.
          */
-        ProgramFileReader(std::string filename) : util::BufferedFileReader<backwards_readable>(filename.c_str()) {
+        ProgramFileReader(std::string filename) : util::BufferedFileReader<backwards_readable>(filename.c_str()), encoded_size(0) {
             platform::read_from_file(this->fd, &this->header, sizeof(this->header));
             this->set_readahead(true); // reset prefetch offset
         }
 
+        /**
+         * @brief Creates a ProgramFileReader to read a stream of instructions
+         * without a metadata header, such as one written by a headerless
+         * ProgramFileWriter, from the specified file descriptor.
+         *
+         * The ProgramFileReader takes ownership of the file descriptor. Since
+         * the length of the stream is not known in advance, the caller should
+         * use at_end() to detect the end of the stream.
+         *
+         * @param file_descriptor The file descriptor to read from.
+         * @param stream_header Metadata to report via get_header() in place
+         * of a header read from the stream.
+         */
+        ProgramFileReader(int file_descriptor, const ProgramFileHeader& stream_header)
+            : util::BufferedFileReader<backwards_readable>(file_descriptor, true), header(stream_header), encoded_size(0) {
+        }
+
         /**
          * @brief Enables collection of statistics for rebuffer times.
          *
@@ -255,6 +525,14 @@ namespace mage {
          * instruction.
          */
         PackedInstruction<addr_bits, storage_bits>& start_instruction(std::size_t maximum_size = sizeof(PackedInstruction<addr_bits, storage_bits>)) {
+            if (this->header.format == ProgramFormat::Compact) {
+                /* The codec is stateful, so decode each instruction once. */
+                if (this->encoded_size == 0) {
+                    const std::uint8_t* from = static_cast<const std::uint8_t*>(this->start_read(CompactInstructionCodec<addr_bits, storage_bits>::max_encoded_size));
+                    this->encoded_size = this->codec.decode(from, this->decoded);
+                }
+                return this->decoded;
+            }
             return this->template start_read<PackedInstruction<addr_bits, storage_bits>>(maximum_size);
         }
 
@@ -264,11 +542,29 @@ namespace mage {
          *
          * @param actual_size The actual size of the read instruction, which
          * may be smaller than the maximum size given to start_instruction().
+         * If the program is in the compact format, this is the size of the
+         * decoded instruction, and is ignored.
          */
         void finish_instruction(std::size_t actual_size) {
+            if (this->header.format == ProgramFormat::Compact) {
+                actual_size = this->encoded_size;
+                this->encoded_size = 0;
+            }
             this->finish_read(actual_size);
         }
 
+        /**
+         * @brief Checks if all instructions in the program have been read.
+         *
+         * This may block until more data is available to read.
+         *
+         * @return True if there are no more instructions to read, otherwise
+         * false.
+         */
+        bool at_end() {
+            return this->util::BufferedFileReader<backwards_readable>::at_end();
+        }
+
         /**
          * @brief Obtains the metadata header for the bytecode program being
          * read by this ProgramFileReader.
@@ -289,6 +585,11 @@ namespace mage {
 
     private:
         ProgramFileHeader header;
+
+        /* Used to decode instructions in the compact format. */
+        CompactInstructionCodec<addr_bits, storage_bits> codec;
+        PackedInstruction<addr_bits, storage_bits> decoded;
+        std::size_t encoded_size;
     };
 
     /**
@@ -318,6 +619,24 @@ namespace mage {
             platform::read_from_file(this->fd, &this->header, sizeof(this->header));
         }
 
+        /**
+         * @brief Opens a file containing a MAGE bytecode program and creates
+         * a ProgramReverseFileReader to read its instructions in reverse
+         * order, starting with the instruction that ends at the specified
+         * offset.
+         *
+         * This makes it possible for multiple readers to read disjoint parts
+         * of the same program concurrently.
+         *
+         * @param filename The name of the file containing the MAGE bytecode
+         * program to read.
+         * @param end The offset in the file at which the first instruction to
+         * read ends, as returned by @p tell().
+         */
+        ProgramReverseFileReader(std::string filename, std::uint64_t end) : ProgramReverseFileReader(filename) {
+            this->length_left = end;
+        }
+
         /**
          * @brief Sets the progress bar to advance as bytes are read from the
          * file.
@@ -349,6 +668,17 @@ namespace mage {
             return this->template read<PackedInstruction<addr_bits, storage_bits>>(size);
         }
 
+        /**
+         * @brief Obtains the offset in the file at which the next instruction
+         * (in reverse order) ends.
+         *
+         * @return The offset in the file at which the stream is currently
+         * positioned.
+         */
+        std::uint64_t tell() const {
+            return this->util::BufferedReverseFileReader<backwards_readable>::tell();
+        }
+
         /**
          * @brief Obtains the metadata header for the bytecode program being
          * read by this ProgramReverseFileReader.
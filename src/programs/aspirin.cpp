@@ -66,6 +66,7 @@ namespace mage::programs::aspirin {
         ClusterUtils utils;
         utils.self_id = args.worker_index;
         utils.num_proc = args.num_workers;
+        Reduction reduction = get_reduction(args);
 
         ShardedArray<Input<patient_id_bits + timestamp_bits>> inputs(input_array_length, args.worker_index, args.num_workers, Layout::Cyclic);
         inputs.for_each([=](std::size_t i, auto& input) {
@@ -87,7 +88,7 @@ namespace mage::programs::aspirin {
         });
         std::optional<Bit> order = utils.reduce_aggregates<Bit>(0, local_order, [](Bit& first, Bit& second) -> Bit {
             return first & second;
-        });
+        }, reduction);
         if (args.worker_index == 0) {
             order.value().mark_output();
         }
@@ -107,7 +108,7 @@ namespace mage::programs::aspirin {
 
         std::optional<Integer<result_bits>> total = utils.reduce_aggregates<Integer<result_bits>>(0, local_total, [](Integer<result_bits>& first, Integer<result_bits>& second) -> Integer<result_bits> {
             return first + second;
-        });
+        }, reduction);
         if (args.worker_index == 0) {
             total.value().mark_output();
         }
@@ -58,6 +58,7 @@ namespace mage::programs::real_statistics {
         ClusterUtils utils;
         utils.self_id = args.worker_index;
         utils.num_proc = args.num_workers;
+        Reduction reduction = get_reduction(args);
 
         ShardedArray<LeveledBatch<2, true>> inputs(input_array_length, args.worker_index, args.num_workers, Layout::Blocked);
         inputs.for_each([=](std::size_t i, auto& input) {
@@ -88,7 +89,7 @@ namespace mage::programs::real_statistics {
             result.sum = a.sum + b.sum;
             result.sum_squares = a.sum_squares + b.sum_squares;
             return result;
-        });
+        }, reduction);
 
         if (args.worker_index == 0) {
             LeveledBatch<1, true> mean = global_stats->sum * LeveledPlaintextBatch<2>(1 / static_cast<double>(input_array_length));
@@ -35,6 +35,7 @@ namespace mage::programs::real_sum {
         ClusterUtils utils;
         utils.self_id = args.worker_index;
         utils.num_proc = args.num_workers;
+        Reduction reduction = get_reduction(args);
 
         ShardedArray<LeveledBatch<0, true>> inputs(input_array_length, args.worker_index, args.num_workers, Layout::Blocked);
         inputs.for_each([=](std::size_t i, auto& input) {
@@ -58,7 +59,7 @@ namespace mage::programs::real_sum {
 
         std::optional<LeveledBatch<0, true>> global_result = utils.reduce_aggregates<LeveledBatch<0, true>>(0, local_result, [](LeveledBatch<0, true>& a, LeveledBatch<0, true>& b) -> LeveledBatch<0, true> {
             return a + b;
-        });
+        }, reduction);
 
         program_ptr->stop_timer();
         program_ptr->print_stats();
@@ -22,8 +22,13 @@
 #ifndef MAGE_PROGRAMS_UTIL_HPP_
 #define MAGE_PROGRAMS_UTIL_HPP_
 
+#include <cstdlib>
+#include <iostream>
+#include <string>
 #include "dsl/leveledbatch.hpp"
 #include "dsl/integer.hpp"
+#include "dsl/parallel.hpp"
+#include "programs/registry.hpp"
 
 using namespace mage::dsl;
 
@@ -46,6 +51,27 @@ namespace mage::programs {
     template <std::uint32_t level>
     using LeveledPlaintextBatch = mage::dsl::LeveledPlaintextBatch<level, memprog::BinnedPlacer, default_program>;
 
+    /**
+     * @brief Determines how a program should reduce values across workers,
+     * based on the optional "reduction" field of the worker's configuration
+     * ("direct", "tree", or "doubling"). Defaults to a binomial tree.
+     */
+    inline Reduction get_reduction(const ProgramOptions& args) {
+        if (args.worker_config == nullptr || args.worker_config->get("reduction") == nullptr) {
+            return Reduction::BinomialTree;
+        }
+        const std::string& name = (*args.worker_config)["reduction"].as_string();
+        if (name == "direct") {
+            return Reduction::Direct;
+        } else if (name == "tree") {
+            return Reduction::BinomialTree;
+        } else if (name == "doubling") {
+            return Reduction::RecursiveDoubling;
+        }
+        std::cerr << "Unknown reduction \"" << name << "\" (try \"direct\", \"tree\", or \"doubling\")" << std::endl;
+        std::abort();
+    }
+
     template <BitWidth width = 8>
     Integer<2 * width> dot_product(Integer<width>* vector_a, Integer<width>* vector_b, std::size_t length) {
         assert(length != 0);
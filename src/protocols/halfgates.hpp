@@ -42,10 +42,10 @@ namespace mage::protocols::halfgates {
     constexpr const std::size_t halfgates_output_batch_size = 1 << 21; // number of output bits to buffer before completing a round and writing it to a file
 
     template <typename T>
-    class InputBatchPipe : public util::UserPipe<T> {
+    class InputBatchPipe : public util::SPSCUserPipe<T> {
     public:
         InputBatchPipe(std::size_t num_batches, std::size_t batch_length)
-            : util::UserPipe<T>(num_batches * batch_length), batch_size(batch_length), index_into_batch(0) {
+            : util::SPSCUserPipe<T>(num_batches * batch_length), batch_size(batch_length), index_into_batch(0) {
         }
 
         std::pair<std::size_t, bool> read_elements_until_end_of_batch(T* into, std::size_t count) {
@@ -97,6 +97,18 @@ namespace mage::protocols::halfgates {
     public:
         using Wire = HalfGatesGarbler::Wire;
 
+        /*
+         * The cost of garbling is the number of AND gates (XOR gates are
+         * free), so circuits should use as few AND gates as possible.
+         */
+        static constexpr bool low_depth_circuits = false;
+
+        /*
+         * Garbled gates are sent to the evaluator in the order in which they
+         * are garbled, so gates must be evaluated one at a time.
+         */
+        static constexpr bool concurrent_gates = false;
+
         HalfGatesGarblingEngine(const std::shared_ptr<engine::ClusterNetwork>& network,
             const char* input_file, const char* output_file, const char* evaluator_host,
             const char* evaluator_port, const OTInfo& oti)
@@ -250,6 +262,12 @@ namespace mage::protocols::halfgates {
     public:
         using Wire = HalfGatesEvaluator::Wire;
 
+        /* See HalfGatesGarblingEngine::low_depth_circuits. */
+        static constexpr bool low_depth_circuits = false;
+
+        /* See HalfGatesGarblingEngine::concurrent_gates. */
+        static constexpr bool concurrent_gates = false;
+
         HalfGatesEvaluationEngine(const char* input_file, const char* evaluator_port, const OTInfo& oti)
             : input_reader(input_file), sockets(oti.num_daemons + 1), conn_output_writer(this->conn_writer), input_daemon_threads(oti.num_daemons), evaluator_input_index(0),
             bits_left_in_output_batch(halfgates_output_batch_size) {
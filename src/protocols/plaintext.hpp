@@ -31,6 +31,12 @@ namespace mage::protocols::plaintext {
     public:
         using Wire = unsigned __int128;
 
+        /* Gates are cheap, so circuits should use as few gates as possible. */
+        static constexpr bool low_depth_circuits = false;
+
+        /* Gates are too cheap to be worth handing to other threads. */
+        static constexpr bool concurrent_gates = false;
+
         PlaintextEvaluationEngine(std::string garbler_input_file, std::string evaluator_input_file, std::string output_file)
             : garbler_input_reader(garbler_input_file.c_str()), evaluator_input_reader(evaluator_input_file.c_str()), output_writer(output_file.c_str()) {
         }
@@ -20,6 +20,10 @@
  */
 
 #include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
 #include "engine/andxor.hpp"
 #include "protocols/registry.hpp"
 #include "protocols/tfhe.hpp"
@@ -36,9 +40,21 @@ namespace mage::protocols::tfhe {
         std::chrono::time_point<std::chrono::steady_clock> end;
 
         util::Configuration& c = *args.config;
-        TFHEEngine p(garbler_input_file.c_str(), evaluator_input_file.c_str(), output_file.c_str());
+        const util::ConfigValue& worker = c["parties"][args.party_id]["workers"][args.self_id];
+
+        unsigned int gate_threads = 1;
+        if (worker.get("gate_threads") != nullptr) {
+            std::int64_t temp = worker["gate_threads"].as_int();
+            if (temp <= 0 || temp > UINT_MAX) {
+                std::cerr << "Specified \"gate_threads\" is " << temp << ", which is invalid" << std::endl;
+                std::abort();
+            }
+            gate_threads = static_cast<unsigned int>(temp);
+        }
+
+        TFHEEngine p(garbler_input_file.c_str(), evaluator_input_file.c_str(), output_file.c_str(), gate_threads);
         start = std::chrono::steady_clock::now();
-        engine::ANDXOREngine executor(args.cluster, c["parties"][args.party_id]["workers"][args.self_id], p, prog_file.c_str());
+        engine::ANDXOREngine executor(args.cluster, worker, p, prog_file.c_str());
         executor.execute_program();
         end = std::chrono::steady_clock::now();
         std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
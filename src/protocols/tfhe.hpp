@@ -28,10 +28,12 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <utility>
 #include "engine/cluster.hpp"
 #include "platform/network.hpp"
 #include "protocols/tfhe_scheme.hpp"
 #include "util/binaryfile.hpp"
+#include "util/threadpool.hpp"
 #include "util/userpipe.hpp"
 
 namespace mage::protocols::tfhe {
@@ -39,8 +41,27 @@ namespace mage::protocols::tfhe {
     public:
         using Wire = TFHEScheme::Wire;
 
-        TFHEEngine(const char* garbler_input_file, const char* evaluator_input_file, const char* output_file)
-            : garbler_input_reader(garbler_input_file, std::ios::binary), evaluator_input_reader(evaluator_input_file, std::ios::binary), output_writer(output_file, std::ios::binary) {
+        /*
+         * Every gate, including XOR, is bootstrapped, so the time to evaluate
+         * a circuit is determined by its depth rather than its number of AND
+         * gates, as long as independent gates are evaluated in parallel.
+         */
+        static constexpr bool low_depth_circuits = true;
+
+        /*
+         * Gates are evaluated locally and take milliseconds each, so
+         * independent gates are worth spreading across threads with
+         * parallel_for().
+         */
+        static constexpr bool concurrent_gates = true;
+
+        /*
+         * NUM_THREADS is the number of threads that evaluate gates. Values
+         * greater than 1 require a build of the TFHE library whose FFT
+         * processor can be used by multiple threads at once.
+         */
+        TFHEEngine(const char* garbler_input_file, const char* evaluator_input_file, const char* output_file, unsigned int num_threads = 1)
+            : tfhe(num_threads), pool(num_threads), garbler_input_reader(garbler_input_file, std::ios::binary), evaluator_input_reader(evaluator_input_file, std::ios::binary), output_writer(output_file, std::ios::binary) {
             {
                 std::ifstream params_file("params", std::ios::binary);
                 if (!params_file.is_open()) {
@@ -62,6 +83,17 @@ namespace mage::protocols::tfhe {
         void print_stats() {
         }
 
+        /*
+         * Invokes F on each integer from 0 to NUM_ITERATIONS - 1, evaluating
+         * their gates in parallel. The gate methods of this class may be
+         * called concurrently from within F, as long as the calls do not
+         * write wires that other calls read or write.
+         */
+        template <typename F>
+        void parallel_for(std::uint64_t num_iterations, F&& f) {
+            this->pool.parallel_for(num_iterations, std::forward<F>(f));
+        }
+
         void input(Wire* data, unsigned int length, bool garbler) {
             std::ifstream* reader_ptr = garbler ? &this->garbler_input_reader : &this->evaluator_input_reader;
             reader_ptr->read(reinterpret_cast<char*>(data), length * sizeof(Wire));
@@ -112,6 +144,7 @@ namespace mage::protocols::tfhe {
 
     private:
         TFHEScheme tfhe;
+        util::ThreadPool pool;
 
         std::ifstream garbler_input_reader;
         std::ifstream evaluator_input_reader;
@@ -22,34 +22,41 @@
 #ifndef MAGE_PROTOCOLS_TFHE_SCHEME_HPP_
 #define MAGE_PROTOCOLS_TFHE_SCHEME_HPP_
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <streambuf>
+#include <vector>
 #include <tfhe/tfhe.h>
 #include <tfhe/tfhe_io.h>
+#include "util/threadpool.hpp"
 
 namespace mage::protocols::tfhe {
     constexpr const std::size_t tfhe_ciphertext_size = 2536;
+    constexpr const int tfhe_lwe_dimension = 630;
     constexpr const int tfhe_num_temp_ciphertexts = 3;
 
+    /*
+     * A ciphertext, laid out as export_gate_bootstrapping_ciphertext_toStream
+     * writes it: a type tag followed by the fields of an LweSample. Gates read
+     * and write the coefficients in place, and input and output files hold
+     * ciphertexts in the same format, so no conversion is needed.
+     */
     struct TFHECiphertext {
-        std::uint8_t data[tfhe_ciphertext_size];
-    };
-
-    class TFHECiphertextReadBuffer : public std::streambuf {
-    public:
-        TFHECiphertextReadBuffer(const TFHECiphertext* ciphertext) {
-            char* base = reinterpret_cast<char*>(const_cast<std::uint8_t*>(&ciphertext->data[0]));
-            this->setg(base, base, base + sizeof(ciphertext->data));
-        }
+        std::int32_t type_uid;
+        Torus32 a[tfhe_lwe_dimension];
+        Torus32 b;
+        double current_variance;
     };
+    static_assert(sizeof(TFHECiphertext) == tfhe_ciphertext_size);
 
     class TFHECiphertextWriteBuffer : public std::streambuf {
     public:
         TFHECiphertextWriteBuffer(TFHECiphertext* ciphertext) {
-            char* base = reinterpret_cast<char*>(&ciphertext->data[0]);
-            this->setp(base, base + sizeof(ciphertext->data));
+            char* base = reinterpret_cast<char*>(ciphertext);
+            this->setp(base, base + sizeof(TFHECiphertext));
         }
     };
 
@@ -57,7 +64,13 @@ namespace mage::protocols::tfhe {
     public:
         using Wire = TFHECiphertext;
 
-        TFHEScheme() : params(nullptr), cloud_key(nullptr), ciphertexts(nullptr) {
+        /*
+         * Each of the NUM_THREADS threads with indices given by
+         * util::ThreadPool::current_index() gets its own temporary
+         * ciphertexts, so gates may be evaluated concurrently on them. The
+         * cloud key is only read by gates, so it is shared.
+         */
+        TFHEScheme(unsigned int num_threads = 1) : params(nullptr), cloud_key(nullptr), ciphertexts(nullptr), num_ciphertexts(std::max(num_threads, 1u) * tfhe_num_temp_ciphertexts) {
         }
 
         virtual ~TFHEScheme() {
@@ -75,46 +88,64 @@ namespace mage::protocols::tfhe {
                 std::cerr << "Out of memory (allocating TFHE params)" << std::endl;
                 std::abort();
             }
+            if (this->params->in_out_params->n != tfhe_lwe_dimension) {
+                std::cerr << "TFHE params have LWE dimension " << this->params->in_out_params->n << ", but only " << tfhe_lwe_dimension << " is supported" << std::endl;
+                std::abort();
+            }
 
-            this->ciphertexts = new_gate_bootstrapping_ciphertext_array(tfhe_num_temp_ciphertexts, this->params);
+            this->ciphertexts = new_gate_bootstrapping_ciphertext_array(this->num_ciphertexts, this->params);
             if (this->ciphertexts == nullptr) {
                 std::cerr << "Out of memory (allocating TFHE ciphertexts)" << std::endl;
                 std::abort();
             }
+            this->masks.resize(this->num_ciphertexts);
+            for (int i = 0; i != this->num_ciphertexts; i++) {
+                this->masks[i] = this->ciphertexts[i].a;
+            }
         }
 
         void set_cloud_key(std::istream& cloud_stream) {
             this->clear_cloud_key();
+            if (this->params == nullptr) {
+                std::cerr << "TFHE params must be set before the cloud key" << std::endl;
+                std::abort();
+            }
 
             this->cloud_key = new_tfheGateBootstrappingCloudKeySet_fromStream(cloud_stream);
             if (this->cloud_key == nullptr) {
                 std::cerr << "Out of memory (allocating TFHE cloud key)" << std::endl;
                 std::abort();
             }
+
+            this->ciphertexts[0].a = this->masks[0];
+            for (int value = 0; value != 2; value++) {
+                bootsCONSTANT(&this->ciphertexts[0], value, this->cloud_key);
+                this->export_ciphertext(this->constants[value], &this->ciphertexts[0]);
+            }
         }
 
         void op_and(Wire& output, const Wire& input1, const Wire& input2) {
-            this->load_ciphertexts(input1, input2);
-            bootsAND(&this->ciphertexts[0], &this->ciphertexts[1], &this->ciphertexts[2], this->cloud_key);
-            this->unload_ciphertext(output);
+            LweSample* temps = this->thread_ciphertexts();
+            bootsAND(this->view(temps[0], output), this->view(temps[1], input1), this->view(temps[2], input2), this->cloud_key);
+            this->store(output, temps[0], input1);
         }
 
         void op_xor(Wire& output, const Wire& input1, const Wire& input2) {
-            this->load_ciphertexts(input1, input2);
-            bootsXOR(&this->ciphertexts[0], &this->ciphertexts[1], &this->ciphertexts[2], this->cloud_key);
-            this->unload_ciphertext(output);
+            LweSample* temps = this->thread_ciphertexts();
+            bootsXOR(this->view(temps[0], output), this->view(temps[1], input1), this->view(temps[2], input2), this->cloud_key);
+            this->store(output, temps[0], input1);
         }
 
         void op_not(Wire& output, const Wire& input) {
-            this->load_ciphertexts(input);
-            bootsNOT(&this->ciphertexts[0], &this->ciphertexts[1], this->cloud_key);
-            this->unload_ciphertext(output);
+            LweSample* temps = this->thread_ciphertexts();
+            bootsNOT(this->view(temps[0], output), this->view(temps[1], input), this->cloud_key);
+            this->store(output, temps[0], input);
         }
 
         void op_xnor(Wire& output, const Wire& input1, const Wire& input2) {
-            this->load_ciphertexts(input1, input2);
-            bootsXNOR(&this->ciphertexts[0], &this->ciphertexts[1], &this->ciphertexts[2], this->cloud_key);
-            this->unload_ciphertext(output);
+            LweSample* temps = this->thread_ciphertexts();
+            bootsXNOR(this->view(temps[0], output), this->view(temps[1], input1), this->view(temps[2], input2), this->cloud_key);
+            this->store(output, temps[0], input1);
         }
 
         void op_copy(Wire& output, const Wire& input) {
@@ -122,13 +153,11 @@ namespace mage::protocols::tfhe {
         }
 
         void one(Wire& output) {
-            bootsCONSTANT(&this->ciphertexts[0], 1, this->cloud_key);
-            this->unload_ciphertext(output);
+            output = this->constants[1];
         }
 
         void zero(Wire& output) {
-            bootsCONSTANT(&this->ciphertexts[0], 1, this->cloud_key);
-            this->unload_ciphertext(output);
+            output = this->constants[0];
         }
 
     private:
@@ -148,39 +177,61 @@ namespace mage::protocols::tfhe {
 
         void clear_ciphertexts() {
             if (this->ciphertexts != nullptr) {
-                delete_gate_bootstrapping_ciphertext_array(tfhe_num_temp_ciphertexts, this->ciphertexts);
+                /* Give back the masks that view() replaced before freeing them. */
+                for (int i = 0; i != this->num_ciphertexts; i++) {
+                    this->ciphertexts[i].a = this->masks[i];
+                }
+                delete_gate_bootstrapping_ciphertext_array(this->num_ciphertexts, this->ciphertexts);
                 this->ciphertexts = nullptr;
             }
         }
 
-        void write_ciphertext(Wire& into, LweSample* from) {
+        /*
+         * Serializes FROM into INTO. Only used to create the cached
+         * constants; it also checks that the library's serialization
+         * matches the layout of TFHECiphertext, which gates rely on.
+         */
+        void export_ciphertext(Wire& into, const LweSample* from) {
             TFHECiphertextWriteBuffer buffer(&into);
             std::ostream stream(&buffer);
             export_gate_bootstrapping_ciphertext_toStream(stream, from, this->params);
+            if (!stream || into.b != from->b || std::memcmp(into.a, from->a, sizeof(into.a)) != 0) {
+                std::cerr << "TFHE ciphertext serialization does not match TFHECiphertext" << std::endl;
+                std::abort();
+            }
         }
 
-        void read_ciphertext(LweSample* into, const Wire& from) {
-            TFHECiphertextReadBuffer buffer(&from);
-            std::istream stream(&buffer);
-            import_gate_bootstrapping_ciphertext_fromStream(stream, into, this->params);
-        }
-
-        void load_ciphertexts(const Wire& input1, const Wire& input2) {
-            this->read_ciphertext(&this->ciphertexts[1], input1);
-            this->read_ciphertext(&this->ciphertexts[2], input2);
+        LweSample* thread_ciphertexts() {
+            return &this->ciphertexts[util::ThreadPool::current_index() * tfhe_num_temp_ciphertexts];
         }
 
-        void load_ciphertexts(const Wire& input1) {
-            this->read_ciphertext(&this->ciphertexts[1], input1);
+        /*
+         * Points TEMP at the coefficients of WIRE, so that a gate reading or
+         * writing TEMP does so in place.
+         */
+        LweSample* view(LweSample& temp, const Wire& wire) {
+            temp.a = const_cast<Torus32*>(&wire.a[0]);
+            temp.b = wire.b;
+            temp.current_variance = wire.current_variance;
+            return &temp;
         }
 
-        void unload_ciphertext(Wire& output) {
-            this->write_ciphertext(output, &this->ciphertexts[0]);
+        /*
+         * Finishes writing the output of a gate, whose mask coefficients were
+         * written in place through TEMP.
+         */
+        void store(Wire& output, const LweSample& temp, const Wire& input) {
+            output.type_uid = input.type_uid;
+            output.b = temp.b;
+            output.current_variance = temp.current_variance;
         }
 
         TFheGateBootstrappingParameterSet* params;
         TFheGateBootstrappingCloudKeySet* cloud_key;
         LweSample* ciphertexts;
+        int num_ciphertexts;
+        std::vector<Torus32*> masks;
+        Wire constants[2];
     };
 }
 
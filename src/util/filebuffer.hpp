@@ -548,6 +548,20 @@ namespace mage::util {
             return &this->buffer.mapping()[this->position];
         }
 
+        /**
+         * @brief Checks if the stream has been read to the end of the
+         * underlying file.
+         *
+         * If no data is buffered, this reads from the underlying file
+         * descriptor, which may block if it is a pipe or socket.
+         *
+         * @return True if all data in the stream has been read, otherwise
+         * false.
+         */
+        bool at_end() {
+            return this->position == this->active_size && !this->rebuffer();
+        }
+
         /**
          * @brief Advances the stream by the specified number of bytes.
          *
@@ -568,6 +582,51 @@ namespace mage::util {
             this->position += actual_size;
         }
 
+        /**
+         * @brief Copies the next @p length bytes of the stream into the
+         * provided destination and advances the stream past them.
+         *
+         * Any data already in the internal buffer is copied out first. The
+         * remainder is read from the underlying file descriptor directly into
+         * the destination, without staging it in the internal buffer; data
+         * that arrives past the end of the item is placed in the internal
+         * buffer as part of the same system call. Unlike start_read(), the
+         * item may be larger than the internal buffer.
+         *
+         * Calling this function may invalidate any prior references or
+         * pointers obtained by calling read() or start_read().
+         *
+         * @param into The memory into which to copy the data.
+         * @param length The number of bytes to read.
+         * @return True if @p length bytes were read, or false if the
+         * end-of-file condition was reached first.
+         */
+        bool read_into(void* into, std::size_t length) {
+            static_assert(!backwards_readable);
+            std::uint8_t* dest = static_cast<std::uint8_t*>(into);
+            std::uint8_t* mapping = this->buffer.mapping();
+
+            std::size_t buffered = std::min(length, this->active_size - this->position);
+            std::copy(&mapping[this->position], &mapping[this->position + buffered], dest);
+            this->position += buffered;
+            if (buffered == length) {
+                return true;
+            }
+
+            if (this->use_stats) {
+                auto start = std::chrono::steady_clock::now();
+
+                bool rv = this->_read_into_directly(&dest[buffered], length - buffered);
+
+                auto end = std::chrono::steady_clock::now();
+                this->stats.event(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+                return rv;
+            } else {
+                return this->_read_into_directly(&dest[buffered], length - buffered);
+            }
+        }
+
         /**
          * @brief Refreshes the in-memory buffer by reading from the underlying
          * file descriptor.
@@ -624,6 +683,39 @@ namespace mage::util {
             return rv != 0;
         }
 
+        /* Assumes that the internal buffer has been drained. */
+        bool _read_into_directly(std::uint8_t* dest, std::size_t length) {
+            if (this->progress_bar != nullptr) {
+                this->progress_bar->advance(this->position);
+            }
+            std::uint8_t* mapping = this->buffer.mapping();
+            this->position = 0;
+            this->active_size = 0;
+            while (length != 0) {
+                std::size_t rv = platform::read_available_from_file_vectored(this->fd, dest, length, mapping, this->buffer.size());
+                if (rv == 0) {
+                    return false;
+                }
+                if (this->progress_bar != nullptr) {
+                    this->progress_bar->advance(std::min(rv, length));
+                }
+                if (this->readahead_pos != -1) {
+                    this->readahead_pos += rv;
+                }
+                if (rv > length) {
+                    this->active_size = rv - length;
+                    length = 0;
+                } else {
+                    dest += rv;
+                    length -= rv;
+                }
+            }
+            if (this->readahead_pos != -1) {
+                platform::prefetch_from_file_at(this->fd, this->readahead_pos, this->buffer.size());
+            }
+            return true;
+        }
+
     protected:
         int fd;
         bool owns_fd;
@@ -751,6 +843,18 @@ namespace mage::util {
             return &mapping[this->position];
         }
 
+        /**
+         * @brief Obtains the offset in the underlying file just past the end
+         * of the next item in the stream (where "next" means "next in reverse
+         * order").
+         *
+         * @return The offset in the underlying file at which the stream is
+         * currently positioned.
+         */
+        std::uint64_t tell() const {
+            return this->length_left + this->position;
+        }
+
     private:
         /**
          * @brief Refreshes the in-memory buffer by reading from the underlying
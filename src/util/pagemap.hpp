@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file util/pagemap.hpp
+ * @brief Map data structure keyed by page number.
+ */
+
+#ifndef MAGE_UTIL_PAGEMAP_HPP_
+#define MAGE_UTIL_PAGEMAP_HPP_
+
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mage::util {
+    /**
+     * @brief A map data structure for keys that are integers, such as page
+     * numbers, that can be stored either as a hash table or as a flat array.
+     *
+     * Page numbers handed out by MAGE's placement stage are dense, so a
+     * flat array indexed by page number is much faster than a hash table, as
+     * long as there are few enough pages that the array fits in memory. The
+     * representation is chosen at runtime: a newly constructed map is a hash
+     * table, and calling @p make_dense while it is empty switches it to a
+     * flat array covering a fixed range of keys.
+     *
+     * @tparam K The type of keys in the map, which must be an integer type.
+     * Only nonnegative keys may be stored in a map with a flat array
+     * representation.
+     * @tparam V The type of values in the map. Values must be
+     * default-constructible, copy-constructible, and copy-assignable.
+     */
+    template <typename K, typename V>
+    class PageMap {
+    public:
+        /**
+         * @brief Creates an empty map represented as a hash table.
+         */
+        PageMap() : num_entries(0), dense(false) {
+        }
+
+        /**
+         * @brief Switches this map to a flat array representation that can
+         * hold the keys 0 to @p num_keys - 1.
+         *
+         * @pre The map is empty.
+         *
+         * @param num_keys One more than the largest key that will be stored
+         * in the map.
+         */
+        void make_dense(K num_keys) {
+            assert(this->num_entries == 0);
+            this->sparse.clear();
+            this->slots.resize(num_keys);
+            this->dense = true;
+        }
+
+        /**
+         * @brief Checks if this map is represented as a flat array.
+         *
+         * @return True if this map is represented as a flat array, or false
+         * if it is represented as a hash table.
+         */
+        bool is_dense() const {
+            return this->dense;
+        }
+
+        /**
+         * @brief Returns the number of elements (key-value pairs) in this
+         * map.
+         *
+         * @return The number of elements (key-value pairs) in this map.
+         */
+        std::uint64_t size() const {
+            return this->num_entries;
+        }
+
+        /**
+         * @brief Looks up the value corresponding to the specified key.
+         *
+         * @param key The key to look up.
+         * @return A pointer to the value corresponding to @p key, or nullptr
+         * if @p key is not in the map.
+         */
+        V* find(const K& key) {
+            if (this->dense) {
+                Slot& slot = this->slots[key];
+                return slot.present ? &slot.value : nullptr;
+            }
+            auto iter = this->sparse.find(key);
+            return iter == this->sparse.end() ? nullptr : &iter->second;
+        }
+
+        /**
+         * @brief Checks if an element with the specified key is present in
+         * the map.
+         *
+         * @param key The key whose presence to check for.
+         * @return True if an element with the specified key is present,
+         * otherwise false.
+         */
+        bool contains(const K& key) const {
+            if (this->dense) {
+                return this->slots[key].present;
+            }
+            return this->sparse.find(key) != this->sparse.end();
+        }
+
+        /**
+         * @brief Get the value corresponding to the specified key.
+         *
+         * @pre An element with the specified key is in the map.
+         *
+         * @param key The key to look up.
+         * @return A reference to the value corresponding to @p key.
+         */
+        V& at(const K& key) {
+            if (this->dense) {
+                assert(this->slots[key].present);
+                return this->slots[key].value;
+            }
+            return this->sparse.at(key);
+        }
+
+        /**
+         * @brief Inserts an element (key-value pair) into the map.
+         *
+         * @pre No element with the specified key is in the map.
+         *
+         * @param key The new element's key.
+         * @param value The new element's value.
+         * @return A reference to the value in the map.
+         */
+        V& insert(const K& key, const V& value) {
+            this->num_entries++;
+            if (this->dense) {
+                Slot& slot = this->slots[key];
+                assert(!slot.present);
+                slot.present = true;
+                slot.value = value;
+                return slot.value;
+            }
+            auto rv = this->sparse.insert(std::make_pair(key, value));
+            assert(rv.second);
+            return rv.first->second;
+        }
+
+        /**
+         * @brief Get the value corresponding to the specified key, inserting
+         * a default-constructed value if the key is not present.
+         *
+         * @param key The key to look up.
+         * @return A reference to the value corresponding to @p key.
+         */
+        V& operator [](const K& key) {
+            V* value = this->find(key);
+            if (value != nullptr) {
+                return *value;
+            }
+            return this->insert(key, V());
+        }
+
+        /**
+         * @brief Removes the element with the specified key, if any.
+         *
+         * @param key The key of the element to remove.
+         * @return True if an element was removed, otherwise false.
+         */
+        bool erase(const K& key) {
+            bool erased;
+            if (this->dense) {
+                Slot& slot = this->slots[key];
+                erased = slot.present;
+                slot.present = false;
+            } else {
+                erased = this->sparse.erase(key) != 0;
+            }
+            if (erased) {
+                this->num_entries--;
+            }
+            return erased;
+        }
+
+        /**
+         * @brief Invokes the specified function on each element (key-value
+         * pair) in the map, in an unspecified order.
+         *
+         * @param f The function to invoke, which is passed the key and a
+         * reference to the value of each element.
+         */
+        template <typename F>
+        void for_each(F f) {
+            if (this->dense) {
+                for (K key = 0; key != this->slots.size(); key++) {
+                    if (this->slots[key].present) {
+                        f(key, this->slots[key].value);
+                    }
+                }
+            } else {
+                for (auto& [key, value] : this->sparse) {
+                    f(key, value);
+                }
+            }
+        }
+
+    private:
+        struct Slot {
+            V value;
+            bool present = false;
+        };
+
+        std::unordered_map<K, V> sparse;
+        std::vector<Slot> slots;
+        std::uint64_t num_entries;
+        bool dense;
+    };
+}
+
+#endif
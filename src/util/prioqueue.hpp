@@ -30,8 +30,8 @@
 #include <cassert>
 #include <cstdint>
 #include <algorithm>
-#include <unordered_map>
 #include <vector>
+#include "util/pagemap.hpp"
 
 namespace mage::util {
     /**
@@ -46,10 +46,16 @@ namespace mage::util {
      * Multiple elements in the priority queue may have the same key, but no
      * two elements in the priority queue should have the same value.
      *
+     * The priority queue is implemented as a 4-ary heap. Compared to a
+     * binary heap, it is half as deep, so inserting or decreasing a key moves
+     * fewer elements, and the children of each node share a cache line or
+     * two, which makes removing the minimum cheaper than the extra
+     * comparisons would suggest.
+     *
      * @tparam K The type of keys in the priority queue. Keys must be
      * copy-constructible, copy-assignable, and comparable via the \< operator.
      * @tparam V The type of values in the priority queue. Values must be
-     * copy-constructible and copy-assignable.
+     * integers (see @p PageMap).
      */
     template <typename K, typename V>
     class PriorityQueue {
@@ -60,6 +66,19 @@ namespace mage::util {
         PriorityQueue() {
         }
 
+        /**
+         * @brief Switches the structure used to locate elements by value to
+         * a flat array, which is faster than the default hash table.
+         *
+         * @pre The priority queue is empty.
+         *
+         * @param num_values One more than the largest value that will be
+         * stored in the priority queue.
+         */
+        void make_dense(V num_values) {
+            this->locator.make_dense(num_values);
+        }
+
         /**
          * @brief Checks if this priority queue is empty.
          *
@@ -141,7 +160,13 @@ namespace mage::util {
                 return second;
             }
 
-            Index start = this->data[1].first < this->data[2].first ? 1 : 2;
+            Index start = 1;
+            Index end = std::min(arity + 1, newsize + 1);
+            for (Index j = 2; j < end; j++) {
+                if (this->data[j].first < this->data[start].first) {
+                    start = j;
+                }
+            }
             std::pair<K, V> second = this->data[start];
             this->locator.erase(second.second);
             if (start != newsize) {
@@ -173,10 +198,8 @@ namespace mage::util {
          * @param value The value of the element to be removed.
          */
         void erase(const V& value) {
-            auto iter = this->locator.find(value);
-            assert(iter != this->locator.end());
-            Index j = iter->second;
-            this->locator.erase(iter);
+            Index j = this->locator.at(value);
+            this->locator.erase(value);
 
             Index newsize = this->data.size() - 1;
             if (j != newsize) {
@@ -256,7 +279,7 @@ namespace mage::util {
          * otherwise false.
          */
         bool contains(const V& value) {
-            return this->locator.find(value) != this->locator.end();
+            return this->locator.contains(value);
         }
 
 
@@ -267,6 +290,11 @@ namespace mage::util {
          */
         using Index = std::uint64_t;
 
+        /**
+         * @brief The number of children of each node in the heap.
+         */
+        static constexpr Index arity = 4;
+
         /**
          * @brief Given the index of an element in the priority queue's
          * underlying array representation, find the index of the element's
@@ -280,37 +308,22 @@ namespace mage::util {
          */
         static Index parent(Index child) {
             assert(child != 0);
-            return ((child + 1) >> 1) - 1;
+            return (child - 1) / arity;
         }
 
         /**
          * @brief Given the index of an element in the priority queue's
          * underlying array representation, find the index of the element's
-         * left child.
+         * first child.
          *
-         * @pre The specified element is part of the priority queue and has a
-         * left child in the priority queue.
+         * The element's children, if any, are at consecutive indices starting
+         * at the returned index.
          *
          * @param parent The index of an element in the priority queue.
-         * @return The index of the element's left child.
+         * @return The index of the element's first child.
          */
-        static Index leftChild(Index parent) {
-            return ((parent + 1) << 1) - 1;
-        }
-
-        /**
-         * @brief Given the index of an element in the priority queue's
-         * underlying array representation, find the index of the element's
-         * right child.
-         *
-         * @pre The specified element is part of the priority queue and has a
-         * right child in the priority queue.
-         *
-         * @param parent The index of an element in the priority queue.
-         * @return The index of the element's right child.
-         */
-        static Index rightChild(Index parent) {
-            return (parent + 1) << 1;
+        static Index firstChild(Index parent) {
+            return parent * arity + 1;
         }
 
         /**
@@ -343,13 +356,14 @@ namespace mage::util {
          * @param key The key for the element whose insertion is considered.
          */
         Index bubbleDown(Index i, const K& key, Index size) {
-            Index left, right;
-            while ((left = (right = rightChild(i)) - 1) < size) {
-                Index chosen;
-                if (right == size || this->data[left].first < this->data[right].first) {
-                    chosen = left;
-                } else {
-                    chosen = right;
+            Index first;
+            while ((first = firstChild(i)) < size) {
+                Index chosen = first;
+                Index end = std::min(first + arity, size);
+                for (Index j = first + 1; j < end; j++) {
+                    if (this->data[j].first < this->data[chosen].first) {
+                        chosen = j;
+                    }
                 }
                 if (this->data[chosen].first < key) {
                     this->update(i, this->data[chosen]);
@@ -395,12 +409,11 @@ namespace mage::util {
          */
         void set(Index i, const std::pair<K, V>& item) {
             this->data[i] = item;
-            assert(this->locator.find(item.second) == this->locator.end());
-            this->locator[item.second] = i;
+            this->locator.insert(item.second, i);
         }
 
         std::vector<std::pair<K, V>> data;
-        std::unordered_map<V, Index> locator;
+        PageMap<V, Index> locator;
     };
 }
 
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2021 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file util/spinwait.hpp
+ * @brief Lock-free waiting for a condition, spinning briefly before blocking.
+ */
+
+#ifndef MAGE_UTIL_SPINWAIT_HPP_
+#define MAGE_UTIL_SPINWAIT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "platform/sync.hpp"
+
+namespace mage::util {
+    /**
+     * @brief Size of a cache line, used to pad data structures shared
+     * between threads so that independently-updated fields do not falsely
+     * share a cache line.
+     */
+    constexpr const std::size_t cache_line_size = 64;
+
+    /**
+     * @brief Hints to the processor that the calling thread is in a spin-wait
+     * loop.
+     */
+    inline void spin_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    /**
+     * @brief Allows a thread to wait for a condition, described by atomic
+     * variables, to become true, without a mutex or condition variable.
+     *
+     * The waiting thread first spins for a bounded number of iterations,
+     * which is enough to cover the common case where the condition becomes
+     * true shortly. Only after that does it block in the kernel (using a
+     * futex). The thread that makes the condition true calls notify(), which
+     * only makes a system call if a thread is actually blocked.
+     *
+     * The condition must be evaluated using atomic loads, and the thread that
+     * makes it true must do so (with atomic stores) before calling notify().
+     *
+     * A SpinWaiter may be placed in memory shared between processes, if it is
+     * created with @p process_shared set to true.
+     */
+    class SpinWaiter {
+    public:
+        /**
+         * @brief Creates a SpinWaiter with no blocked threads.
+         *
+         * @param process_shared True if the SpinWaiter will be used by
+         * multiple processes via shared memory, otherwise false.
+         */
+        SpinWaiter(bool process_shared = false) : sleeping(0), shared(process_shared) {
+        }
+
+        /**
+         * @brief Blocks until the provided predicate returns true.
+         *
+         * @tparam Predicate Type of the predicate.
+         * @param ready The predicate to wait for.
+         */
+        template <typename Predicate>
+        void wait_until(Predicate ready) {
+            for (std::uint32_t i = 0; i != SpinWaiter::max_spins; i++) {
+                if (ready()) {
+                    return;
+                }
+                spin_pause();
+            }
+            while (true) {
+                this->sleeping.store(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (ready()) {
+                    this->sleeping.store(0, std::memory_order_relaxed);
+                    return;
+                }
+                platform::futex_wait(this->sleeping, 1, this->shared);
+            }
+        }
+
+        /**
+         * @brief Wakes any thread blocked in wait_until(), so that it
+         * re-evaluates its predicate.
+         */
+        void notify() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (this->sleeping.load(std::memory_order_relaxed) != 0) {
+                this->sleeping.store(0, std::memory_order_relaxed);
+                platform::futex_wake_all(this->sleeping, this->shared);
+            }
+        }
+
+        /**
+         * @brief The number of times wait_until() checks the predicate before
+         * blocking.
+         */
+        static constexpr const std::uint32_t max_spins = 1 << 10;
+
+    private:
+        std::atomic<std::uint32_t> sleeping;
+        bool shared;
+    };
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2021 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2021 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file util/threadpool.hpp
+ * @brief Fixed-size pool of threads for data-parallel loops.
+ */
+
+#ifndef MAGE_UTIL_THREADPOOL_HPP_
+#define MAGE_UTIL_THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace mage::util {
+    /**
+     * @brief A fixed-size pool of threads that execute the iterations of a
+     * loop in parallel.
+     *
+     * The thread that calls parallel_for() takes part in executing the loop,
+     * so a pool of size N creates N - 1 additional threads. Iterations are
+     * handed out one at a time, which balances load well when each iteration
+     * is expensive (e.g., a bootstrapped FHE gate), but adds too much
+     * overhead for cheap iterations.
+     */
+    class ThreadPool {
+    public:
+        /**
+         * @brief Creates a thread pool of the specified size.
+         *
+         * @param num_threads The number of threads, including the thread
+         * that calls parallel_for(), that execute loop iterations. If this
+         * is 0 or 1, no threads are created and loops run serially.
+         */
+        ThreadPool(unsigned int num_threads) : iteration(nullptr), context(nullptr), count(0), next(0), num_busy(0), generation(0), stopping(false) {
+            for (unsigned int i = 1; i < num_threads; i++) {
+                this->threads.emplace_back(&ThreadPool::worker_loop, this, i);
+            }
+        }
+
+        /**
+         * @brief Stops and joins all threads in the pool.
+         */
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->stopping = true;
+            }
+            this->work_available.notify_all();
+            for (std::thread& thread : this->threads) {
+                thread.join();
+            }
+        }
+
+        /**
+         * @brief Returns the number of threads that execute loop iterations,
+         * including the thread that calls parallel_for().
+         *
+         * @return The number of threads that execute loop iterations.
+         */
+        unsigned int size() const {
+            return this->threads.size() + 1;
+        }
+
+        /**
+         * @brief Returns the index, within its pool, of the calling thread.
+         *
+         * Indices range from 0 to size() - 1. Threads not created by a
+         * thread pool, including those that call parallel_for(), have index
+         * 0. This is useful for indexing per-thread scratch space.
+         *
+         * @return The index of the calling thread.
+         */
+        static unsigned int current_index() {
+            return ThreadPool::thread_index;
+        }
+
+        /**
+         * @brief Invokes the provided function on each integer from 0 to
+         * @p num_iterations - 1, in parallel, and waits for all invocations
+         * to complete.
+         *
+         * @pre No other call to parallel_for() on this pool is in progress.
+         *
+         * @tparam F Type of the function to invoke.
+         * @param num_iterations The number of iterations.
+         * @param f The function to invoke, which is passed the index of the
+         * iteration.
+         */
+        template <typename F>
+        void parallel_for(std::uint64_t num_iterations, F&& f) {
+            if (this->threads.empty() || num_iterations < 2) {
+                for (std::uint64_t i = 0; i != num_iterations; i++) {
+                    f(i);
+                }
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->iteration = [](void* context, std::uint64_t i) {
+                    (*static_cast<std::remove_reference_t<F>*>(context))(i);
+                };
+                this->context = &f;
+                this->count = num_iterations;
+                this->next.store(0, std::memory_order_relaxed);
+                this->num_busy = this->threads.size();
+                this->generation++;
+            }
+            this->work_available.notify_all();
+
+            this->run_iterations();
+
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->work_done.wait(guard, [this]() { return this->num_busy == 0; });
+        }
+
+    private:
+        void run_iterations() {
+            for (std::uint64_t i = this->next.fetch_add(1, std::memory_order_relaxed); i < this->count; i = this->next.fetch_add(1, std::memory_order_relaxed)) {
+                this->iteration(this->context, i);
+            }
+        }
+
+        void worker_loop(unsigned int index) {
+            ThreadPool::thread_index = index;
+            std::uint64_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> guard(this->lock);
+                    this->work_available.wait(guard, [this, seen]() { return this->stopping || this->generation != seen; });
+                    if (this->stopping) {
+                        return;
+                    }
+                    seen = this->generation;
+                }
+
+                this->run_iterations();
+
+                std::lock_guard<std::mutex> guard(this->lock);
+                if (--this->num_busy == 0) {
+                    this->work_done.notify_one();
+                }
+            }
+        }
+
+        static inline thread_local unsigned int thread_index = 0;
+
+        std::mutex lock;
+        std::condition_variable work_available;
+        std::condition_variable work_done;
+        void (*iteration)(void*, std::uint64_t);
+        void* context;
+        std::uint64_t count;
+        std::atomic<std::uint64_t> next;
+        std::size_t num_busy;
+        std::uint64_t generation;
+        bool stopping;
+        std::vector<std::thread> threads;
+    };
+}
+
+#endif
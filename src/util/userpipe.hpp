@@ -27,10 +27,16 @@
 #ifndef MAGE_UTIL_USERPIPE_HPP_
 #define MAGE_UTIL_USERPIPE_HPP_
 
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include "platform/memory.hpp"
 #include "util/circbuffer.hpp"
+#include "util/spinwait.hpp"
 
 namespace mage::util {
     /**
@@ -96,7 +102,7 @@ namespace mage::util {
             while (this->get_space_occupied() < count && !this->closed) {
                 this->added.wait(lock);
             }
-            std::size_t to_read = std::min(this->get_space_occupcied(), count);
+            std::size_t to_read = std::min(this->get_space_occupied(), count);
             this->read_unchecked(elements, to_read);
             this->removed.notify_all();
             return to_read;
@@ -275,6 +281,236 @@ namespace mage::util {
         std::condition_variable removed;
         bool closed;
     };
+
+    /**
+     * @brief A lock-free variant of UserPipe that supports exactly one
+     * reading thread and one writing thread.
+     *
+     * UserPipe acquires a mutex and signals a condition variable on every
+     * operation, even if the other side is not waiting. For pipes with a
+     * single producer and a single consumer, that is unnecessary: each index
+     * into the buffer is written by only one thread, so it suffices to
+     * publish it with release semantics and read it with acquire semantics.
+     * A thread that finds the pipe empty (or full) spins briefly and then
+     * blocks in the kernel, and is woken only if it actually blocked.
+     *
+     * The read and write indices are kept on separate cache lines, and each
+     * side caches the last value of the other side's index that it saw, so
+     * that in the steady state, the two threads do not contend on a cache
+     * line.
+     *
+     * SPSCUserPipe provides the same interface as UserPipe, except for the
+     * functions that expose UserPipe's internal lock, so a pipe that is known
+     * to have a single producer and a single consumer can be switched over by
+     * changing its type.
+     *
+     * The type @p T of elements is subject to the same constraints as for
+     * CircularBuffer.
+     *
+     * @tparam T The type of each element (datum) in the buffer.
+     */
+    template <typename T>
+    class SPSCUserPipe {
+    public:
+        /**
+         * @brief Creates a single-producer single-consumer user pipe.
+         *
+         * @param capacity Number of data elements that can be held.
+         */
+        SPSCUserPipe(std::size_t capacity) : data(sizeof(T) * capacity, false), capacity(capacity),
+            num_read(0), read_index(0), known_written(0), num_written(0), write_index(0), known_read(0), closed(false) {
+        }
+
+        /**
+         * @brief Disallows further writes to the pipe.
+         *
+         * Reads can still get what was previously written to the pipe, but
+         * they will no longer block waiting for more data. Must be called by
+         * the writing thread.
+         */
+        void close() {
+            this->closed.store(true, std::memory_order_release);
+            this->added.notify();
+            this->removed.notify();
+        }
+
+        /**
+         * @brief Reads and removes data elements from the pipe, first waiting
+         * until the pipe contains the required number of data elements.
+         *
+         * Must be called by the reading thread. The read data elements are
+         * copied into the @p elements array. If the pipe is closed before the
+         * required number of data elements are present, then all elements
+         * remaining in the pipe are read.
+         *
+         * @param[out] elements The array into which to copy the read elements.
+         * @param count The number of elements to read and remove.
+         * @return The number of elements actually read (could be less than
+         * @p count if the pipe is closed concurrently with the read).
+         */
+        std::size_t read_contiguous(T* elements, std::size_t count) {
+            if (this->start_read_in_place(count) == nullptr) {
+                count = this->known_written - this->num_read.load(std::memory_order_relaxed);
+            }
+            const T* buffer = this->data.mapping();
+            std::size_t until_end = this->capacity - this->read_index;
+            if (until_end <= count) {
+                std::copy(&buffer[this->read_index], &buffer[this->capacity], &elements[0]);
+                std::copy(&buffer[0], &buffer[count - until_end], &elements[until_end]);
+            } else {
+                std::copy(&buffer[this->read_index], &buffer[this->read_index + count], &elements[0]);
+            }
+            this->finish_read_in_place(count);
+            return count;
+        }
+
+        /**
+         * @brief Adds the provided data elements to the pipe, first waiting
+         * until the pipe has enough free space for the added data elements.
+         *
+         * Must be called by the writing thread. If the pipe has been closed,
+         * then no data elements are added.
+         *
+         * @param[in] elements The array storing the elements to add.
+         * @param count The number of elements to add.
+         * @return True if the elements were added, or false if they were not.
+         */
+        bool write_contiguous(const T* elements, std::size_t count) {
+            if (this->start_write_in_place(count) == nullptr) {
+                return false;
+            }
+            T* buffer = this->data.mapping();
+            std::size_t until_end = this->capacity - this->write_index;
+            if (until_end <= count) {
+                std::copy(&elements[0], &elements[until_end], &buffer[this->write_index]);
+                std::copy(&elements[until_end], &elements[count], &buffer[0]);
+            } else {
+                std::copy(&elements[0], &elements[count], &buffer[this->write_index]);
+            }
+            this->finish_write_in_place(count);
+            return true;
+        }
+
+        /**
+         * @brief Waits for @p amount elements to become available in the pipe,
+         * and then provides a pointer to the oldest element in the pipe, so
+         * that elements can be read without copying them.
+         *
+         * Must be called by the reading thread. The same caveats apply as for
+         * UserPipe::start_read_in_place().
+         *
+         * @return A pointer to the space in the pipe's internal memory for the
+         * next element to be read, or a null pointer if the pipe is closed
+         * before @p amount elements are available in the pipe.
+         */
+        const T* start_read_in_place(std::size_t amount) {
+            if (this->known_written - this->num_read.load(std::memory_order_relaxed) < amount) {
+                this->known_written = this->num_written.load(std::memory_order_acquire);
+                if (this->known_written - this->num_read.load(std::memory_order_relaxed) < amount) {
+                    this->added.wait_until([this, amount]() {
+                        return this->num_written.load(std::memory_order_acquire) - this->num_read.load(std::memory_order_relaxed) >= amount
+                            || this->closed.load(std::memory_order_acquire);
+                    });
+                    this->known_written = this->num_written.load(std::memory_order_acquire);
+                    if (this->known_written - this->num_read.load(std::memory_order_relaxed) < amount) {
+                        return nullptr;
+                    }
+                }
+            }
+            return &this->data.mapping()[this->read_index];
+        }
+
+        /**
+         * @brief Removes elements from the pipe in place, without copying
+         * them.
+         *
+         * Must be called by the reading thread.
+         *
+         * @pre There are at least @p amount elements in the pipe.
+         * @post The @p amount oldest elements in the pipe are removed, and any
+         * other elements in the pipe remain.
+         *
+         * @param amount The number of elements to remove from the pipe.
+         */
+        void finish_read_in_place(std::size_t amount) {
+            std::uint64_t new_num_read = this->num_read.load(std::memory_order_relaxed) + amount;
+            assert(new_num_read <= this->known_written);
+            this->read_index += amount;
+            if (this->capacity <= this->read_index) {
+                this->read_index -= this->capacity;
+            }
+            this->num_read.store(new_num_read, std::memory_order_release);
+            this->removed.notify();
+        }
+
+        /**
+         * @brief Waits for @p amount elements of free space to become
+         * available, and then provides a pointer to space in the pipe's
+         * internal buffer for writing @p elements.
+         *
+         * Must be called by the writing thread. The same caveats apply as for
+         * UserPipe::start_write_in_place().
+         *
+         * @return A pointer to the space in the pipe's internal memory where
+         * the next written element would be stored, or a null pointer if
+         * the pipe is closed before free space for @p elements is available.
+         */
+        T* start_write_in_place(std::size_t amount) {
+            if (this->closed.load(std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            if (this->capacity - (this->num_written.load(std::memory_order_relaxed) - this->known_read) < amount) {
+                this->known_read = this->num_read.load(std::memory_order_acquire);
+                if (this->capacity - (this->num_written.load(std::memory_order_relaxed) - this->known_read) < amount) {
+                    this->removed.wait_until([this, amount]() {
+                        return this->capacity - (this->num_written.load(std::memory_order_relaxed) - this->num_read.load(std::memory_order_acquire)) >= amount;
+                    });
+                    this->known_read = this->num_read.load(std::memory_order_acquire);
+                }
+            }
+            return &this->data.mapping()[this->write_index];
+        }
+
+        /**
+         * @brief Adds elements to the pipe in place, without copying them.
+         *
+         * Must be called by the writing thread.
+         *
+         * @pre There is space for at least @p amount elements in the pipe.
+         * @post The next @p amount elements in the pipe's internal memory are
+         * added to the pipe.
+         *
+         * @param amount The number of elements to add to the pipe.
+         */
+        void finish_write_in_place(std::size_t amount = 1) {
+            std::uint64_t new_num_written = this->num_written.load(std::memory_order_relaxed) + amount;
+            assert(new_num_written - this->known_read <= this->capacity);
+            this->write_index += amount;
+            if (this->capacity <= this->write_index) {
+                this->write_index -= this->capacity;
+            }
+            this->num_written.store(new_num_written, std::memory_order_release);
+            this->added.notify();
+        }
+
+    private:
+        platform::MappedFile<T> data;
+        std::size_t capacity;
+
+        /* Owned by the reading thread. */
+        alignas(cache_line_size) std::atomic<std::uint64_t> num_read;
+        std::size_t read_index;
+        std::uint64_t known_written;
+
+        /* Owned by the writing thread. */
+        alignas(cache_line_size) std::atomic<std::uint64_t> num_written;
+        std::size_t write_index;
+        std::uint64_t known_read;
+
+        alignas(cache_line_size) std::atomic<bool> closed;
+        alignas(cache_line_size) SpinWaiter added;
+        alignas(cache_line_size) SpinWaiter removed;
+    };
 }
 
 #endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file util/varint.hpp
+ * @brief Variable-length encoding of integers.
+ *
+ * Integers are encoded seven bits at a time, least significant bits first.
+ * The high bit of each byte is set if more bytes follow. Small integers
+ * therefore take up fewer bytes.
+ */
+
+#ifndef MAGE_UTIL_VARINT_HPP_
+#define MAGE_UTIL_VARINT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mage::util {
+    /**
+     * @brief The maximum number of bytes needed to encode an integer with the
+     * specified number of significant bits.
+     *
+     * @param bits The number of significant bits.
+     * @return The maximum size of the encoding, in bytes.
+     */
+    constexpr std::size_t max_varint_size(std::size_t bits) {
+        return (bits + 6) / 7;
+    }
+
+    /**
+     * @brief Encodes an unsigned integer into the specified buffer.
+     *
+     * @param value The integer to encode.
+     * @param into The buffer into which to write the encoding, which must
+     * have space for at least max_varint_size(64) bytes.
+     * @return The number of bytes written to @p into.
+     */
+    inline std::size_t encode_varint(std::uint64_t value, std::uint8_t* into) {
+        std::size_t i = 0;
+        while (value >= 0x80) {
+            into[i++] = static_cast<std::uint8_t>(value) | 0x80;
+            value >>= 7;
+        }
+        into[i++] = static_cast<std::uint8_t>(value);
+        return i;
+    }
+
+    /**
+     * @brief Computes the size of the encoding of an unsigned integer.
+     *
+     * @param value The integer to encode.
+     * @return The number of bytes that encode_varint() would write.
+     */
+    constexpr std::size_t varint_size(std::uint64_t value) {
+        std::size_t size = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    /**
+     * @brief Decodes an unsigned integer from the specified buffer.
+     *
+     * @param from The buffer containing the encoding.
+     * @param[out] value Populated with the decoded integer.
+     * @return The number of bytes read from @p from.
+     */
+    inline std::size_t decode_varint(const std::uint8_t* from, std::uint64_t& value) {
+        std::size_t i = 0;
+        unsigned int shift = 0;
+        value = 0;
+        while ((from[i] & 0x80) != 0) {
+            value |= static_cast<std::uint64_t>(from[i++] & 0x7F) << shift;
+            shift += 7;
+        }
+        value |= static_cast<std::uint64_t>(from[i++]) << shift;
+        return i;
+    }
+
+    /**
+     * @brief Maps a signed integer to an unsigned integer so that integers
+     * with small magnitude, whether positive or negative, have short varint
+     * encodings.
+     *
+     * @param value The signed integer.
+     * @return The corresponding unsigned integer.
+     */
+    constexpr std::uint64_t zigzag_encode(std::int64_t value) {
+        return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    }
+
+    /**
+     * @brief Inverts @p zigzag_encode.
+     *
+     * @param value The unsigned integer.
+     * @return The corresponding signed integer.
+     */
+    constexpr std::int64_t zigzag_decode(std::uint64_t value) {
+        return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 0x1);
+    }
+}
+
+#endif
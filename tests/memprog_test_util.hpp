@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Helpers shared by the tests of the passes over virtual bytecode. Include
+ * this after boost/test/unit_test.hpp.
+ */
+
+#ifndef MAGE_TESTS_MEMPROG_TEST_UTIL_HPP_
+#define MAGE_TESTS_MEMPROG_TEST_UTIL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+
+namespace mage::test {
+    inline Instruction make_instruction(OpCode op, std::uint64_t output, std::uint64_t input1 = 0, std::uint64_t input2 = 0, std::uint8_t flags = 0, std::uint64_t width = 8) {
+        Instruction instr;
+        instr.header.operation = op;
+        instr.header.width = width;
+        instr.header.flags = flags;
+        instr.header.output = output;
+        instr.two_args.input1 = input1;
+        instr.two_args.input2 = input2;
+        return instr;
+    }
+
+    /*
+     * Names the input and output programs of a pass in the working directory,
+     * and removes them when it goes out of scope, even if the test fails
+     * partway through.
+     */
+    struct PassPrograms {
+        PassPrograms(const std::string& name) : input(name + ".prog"), output(name + ".out.prog") {
+        }
+
+        ~PassPrograms() {
+            std::remove(this->input.c_str());
+            std::remove(this->output.c_str());
+        }
+
+        std::string input;
+        std::string output;
+    };
+
+    /*
+     * Reads back the program in FILENAME, which must contain NUM_INSTRUCTIONS
+     * instructions, calling F with the index of each instruction and the
+     * instruction itself. Returns the program's header.
+     */
+    template <typename F>
+    ProgramFileHeader read_program(const std::string& filename, std::size_t num_instructions, F f) {
+        VirtProgramFileReader reader(filename);
+        BOOST_REQUIRE(reader.get_header().num_instructions == num_instructions);
+        for (std::size_t i = 0; i != num_instructions; i++) {
+            PackedVirtInstruction& instr = reader.start_instruction();
+            f(i, instr);
+            reader.finish_instruction(instr.size());
+        }
+        return reader.get_header();
+    }
+}
+
+#endif
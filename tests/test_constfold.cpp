@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "addr.hpp"
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+#include "memprog/constfold.hpp"
+#include "memprog_test_util.hpp"
+
+using mage::FlagInput1Constant;
+using mage::FlagInput2Constant;
+using mage::FlagOutputPageFirstUse;
+using mage::Instruction;
+using mage::OpCode;
+using mage::PackedVirtInstruction;
+using mage::VirtProgramFileWriter;
+using mage::test::PassPrograms;
+using mage::test::make_instruction;
+using mage::test::read_program;
+
+static Instruction make_constant(std::uint64_t output, std::uint64_t constant, std::uint8_t flags = 0) {
+    Instruction instr;
+    instr.header.operation = OpCode::PublicConstant;
+    instr.header.width = 8;
+    instr.header.flags = flags;
+    instr.header.output = output;
+    instr.constant.constant = constant;
+    return instr;
+}
+
+BOOST_AUTO_TEST_CASE(test_fold_constants) {
+    PassPrograms programs("test_constfold");
+    {
+        /* Pages are 16 units; the input is on page 0 and constants on page 1. */
+        VirtProgramFileWriter writer(programs.input, 4, 4);
+        writer.append_instruction(make_instruction(OpCode::Input, 0, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_constant(16, 0xFF, FlagOutputPageFirstUse));
+        writer.append_instruction(make_constant(24, 0x00));
+        writer.append_instruction(make_instruction(OpCode::BitAND, 32, 0, 16, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::BitXOR, 40, 16, 0));
+        writer.append_instruction(make_instruction(OpCode::IntAdd, 16, 16, 24));
+        writer.append_instruction(make_instruction(OpCode::IntMultiply, 48, 0, 16, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::Output, 48));
+    }
+
+    mage::memprog::ConstantFoldingStats stats;
+    BOOST_REQUIRE(mage::memprog::fold_constants(programs.output, programs.input, 4, nullptr, false, stats));
+    BOOST_CHECK(stats.num_folded_constants == 1);
+    BOOST_CHECK(stats.num_folded_copies == 2);
+    BOOST_CHECK(stats.num_constant_operands == 1);
+
+    std::vector<OpCode> expected = { OpCode::Input, OpCode::PublicConstant, OpCode::PublicConstant, OpCode::Copy, OpCode::BitNOT, OpCode::PublicConstant, OpCode::IntMultiply, OpCode::Output };
+    std::vector<std::uint8_t> flags = { FlagOutputPageFirstUse, FlagOutputPageFirstUse, 0, FlagOutputPageFirstUse, 0, 0, FlagOutputPageFirstUse | FlagInput2Constant, 0 };
+    mage::ProgramFileHeader header = read_program(programs.output, expected.size(), [&](std::size_t i, PackedVirtInstruction& instr) {
+        BOOST_CHECK(instr.header.operation == expected[i]);
+        BOOST_CHECK(instr.header.flags == flags[i]);
+        if (i == 3 || i == 4) {
+            BOOST_CHECK(instr.one_arg.output == (i == 3 ? 32 : 40));
+            BOOST_CHECK(instr.one_arg.input1 == 0);
+        } else if (i == 5) {
+            BOOST_CHECK(instr.constant.output == 16);
+            BOOST_CHECK(instr.constant.constant == 0xFF);
+        }
+    });
+    BOOST_CHECK(header.num_pages == 4);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "addr.hpp"
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+#include "memprog/copyelision.hpp"
+#include "memprog_test_util.hpp"
+
+using mage::FlagOutputPageFirstUse;
+using mage::OpCode;
+using mage::PackedVirtInstruction;
+using mage::VirtProgramFileWriter;
+using mage::test::PassPrograms;
+using mage::test::make_instruction;
+using mage::test::read_program;
+
+BOOST_AUTO_TEST_CASE(test_elide_copies) {
+    PassPrograms programs("test_copyelision");
+    {
+        /* Pages are 16 units; the inputs live on page 0. */
+        VirtProgramFileWriter writer(programs.input, 4, 3);
+        writer.append_instruction(make_instruction(OpCode::Input, 0, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::Input, 8));
+        /* Its source is intact for all reads of its destination. */
+        writer.append_instruction(make_instruction(OpCode::Copy, 16, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::BitXOR, 32, 16, 8, FlagOutputPageFirstUse));
+        /* Its source is overwritten before its destination is read. */
+        writer.append_instruction(make_instruction(OpCode::Copy, 24, 8));
+        writer.append_instruction(make_instruction(OpCode::IntAdd, 8, 0, 0));
+        writer.append_instruction(make_instruction(OpCode::Output, 24));
+        /* Its destination is never overwritten. */
+        writer.append_instruction(make_instruction(OpCode::Copy, 40, 32));
+        writer.append_instruction(make_instruction(OpCode::Output, 40));
+        writer.append_instruction(make_instruction(OpCode::Output, 16));
+    }
+
+    mage::memprog::CopyElisionStats stats;
+    BOOST_REQUIRE(mage::memprog::elide_copies(programs.output, programs.input, 4, nullptr, false, stats));
+    BOOST_CHECK(stats.num_copies_elided == 2);
+    BOOST_CHECK(stats.num_units_not_copied == 16);
+
+    std::vector<OpCode> expected = { OpCode::Input, OpCode::Input, OpCode::BitXOR, OpCode::Copy, OpCode::IntAdd, OpCode::Output, OpCode::Output, OpCode::Output };
+    std::vector<std::uint64_t> output = { 0, 8, 32, 24, 8, 24, 32, 0 };
+    std::vector<std::uint64_t> input1 = { 0, 0, 0, 8, 0, 0, 0, 0 };
+    std::vector<bool> first_use = { true, false, true, true, false, false, false, false };
+    mage::ProgramFileHeader header = read_program(programs.output, expected.size(), [&](std::size_t i, PackedVirtInstruction& instr) {
+        BOOST_CHECK(instr.header.operation == expected[i]);
+        BOOST_CHECK(instr.no_args.output == output[i]);
+        if (expected[i] != OpCode::Input && expected[i] != OpCode::Output) {
+            BOOST_CHECK(instr.one_arg.input1 == input1[i]);
+        }
+        BOOST_CHECK(((instr.header.flags & FlagOutputPageFirstUse) != 0) == first_use[i]);
+    });
+    BOOST_CHECK(header.num_pages == 3);
+}
+
+BOOST_AUTO_TEST_CASE(test_elide_copies_output_overwrites_source) {
+    PassPrograms programs("test_copyelision_overwrite");
+    {
+        VirtProgramFileWriter writer(programs.input, 4, 3);
+        writer.append_instruction(make_instruction(OpCode::Input, 0, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::Input, 16, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::Copy, 32, 0, 0, FlagOutputPageFirstUse));
+        /* Reading the copy's source here would overlap the output. */
+        writer.append_instruction(make_instruction(OpCode::IntMultiply, 0, 32, 16));
+        writer.append_instruction(make_instruction(OpCode::Output, 0, 0, 0, 0, 16));
+    }
+
+    mage::memprog::CopyElisionStats stats;
+    BOOST_REQUIRE(mage::memprog::elide_copies(programs.output, programs.input, 4, nullptr, false, stats));
+    BOOST_CHECK(stats.num_copies_elided == 0);
+
+    std::vector<OpCode> expected = { OpCode::Input, OpCode::Input, OpCode::Copy, OpCode::IntMultiply, OpCode::Output };
+    read_program(programs.output, expected.size(), [&](std::size_t i, PackedVirtInstruction& instr) {
+        BOOST_CHECK(instr.header.operation == expected[i]);
+        if (expected[i] == OpCode::IntMultiply) {
+            BOOST_CHECK(instr.two_args.output == 0);
+            BOOST_CHECK(instr.two_args.input1 == 32);
+            BOOST_CHECK(instr.two_args.input2 == 16);
+        }
+    });
+}
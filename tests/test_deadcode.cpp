@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "addr.hpp"
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+#include "memprog/deadcode.hpp"
+#include "memprog_test_util.hpp"
+
+using mage::FlagOutputPageFirstUse;
+using mage::OpCode;
+using mage::PackedVirtInstruction;
+using mage::VirtProgramFileWriter;
+using mage::test::PassPrograms;
+using mage::test::make_instruction;
+using mage::test::read_program;
+
+BOOST_AUTO_TEST_CASE(test_eliminate_dead_instructions) {
+    PassPrograms programs("test_deadcode");
+    {
+        /* Pages are 16 units; the inputs live on page 0. */
+        VirtProgramFileWriter writer(programs.input, 4, 3);
+        writer.append_instruction(make_instruction(OpCode::Input, 0, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::Input, 8));
+        /* Never read. */
+        writer.append_instruction(make_instruction(OpCode::BitAND, 32, 0, 8, FlagOutputPageFirstUse));
+        /* Overwritten before being read. */
+        writer.append_instruction(make_instruction(OpCode::Copy, 16, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::IntAdd, 16, 0, 8));
+        /* Writes a single bit, which is all that is read. */
+        writer.append_instruction(make_instruction(OpCode::IsZero, 40, 16));
+        writer.append_instruction(make_instruction(OpCode::Output, 40, 0, 0, 0, 1));
+    }
+
+    std::uint64_t num_eliminated;
+    BOOST_REQUIRE(mage::memprog::eliminate_dead_instructions(programs.output, programs.input, 4, nullptr, false, num_eliminated));
+    BOOST_CHECK(num_eliminated == 2);
+
+    std::vector<OpCode> expected = { OpCode::Input, OpCode::Input, OpCode::IntAdd, OpCode::IsZero, OpCode::Output };
+    std::vector<bool> first_use = { true, false, true, true, false };
+    mage::ProgramFileHeader header = read_program(programs.output, expected.size(), [&](std::size_t i, PackedVirtInstruction& instr) {
+        BOOST_CHECK(instr.header.operation == expected[i]);
+        BOOST_CHECK(((instr.header.flags & FlagOutputPageFirstUse) != 0) == first_use[i]);
+    });
+    BOOST_CHECK(header.num_pages == 3);
+}
+
+BOOST_AUTO_TEST_CASE(test_eliminate_dead_cond_swaps) {
+    PassPrograms programs("test_deadcode_swap");
+    {
+        VirtProgramFileWriter writer(programs.input, 4, 2);
+        writer.append_instruction(make_instruction(OpCode::Input, 0, 0, 0, FlagOutputPageFirstUse));
+        writer.append_instruction(make_instruction(OpCode::Input, 8));
+        writer.append_instruction(make_instruction(OpCode::IntLess, 16, 0, 8, FlagOutputPageFirstUse));
+        /* Only the first input, which is updated in place, is read. */
+        writer.append_instruction(make_instruction(OpCode::CondSwap, 0, 8, 16));
+        writer.append_instruction(make_instruction(OpCode::Output, 8));
+        /* Neither operand is read. */
+        writer.append_instruction(make_instruction(OpCode::CondSwap, 0, 8, 16));
+    }
+
+    std::uint64_t num_eliminated;
+    BOOST_REQUIRE(mage::memprog::eliminate_dead_instructions(programs.output, programs.input, 4, nullptr, false, num_eliminated));
+    BOOST_CHECK(num_eliminated == 1);
+
+    std::vector<OpCode> expected = { OpCode::Input, OpCode::Input, OpCode::IntLess, OpCode::CondSwap, OpCode::Output };
+    read_program(programs.output, expected.size(), [&](std::size_t i, PackedVirtInstruction& instr) {
+        BOOST_CHECK(instr.header.operation == expected[i]);
+    });
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "addr.hpp"
+#include "memprog/placement.hpp"
+
+using mage::VirtAddr;
+using mage::memprog::BinnedPlacer;
+using mage::memprog::LifetimeProfile;
+
+/*
+ * Interleaves allocations that are never deallocated with temporaries, as a
+ * sort does with its output and the intermediate values of comparisons.
+ */
+static void place_interleaved(BinnedPlacer& placer, std::vector<VirtAddr>& immortal) {
+    bool fresh_page;
+    VirtAddr previous = placer.allocate_virtual(8, fresh_page);
+    for (int i = 0; i != 64; i++) {
+        immortal.push_back(placer.allocate_virtual(8, fresh_page));
+        VirtAddr temporary = placer.allocate_virtual(8, fresh_page);
+        placer.deallocate_virtual(previous, 8);
+        previous = temporary;
+    }
+    placer.deallocate_virtual(previous, 8);
+}
+
+BOOST_AUTO_TEST_CASE(test_lifetime_hints_separate_pages) {
+    LifetimeProfile profile;
+    std::vector<VirtAddr> unhinted;
+    BinnedPlacer recorder(6);
+    recorder.record_lifetimes(&profile);
+    place_interleaved(recorder, unhinted);
+
+    BOOST_CHECK(!profile.is_immortal(0));
+    BOOST_CHECK(profile.is_immortal(1));
+    BOOST_CHECK(!profile.is_immortal(2));
+    BOOST_CHECK(unhinted[1] != unhinted[0] + 8);
+
+    std::vector<VirtAddr> hinted;
+    BinnedPlacer placer(6);
+    placer.use_lifetime_hints(&profile);
+    place_interleaved(placer, hinted);
+
+    /* Immortal allocations must not share pages with temporaries. */
+    for (std::size_t i = 0; i != hinted.size(); i++) {
+        BOOST_CHECK(hinted[i] == hinted[0] + 8 * i);
+    }
+    BOOST_CHECK(placer.get_num_pages() <= recorder.get_num_pages());
+}
+
+BOOST_AUTO_TEST_CASE(test_binned_utilization) {
+    BinnedPlacer placer(6);
+    bool fresh_page;
+    std::vector<VirtAddr> allocated;
+    for (int i = 0; i != 10; i++) {
+        allocated.push_back(placer.allocate_virtual(8, fresh_page));
+    }
+    allocated.push_back(placer.allocate_virtual(16, fresh_page));
+
+    mage::memprog::PlacementUtilization utilization = placer.get_utilization();
+    BOOST_CHECK(utilization.live_bytes == 10 * 8 + 16);
+    BOOST_CHECK(utilization.allocated_pages == 3);
+    BOOST_CHECK(placer.get_peak_allocated_pages() == 3);
+
+    /* Emptying the first page of 8-byte slots releases it. */
+    for (int i = 0; i != 8; i++) {
+        placer.deallocate_virtual(allocated[i], 8);
+    }
+    utilization = placer.get_utilization();
+    BOOST_CHECK(utilization.live_bytes == 2 * 8 + 16);
+    BOOST_CHECK(utilization.allocated_pages == 2);
+    BOOST_CHECK(placer.get_peak_allocated_pages() == 3);
+
+    std::map<mage::memprog::AllocationSize, mage::VirtPageNumber> peaks = placer.get_peak_pages_by_size();
+    BOOST_CHECK(peaks.size() == 2);
+    BOOST_CHECK(peaks[8] == 2);
+    BOOST_CHECK(peaks[16] == 1);
+}
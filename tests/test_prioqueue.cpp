@@ -152,7 +152,7 @@ BOOST_DATA_TEST_CASE(test_prioqueue_second_min, bdata::make(reverse) + RandomInt
     }
 }
 
-BOOST_DATA_TEST_CASE(test_prioqueue_decrease_key, bdata::make(reverse) + RandomIntsDataset(99)) {
+BOOST_DATA_TEST_CASE(test_prioqueue_decrease_key, (bdata::make(reverse) + RandomIntsDataset(99)) * bdata::make({ false, true }), sample, dense) {
     std::vector<int> numbers(sample.data);
 
     std::vector<int> numbers2;
@@ -166,11 +166,15 @@ BOOST_DATA_TEST_CASE(test_prioqueue_decrease_key, bdata::make(reverse) + RandomI
     }
 
     PriorityQueue<int, int> pq;
+    if (dense) {
+        pq.make_dense(257);
+    }
     for (int i = 0; i != numbers.size(); i++) {
         pq.insert(numbers2[i], numbers[i]);
     }
 
     for (int i = 0; i != numbers.size(); i++) {
+        BOOST_CHECK(pq.contains(numbers[i]));
         pq.decrease_key(numbers[i], numbers[i]);
     }
 
@@ -178,6 +182,7 @@ BOOST_DATA_TEST_CASE(test_prioqueue_decrease_key, bdata::make(reverse) + RandomI
     while (!pq.empty()) {
         auto res = pq.remove_min();
         BOOST_CHECK(res.first == res.second);
+        BOOST_CHECK(!pq.contains(res.second));
         popped.push_back(res.second);
     }
 
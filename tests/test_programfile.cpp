@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+#include "instruction.hpp"
+#include "opcode.hpp"
+#include "programfile.hpp"
+
+using mage::CompactInstructionCodec;
+using mage::OpCode;
+using mage::PackedPhysInstruction;
+using mage::physical_address_bits;
+using mage::storage_address_bits;
+
+static PackedPhysInstruction make_three_args(OpCode op, std::uint64_t output, std::uint64_t input1, std::uint64_t input2, std::uint64_t input3) {
+    PackedPhysInstruction phys;
+    std::fill(reinterpret_cast<std::uint8_t*>(&phys), reinterpret_cast<std::uint8_t*>(&phys) + sizeof(phys), 0);
+    phys.header.operation = op;
+    phys.header.flags = 0;
+    phys.three_args.width = 128;
+    phys.three_args.output = output;
+    phys.three_args.input1 = input1;
+    phys.three_args.input2 = input2;
+    phys.three_args.input3 = input3;
+    return phys;
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_codec_roundtrip) {
+    std::vector<PackedPhysInstruction> program;
+    program.push_back(make_three_args(OpCode::IntLess, 36864, 16384, 3968, 0));
+    program.push_back(make_three_args(OpCode::ValueSelect, 24576, 3968, 16384, 36864));
+    program.push_back(make_three_args(OpCode::BitXOR, 3840, 24576, 16384, 0));
+    program.push_back(make_three_args(OpCode::Copy, (UINT64_C(1) << physical_address_bits) - 1, 0, 0, 0));
+
+    PackedPhysInstruction constant = make_three_args(OpCode::PublicConstant, 8, 0, 0, 0);
+    constant.constant.constant = UINT64_MAX;
+    program.push_back(constant);
+
+    PackedPhysInstruction swap = make_three_args(OpCode::IssueSwapIn, 0, 0, 0, 0);
+    swap.swap.memory = 7;
+    swap.swap.storage = (UINT64_C(1) << storage_address_bits) - 1;
+    program.push_back(swap);
+
+    PackedPhysInstruction receive = make_three_args(OpCode::NetworkPostReceive, 24576, 0, 0, 0);
+    program.push_back(receive);
+
+    std::vector<std::uint8_t> encoded(program.size() * CompactInstructionCodec<physical_address_bits, storage_address_bits>::max_encoded_size);
+    CompactInstructionCodec<physical_address_bits, storage_address_bits> encoder;
+    std::size_t offset = 0;
+    for (const PackedPhysInstruction& phys : program) {
+        offset += encoder.encode(phys, &encoded[offset]);
+    }
+    std::size_t end = offset;
+
+    CompactInstructionCodec<physical_address_bits, storage_address_bits> decoder;
+    offset = 0;
+    for (const PackedPhysInstruction& phys : program) {
+        PackedPhysInstruction decoded;
+        offset += decoder.decode(&encoded[offset], decoded);
+        BOOST_REQUIRE(decoded.header.operation == phys.header.operation);
+        BOOST_REQUIRE(decoded.size() == phys.size());
+        const std::uint8_t* expected = reinterpret_cast<const std::uint8_t*>(&phys);
+        const std::uint8_t* actual = reinterpret_cast<const std::uint8_t*>(&decoded);
+        BOOST_CHECK(std::equal(expected, expected + phys.size(), actual));
+    }
+    BOOST_CHECK(offset == end);
+}
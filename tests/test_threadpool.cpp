@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+#include "boost/test/data/test_case.hpp"
+#include "boost/test/data/monomorphic.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "util/threadpool.hpp"
+
+namespace bdata = boost::unit_test::data;
+using mage::util::ThreadPool;
+
+constexpr const unsigned int max_num_threads = 8;
+constexpr const std::uint64_t num_loops = 100;
+
+BOOST_DATA_TEST_CASE(test_threadpool_covers_iterations, bdata::xrange(1u, max_num_threads + 1), num_threads) {
+    ThreadPool pool(num_threads);
+    BOOST_REQUIRE(pool.size() == num_threads);
+
+    for (std::uint64_t loop = 0; loop != num_loops; loop++) {
+        std::uint64_t num_iterations = loop * 7;
+        std::vector<std::atomic<std::uint64_t>> visits(num_iterations);
+        std::vector<std::atomic<std::uint64_t>> per_thread(num_threads);
+        std::atomic<std::uint64_t> bad_indices(0);
+        /* Boost.Test assertions are not thread-safe, so check afterward. */
+        pool.parallel_for(num_iterations, [&](std::uint64_t i) {
+            visits[i].fetch_add(1);
+            unsigned int index = ThreadPool::current_index();
+            if (index < num_threads) {
+                per_thread[index].fetch_add(1);
+            } else {
+                bad_indices.fetch_add(1);
+            }
+        });
+
+        BOOST_CHECK(bad_indices.load() == 0);
+
+        for (std::uint64_t i = 0; i != num_iterations; i++) {
+            BOOST_CHECK_MESSAGE(visits[i].load() == 1, "iteration " << i << " ran " << visits[i].load() << " times");
+        }
+        std::uint64_t total = 0;
+        for (std::atomic<std::uint64_t>& count : per_thread) {
+            total += count.load();
+        }
+        BOOST_CHECK(total == num_iterations);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_threadpool_caller_index) {
+    ThreadPool pool(4);
+    BOOST_CHECK(ThreadPool::current_index() == 0);
+    unsigned int index = 1;
+    pool.parallel_for(1, [&](std::uint64_t) {
+        index = ThreadPool::current_index();
+    });
+    BOOST_CHECK(index == 0);
+}
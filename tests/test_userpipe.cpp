@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+#include "boost/test/data/test_case.hpp"
+#include "boost/test/data/monomorphic.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "util/userpipe.hpp"
+
+namespace bdata = boost::unit_test::data;
+using mage::util::SPSCUserPipe;
+
+constexpr const std::size_t userpipe_capacity = 61;
+constexpr const std::uint64_t userpipe_num_elements = 1 << 16;
+
+BOOST_DATA_TEST_CASE(test_spsc_userpipe_contiguous, bdata::xrange(1, 17), step_size) {
+    SPSCUserPipe<std::uint64_t> pipe(userpipe_capacity);
+
+    std::thread producer([&pipe, step_size]() {
+        std::vector<std::uint64_t> x(step_size);
+        for (std::uint64_t i = 0; i < userpipe_num_elements; i += step_size) {
+            std::uint64_t count = std::min<std::uint64_t>(step_size, userpipe_num_elements - i);
+            for (std::uint64_t k = 0; k != count; k++) {
+                x[k] = i + k;
+            }
+            pipe.write_contiguous(x.data(), count);
+        }
+        pipe.close();
+    });
+
+    std::vector<std::uint64_t> y(step_size + 1);
+    std::uint64_t expected = 0;
+    std::size_t read;
+    while ((read = pipe.read_contiguous(y.data(), step_size + 1)) != 0) {
+        for (std::size_t k = 0; k != read; k++) {
+            BOOST_CHECK_MESSAGE(y[k] == expected, "read " << y[k] << ", but expected " << expected);
+            expected++;
+        }
+    }
+    producer.join();
+
+    BOOST_CHECK_MESSAGE(expected == userpipe_num_elements, "read " << expected << " elements, but expected " << userpipe_num_elements);
+}
+
+BOOST_DATA_TEST_CASE(test_spsc_userpipe_in_place, bdata::xrange(1, 9), batch_size) {
+    SPSCUserPipe<std::uint64_t> pipe(batch_size * 4);
+    std::uint64_t num_batches = userpipe_num_elements / batch_size;
+
+    std::thread producer([&pipe, batch_size, num_batches]() {
+        for (std::uint64_t i = 0; i != num_batches; i++) {
+            std::uint64_t* batch = pipe.start_write_in_place(batch_size);
+            for (std::uint64_t k = 0; k != batch_size; k++) {
+                batch[k] = i * batch_size + k;
+            }
+            pipe.finish_write_in_place(batch_size);
+        }
+        pipe.close();
+    });
+
+    std::uint64_t expected = 0;
+    const std::uint64_t* batch;
+    while ((batch = pipe.start_read_in_place(batch_size)) != nullptr) {
+        for (std::uint64_t k = 0; k != batch_size; k++) {
+            BOOST_CHECK_MESSAGE(batch[k] == expected, "read " << batch[k] << ", but expected " << expected);
+            expected++;
+        }
+        pipe.finish_read_in_place(batch_size);
+    }
+    producer.join();
+
+    BOOST_CHECK_MESSAGE(expected == num_batches * batch_size, "read " << expected << " elements, but expected " << num_batches * batch_size);
+}
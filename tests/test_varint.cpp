@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020 Sam Kumar <samkumar@cs.berkeley.edu>
+ * Copyright (C) 2020 University of California, Berkeley
+ * All rights reserved.
+ *
+ * This file is part of MAGE.
+ *
+ * MAGE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MAGE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MAGE.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+#include "boost/test/data/test_case.hpp"
+#include "boost/test/data/monomorphic.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+#include "util/varint.hpp"
+
+namespace bdata = boost::unit_test::data;
+using mage::util::decode_varint;
+using mage::util::encode_varint;
+using mage::util::max_varint_size;
+
+BOOST_DATA_TEST_CASE(test_varint_roundtrip, bdata::xrange(64), bit) {
+    std::array<std::uint64_t, 3> values = { (UINT64_C(1) << bit) - 1, UINT64_C(1) << bit, (UINT64_C(1) << bit) + 1 };
+    for (std::uint64_t value : values) {
+        std::array<std::uint8_t, max_varint_size(64)> buffer;
+        std::size_t encoded_size = encode_varint(value, buffer.data());
+        BOOST_CHECK(encoded_size <= max_varint_size(64));
+        BOOST_CHECK(encoded_size == (value == 0 ? 1 : max_varint_size(64 - __builtin_clzll(value))));
+
+        std::uint64_t decoded;
+        std::size_t decoded_size = decode_varint(buffer.data(), decoded);
+        BOOST_CHECK_MESSAGE(decoded == value, "encoded " << value << ", but decoded " << decoded);
+        BOOST_CHECK(decoded_size == encoded_size);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_varint_sequence) {
+    std::array<std::uint64_t, 6> values = { 0, 127, 128, 300, UINT64_C(1) << 47, UINT64_MAX };
+    std::array<std::uint8_t, 6 * max_varint_size(64)> buffer;
+    std::size_t offset = 0;
+    for (std::uint64_t value : values) {
+        offset += encode_varint(value, &buffer[offset]);
+    }
+    std::size_t end = offset;
+
+    offset = 0;
+    for (std::uint64_t value : values) {
+        std::uint64_t decoded;
+        offset += decode_varint(&buffer[offset], decoded);
+        BOOST_CHECK(decoded == value);
+    }
+    BOOST_CHECK(offset == end);
+}